@@ -0,0 +1,82 @@
+#ifndef VISUALIZER_BIQUAD_H
+#define VISUALIZER_BIQUAD_H
+#include <audio_filters/kernels.h>
+#include <cstddef>
+#include <vector>
+
+namespace audio
+{
+namespace filters
+{
+/// Second order IIR section, normalized so a0 is 1. Frequencies are fractions of the sample rate
+/// below 0.5, the designs are the ones of the RBJ audio EQ cookbook.
+struct Biquad
+{
+  float b0 = 1.0F;
+  float b1 = 0.0F;
+  float b2 = 0.0F;
+  float a1 = 0.0F;
+  float a2 = 0.0F;
+
+  static Biquad lowpass(double cutoff, double q = 0.7071067811865476);
+  static Biquad highpass(double cutoff, double q = 0.7071067811865476);
+  /// 0 dB at the center
+  static Biquad bandpass(double center, double q);
+  static Biquad low_shelf(double cutoff, double gain_db, double slope = 1.0);
+  static Biquad high_shelf(double cutoff, double gain_db, double slope = 1.0);
+  /// First order, a zero at DC and a pole just inside it
+  static Biquad dc_block(double cutoff);
+};
+
+/// Butterworth lowpass or highpass as a cascade, order is rounded up to an even number
+std::vector<Biquad> butterworth_lowpass(double cutoff, unsigned order);
+std::vector<Biquad> butterworth_highpass(double cutoff, unsigned order);
+
+/// Cascade of biquads in transposed direct form II for a single channel
+class BiquadCascade
+{
+public:
+  explicit BiquadCascade(const std::vector<Biquad> &sections);
+
+  /// in and out may be the same
+  void process(const float *in, float *out, std::size_t count);
+  void reset();
+
+private:
+  std::vector<Biquad> m_sections;
+  // Two delays per section
+  std::vector<float> m_state;
+};
+
+/// Up to BIQUAD_LANES cascades run side by side, a lane of the vector registers each. Either a
+/// channel per lane, or one signal split into bands.
+class BiquadBank
+{
+public:
+  /// One cascade per lane, those with fewer sections than the longest are padded with ones that pass
+  explicit BiquadBank(const std::vector<std::vector<Biquad>> &cascades);
+
+  /// A channel per cascade, planar. in and out may be the same.
+  void process(const float *const *in, float *const *out, std::size_t frames);
+  /// The same samples through every cascade, out has a plane per cascade
+  void process_bands(const float *in, float *const *out, std::size_t frames);
+  void reset();
+  std::size_t lanes() const
+  {
+    return m_lanes;
+  }
+
+private:
+  void run(float *const *out, std::size_t frames);
+
+  std::size_t m_lanes;
+  std::size_t m_sections;
+  std::vector<float> m_coefficients;
+  std::vector<float> m_state;
+  // Frames with their lanes interleaved, the way the kernel takes them
+  std::vector<float> m_frames;
+};
+}
+}
+
+#endif //VISUALIZER_BIQUAD_H
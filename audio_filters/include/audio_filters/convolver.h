@@ -0,0 +1,47 @@
+#ifndef VISUALIZER_CONVOLVER_H
+#define VISUALIZER_CONVOLVER_H
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace audio
+{
+namespace filters
+{
+/// Block convolution with a FIR filter, picking the cheaper way from the number of taps and the
+/// block size. Short filters run in direct form. Long ones keep their first partition in direct
+/// form and convolve the rest in uniform partitions through FFTs (overlap-save), whose results
+/// are ready before they are due, so neither way adds latency.
+///
+/// The cost estimate has the FFT part pay off from about 100 taps with the scalar kernels, 450 with
+/// SSE2, 1000 with AVX2 and 2200 with AVX-512. The lowpasses of filters.h have 301 taps, so they only
+/// use the FFTs when the kernels run scalar.
+class Convolver
+{
+public:
+  /// taps[0] weighs the oldest sample like in lowpass_taps(), the newest one isn't part of its own output.
+  /// block_size is how many samples process() is usually given, partitions aren't made longer.
+  Convolver(const std::vector<float> &taps, std::size_t block_size);
+  /// Uses the given partition size instead of the estimate, 0 for direct form. Others must be a power
+  /// of two from 32 to 1024 and below the number of taps, std::invalid_argument otherwise.
+  static Convolver partitioned(const std::vector<float> &taps, std::size_t partition);
+  ~Convolver();
+  Convolver(Convolver &&other) noexcept;
+  Convolver &operator=(Convolver &&other) noexcept;
+
+  /// in and out may be the same
+  void process(const float *in, float *out, std::size_t count);
+  void reset();
+  /// Samples per partition of the FFT part, 0 when everything runs in direct form
+  std::size_t partition_size() const;
+
+private:
+  struct State;
+  explicit Convolver(std::unique_ptr<State> state);
+
+  std::unique_ptr<State> m_state;
+};
+}
+}
+
+#endif //VISUALIZER_CONVOLVER_H
@@ -0,0 +1,67 @@
+#ifndef VISUALIZER_DECIMATOR_H
+#define VISUALIZER_DECIMATOR_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace audio
+{
+namespace filters
+{
+/// Windowed sinc lowpass (Blackman window), cutoff as a fraction of the sample rate below 0.5
+std::vector<float> design_lowpass(double cutoff, std::size_t taps);
+
+/// Filters and keeps every factor-th output, the outputs in between are never computed. Each kept
+/// output is one dot product over the window ending at its sample, which is what the phases of a
+/// polyphase decimator add up to.
+class Decimator
+{
+public:
+  /// taps[0] weighs the oldest sample of the window, the last one the sample the output is kept at.
+  /// The first output is kept at the first sample after construction or reset().
+  Decimator(const std::vector<float> &taps, std::uint32_t factor);
+
+  /// Writes the outputs that fall into these samples and returns how many, at most count / factor + 1
+  std::size_t process(const float *in, std::size_t count, float *out);
+  void reset();
+  std::uint32_t factor() const
+  {
+    return m_factor;
+  }
+
+private:
+  std::vector<float> m_taps;
+  std::uint32_t m_factor;
+  // The last taps - 1 samples, then room for a block of as many as there are taps
+  std::vector<float> m_history;
+  // Samples to skip in the next block until an output is kept
+  std::size_t m_next = 0;
+};
+
+/// Decimation in stages, 48 kHz to 1.5 kHz is cheaper as 4, 4 and 2 than as 32 at once. Every stage
+/// gets its own lowpass, only as steep as needed to keep aliases out of what the last stage keeps.
+class DecimatorCascade
+{
+public:
+  /// Stages in the order the samples pass them, each with a factor of at least 2, std::invalid_argument
+  /// otherwise. passband is the fraction of the final rate that is kept free of aliases, below 0.5.
+  explicit DecimatorCascade(const std::vector<std::uint32_t> &factors, double passband = 0.4);
+
+  /// Same as Decimator::process, for the product of the factors
+  std::size_t process(const float *in, std::size_t count, float *out);
+  void reset();
+  std::uint32_t factor() const;
+  const std::vector<Decimator> &stages() const
+  {
+    return m_stages;
+  }
+
+private:
+  std::vector<Decimator> m_stages;
+  // Output of every stage but the last
+  std::vector<std::vector<float>> m_between;
+};
+}
+}
+
+#endif //VISUALIZER_DECIMATOR_H
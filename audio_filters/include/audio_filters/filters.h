@@ -1,12 +1,43 @@
 #ifndef VISUALIZER_FILTERS_H
 #define VISUALIZER_FILTERS_H
+#include <audio_filters/convolver.h>
+#include <cstddef>
 #include <vector>
 
 namespace audio
 {
 namespace filters
 {
-std::vector<float> lowpass(const std::vector<float> to_filter);
+/// Equiripple FIR lowpasses for 48 kHz
+enum class LowpassDesign
+{
+  pass180_stop400,
+  pass100_stop180,
+};
+
+const std::vector<float> &lowpass_taps(LowpassDesign design);
+
+/// One of the lowpasses above with its own history, one per channel or stream. Different instances
+/// share nothing, so they can run on different threads.
+class Lowpass
+{
+public:
+  /// block_size is how many samples process() is usually given, see Convolver
+  explicit Lowpass(LowpassDesign design = LowpassDesign::pass180_stop400, std::size_t block_size = 512);
+
+  /// in and out may be the same
+  void process(const float *in, float *out, std::size_t count);
+  /// Forgets the samples filtered so far, for input that doesn't follow on from them (BUFFER_DISCONTINUITY)
+  void reset();
+  LowpassDesign design() const
+  {
+    return m_design;
+  }
+
+private:
+  LowpassDesign m_design;
+  Convolver m_convolver;
+};
 }
 }
 
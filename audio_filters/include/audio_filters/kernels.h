@@ -0,0 +1,51 @@
+#ifndef VISUALIZER_KERNELS_H
+#define VISUALIZER_KERNELS_H
+#include <cstddef>
+#include <cstdint>
+
+namespace audio
+{
+namespace filters
+{
+/// Instruction sets the kernels below are written for, each level implies the ones before it
+enum class SimdLevel
+{
+  scalar,
+  sse2,
+  avx2,
+  avx512,
+};
+
+/// Level the kernels run at. The best one the cpu supports is picked the first time any kernel runs,
+/// unless the AUDIO_FILTERS_SIMD environment variable names a lower one (scalar, sse2, avx2, avx512).
+SimdLevel simd_level();
+/// Switches every kernel to the given level, for comparing variants. False if the cpu can't run it.
+bool select_simd_level(SimdLevel level);
+const char *simd_level_name(SimdLevel level);
+
+/// Sum of a[i] * b[i], the inner loop of a FIR filter
+float dot(const float *a, const float *b, std::size_t count);
+
+/// count outputs of a FIR filter over a linear history, out[k] is the sum of taps[i] * samples[k + i].
+/// samples holds count + tap_count - 1 values and taps is in the order of the samples, oldest first.
+/// Several outputs are computed per pass over the taps.
+void fir(const float *samples, const float *taps, std::size_t tap_count, float *out, std::size_t count);
+
+/// Channels or bands the biquad kernel runs side by side, one AVX2 register
+const std::size_t BIQUAD_LANES = 8;
+/// Filters frames of BIQUAD_LANES interleaved lanes in place through a cascade of biquads in transposed
+/// direct form II. coefficients holds b0, b1, b2, a1 and a2 of every section in turn, each as one value
+/// per lane, state holds the two delays of every section the same way.
+void biquad_lanes(const float *coefficients, float *state, std::size_t sections, float *samples, std::size_t frames);
+
+/// Straight lines between consecutive input samples, factor outputs per input. The last input only
+/// ends the final line, so (frames - 1) * factor samples are written. Returns how many.
+std::size_t interpolate_linear(const float *in, std::size_t frames, std::uint32_t factor, float *out);
+
+/// Offset into samples where the pattern matches best, by the sum of squared differences.
+/// Only offsets where the whole pattern fits are tried, 0 if there are none.
+std::size_t best_match(const float *pattern, std::size_t pattern_size, const float *samples, std::size_t count);
+}
+}
+
+#endif //VISUALIZER_KERNELS_H
@@ -0,0 +1,208 @@
+#include <audio_filters/biquad.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+const double PI = 3.14159265358979323846;
+// Frames moved into the lanes at a time
+const std::size_t CHUNK = 256;
+
+void check_frequency(double frequency)
+{
+  if (frequency <= 0 || frequency >= 0.5)
+    throw std::invalid_argument("biquad frequencies have to be between 0 and half the sample rate");
+}
+
+audio::filters::Biquad normalized(double b0, double b1, double b2, double a0, double a1, double a2)
+{
+  audio::filters::Biquad section;
+  section.b0 = static_cast<float>(b0 / a0);
+  section.b1 = static_cast<float>(b1 / a0);
+  section.b2 = static_cast<float>(b2 / a0);
+  section.a1 = static_cast<float>(a1 / a0);
+  section.a2 = static_cast<float>(a2 / a0);
+  return section;
+}
+
+// Shelves share everything but the sign of the cosine terms
+audio::filters::Biquad shelf(double cutoff, double gain_db, double slope, double sign)
+{
+  check_frequency(cutoff);
+  const double a = std::pow(10.0, gain_db / 40);
+  const double w0 = 2 * PI * cutoff;
+  const double cosine = sign * std::cos(w0);
+  const double alpha = std::sin(w0) / 2 * std::sqrt((a + 1 / a) * (1 / slope - 1) + 2);
+  const double root = 2 * std::sqrt(a) * alpha;
+  return normalized(a * ((a + 1) - (a - 1) * cosine + root), sign * 2 * a * ((a - 1) - (a + 1) * cosine),
+                    a * ((a + 1) - (a - 1) * cosine - root), (a + 1) + (a - 1) * cosine + root,
+                    sign * -2 * ((a - 1) + (a + 1) * cosine), (a + 1) + (a - 1) * cosine - root);
+}
+
+std::vector<audio::filters::Biquad> butterworth(double cutoff, unsigned order, bool high)
+{
+  std::vector<audio::filters::Biquad> sections;
+  const unsigned pairs = std::max(1U, (order + 1) / 2);
+  // The poles of a pair sit at these angles, each gives the q of its section
+  for (unsigned k = 0; k < pairs; k++) {
+    const double q = 1 / (2 * std::cos((2 * k + 1) * PI / (4 * pairs)));
+    sections.push_back(high ? audio::filters::Biquad::highpass(cutoff, q) : audio::filters::Biquad::lowpass(cutoff, q));
+  }
+  return sections;
+}
+}
+
+namespace audio
+{
+namespace filters
+{
+Biquad Biquad::lowpass(double cutoff, double q)
+{
+  check_frequency(cutoff);
+  const double w0 = 2 * PI * cutoff;
+  const double cosine = std::cos(w0);
+  const double alpha = std::sin(w0) / (2 * q);
+  return normalized((1 - cosine) / 2, 1 - cosine, (1 - cosine) / 2, 1 + alpha, -2 * cosine, 1 - alpha);
+}
+
+Biquad Biquad::highpass(double cutoff, double q)
+{
+  check_frequency(cutoff);
+  const double w0 = 2 * PI * cutoff;
+  const double cosine = std::cos(w0);
+  const double alpha = std::sin(w0) / (2 * q);
+  return normalized((1 + cosine) / 2, -(1 + cosine), (1 + cosine) / 2, 1 + alpha, -2 * cosine, 1 - alpha);
+}
+
+Biquad Biquad::bandpass(double center, double q)
+{
+  check_frequency(center);
+  const double w0 = 2 * PI * center;
+  const double alpha = std::sin(w0) / (2 * q);
+  return normalized(alpha, 0, -alpha, 1 + alpha, -2 * std::cos(w0), 1 - alpha);
+}
+
+Biquad Biquad::low_shelf(double cutoff, double gain_db, double slope)
+{
+  return shelf(cutoff, gain_db, slope, 1);
+}
+
+Biquad Biquad::high_shelf(double cutoff, double gain_db, double slope)
+{
+  return shelf(cutoff, gain_db, slope, -1);
+}
+
+Biquad Biquad::dc_block(double cutoff)
+{
+  check_frequency(cutoff);
+  const double pole = std::exp(-2 * PI * cutoff);
+  return normalized(1, -1, 0, 1, -pole, 0);
+}
+
+std::vector<Biquad> butterworth_lowpass(double cutoff, unsigned order)
+{
+  return butterworth(cutoff, order, false);
+}
+
+std::vector<Biquad> butterworth_highpass(double cutoff, unsigned order)
+{
+  return butterworth(cutoff, order, true);
+}
+
+BiquadCascade::BiquadCascade(const std::vector<Biquad> &sections)
+    : m_sections(sections), m_state(2 * sections.size())
+{
+}
+
+void BiquadCascade::process(const float *in, float *out, std::size_t count)
+{
+  std::copy(in, in + count, out);
+  for (std::size_t s = 0; s < m_sections.size(); s++) {
+    const Biquad &section = m_sections[s];
+    float z1 = m_state[2 * s];
+    float z2 = m_state[2 * s + 1];
+    for (std::size_t i = 0; i < count; i++) {
+      const float x = out[i];
+      const float y = section.b0 * x + z1;
+      z1 = section.b1 * x - section.a1 * y + z2;
+      z2 = section.b2 * x - section.a2 * y;
+      out[i] = y;
+    }
+    m_state[2 * s] = z1;
+    m_state[2 * s + 1] = z2;
+  }
+}
+
+void BiquadCascade::reset()
+{
+  std::fill(m_state.begin(), m_state.end(), 0.0F);
+}
+
+BiquadBank::BiquadBank(const std::vector<std::vector<Biquad>> &cascades)
+    : m_lanes(cascades.size()), m_sections(0), m_frames(CHUNK * BIQUAD_LANES)
+{
+  if (cascades.empty() || cascades.size() > BIQUAD_LANES)
+    throw std::invalid_argument("a biquad bank takes between 1 and " + std::to_string(BIQUAD_LANES) + " cascades");
+  for (const auto &cascade : cascades)
+    m_sections = std::max(m_sections, cascade.size());
+
+  m_coefficients.resize(m_sections * 5 * BIQUAD_LANES);
+  m_state.resize(m_sections * 2 * BIQUAD_LANES);
+  for (std::size_t s = 0; s < m_sections; s++) {
+    float *c = &m_coefficients[s * 5 * BIQUAD_LANES];
+    for (std::size_t lane = 0; lane < BIQUAD_LANES; lane++) {
+      const Biquad section = lane < m_lanes && s < cascades[lane].size() ? cascades[lane][s] : Biquad();
+      c[lane] = section.b0;
+      c[BIQUAD_LANES + lane] = section.b1;
+      c[2 * BIQUAD_LANES + lane] = section.b2;
+      c[3 * BIQUAD_LANES + lane] = section.a1;
+      c[4 * BIQUAD_LANES + lane] = section.a2;
+    }
+  }
+}
+
+void BiquadBank::process(const float *const *in, float *const *out, std::size_t frames)
+{
+  for (std::size_t done = 0; done < frames; done += CHUNK) {
+    const std::size_t chunk = std::min(CHUNK, frames - done);
+    for (std::size_t f = 0; f < chunk; f++) {
+      for (std::size_t lane = 0; lane < m_lanes; lane++)
+        m_frames[f * BIQUAD_LANES + lane] = in[lane][done + f];
+    }
+    float *planes[BIQUAD_LANES];
+    for (std::size_t lane = 0; lane < m_lanes; lane++)
+      planes[lane] = out[lane] + done;
+    run(planes, chunk);
+  }
+}
+
+void BiquadBank::process_bands(const float *in, float *const *out, std::size_t frames)
+{
+  for (std::size_t done = 0; done < frames; done += CHUNK) {
+    const std::size_t chunk = std::min(CHUNK, frames - done);
+    for (std::size_t f = 0; f < chunk; f++)
+      std::fill_n(&m_frames[f * BIQUAD_LANES], m_lanes, in[done + f]);
+    float *planes[BIQUAD_LANES];
+    for (std::size_t lane = 0; lane < m_lanes; lane++)
+      planes[lane] = out[lane] + done;
+    run(planes, chunk);
+  }
+}
+
+void BiquadBank::run(float *const *out, std::size_t frames)
+{
+  biquad_lanes(m_coefficients.data(), m_state.data(), m_sections, m_frames.data(), frames);
+  for (std::size_t f = 0; f < frames; f++) {
+    for (std::size_t lane = 0; lane < m_lanes; lane++)
+      out[lane][f] = m_frames[f * BIQUAD_LANES + lane];
+  }
+}
+
+void BiquadBank::reset()
+{
+  std::fill(m_state.begin(), m_state.end(), 0.0F);
+}
+}
+}
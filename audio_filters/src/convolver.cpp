@@ -0,0 +1,256 @@
+#include <audio_filters/convolver.h>
+#include <audio_filters/kernels.h>
+#include "fft.h"
+#include "fir.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+using audio::filters::detail::MAX_TRANSFORM;
+using audio::filters::detail::MIN_TRANSFORM;
+
+double simd_lanes()
+{
+  switch (audio::filters::simd_level()) {
+    case audio::filters::SimdLevel::scalar:
+      return 1;
+    case audio::filters::SimdLevel::sse2:
+      return 4;
+    case audio::filters::SimdLevel::avx2:
+      return 8;
+    case audio::filters::SimdLevel::avx512:
+      return 16;
+  }
+  return 1;
+}
+
+// Rough flops per output sample, only good for comparing the two ways with each other.
+// The direct form runs on the vector kernels, the transforms are taken as scalar. With AVX2 the
+// estimate has them break even at about 1000 taps, where measurements put the crossover too.
+double direct_cost(std::size_t taps)
+{
+  return 2.0 * taps / simd_lanes();
+}
+
+double partitioned_cost(std::size_t taps, std::size_t partition)
+{
+  const double partitions = std::ceil(double(taps - partition) / partition);
+  // The first partition in direct form, a forward and an inverse transform of twice the partition
+  // per partition of samples, and a complex multiply-add per bin of every other partition
+  return direct_cost(partition) + 2 * 5 * 2.0 * std::log2(2.0 * partition) + 8 * partitions * (partition + 1) / partition;
+}
+
+// 0 for direct form
+std::size_t choose_partition(std::size_t taps, std::size_t block_size)
+{
+  std::size_t best = 0;
+  double best_cost = direct_cost(taps);
+  const std::size_t longest = std::min(MAX_TRANSFORM / 2, std::max(block_size, MIN_TRANSFORM / 2));
+  for (std::size_t partition = MIN_TRANSFORM / 2; partition <= longest && partition < taps; partition *= 2) {
+    const double cost = partitioned_cost(taps, partition);
+    if (cost < best_cost) {
+      best_cost = cost;
+      best = partition;
+    }
+  }
+  return best;
+}
+
+std::vector<float> head_taps(const std::vector<float> &taps, std::size_t partition)
+{
+  if (partition == 0)
+    return taps;
+  return std::vector<float>(taps.end() - partition, taps.end());
+}
+
+// sum += a * b over count bins
+void multiply_accumulate(const std::complex<float> *a, const std::complex<float> *b, std::complex<float> *sum,
+                         std::size_t count)
+{
+  const float *x = reinterpret_cast<const float *>(a);
+  const float *y = reinterpret_cast<const float *>(b);
+  float *s = reinterpret_cast<float *>(sum);
+  for (std::size_t i = 0; i < 2 * count; i += 2) {
+    s[i] += x[i] * y[i] - x[i + 1] * y[i + 1];
+    s[i + 1] += x[i] * y[i + 1] + x[i + 1] * y[i];
+  }
+}
+}
+
+namespace audio
+{
+namespace filters
+{
+// The filter is split by how long ago the samples it weighs arrived. The newest partition of
+// samples goes through the direct form, sample by sample. Every older partition of the filter
+// only sees blocks that are complete by the time its output is due, so once a block of input is
+// complete its spectrum is multiplied with the spectra of those partitions and transformed back
+// into the tail of every output of the next block.
+//
+// Taps are given in window order with the newest sample left out, so the impulse response is the
+// taps reversed over the input delayed by one sample. That delayed input is what the blocks hold.
+struct Convolver::State
+{
+  State(const std::vector<float> &taps, std::size_t partition)
+      : head(head_taps(taps, partition)), partition(partition)
+  {
+    if (partition == 0)
+      return;
+    const std::size_t size = 2 * partition;
+    transform = detail::make_transform(size);
+    partitions = (taps.size() - 1) / partition;
+    filters.resize(partitions * size);
+    spectra.resize(partitions * size);
+    input.resize(size);
+    tail.resize(partition);
+    next_tail.resize(partition);
+    chunk.resize(partition);
+    scratch.resize(size);
+
+    // Partition p weighs the samples p * partition to (p + 1) * partition - 1 samples old
+    for (std::size_t p = 1; p <= partitions; p++) {
+      std::complex<float> *spectrum = &filters[(p - 1) * size];
+      for (std::size_t j = 0; j < partition && p * partition + j < taps.size(); j++)
+        spectrum[j] = taps[taps.size() - 1 - p * partition - j];
+      transform->forward(spectrum);
+    }
+    reset();
+  }
+
+  void reset()
+  {
+    head.reset();
+    if (partition == 0)
+      return;
+    std::fill(spectra.begin(), spectra.end(), std::complex<float>());
+    std::fill(input.begin(), input.end(), 0.0F);
+    std::fill(tail.begin(), tail.end(), 0.0F);
+    std::fill(next_tail.begin(), next_tail.end(), 0.0F);
+    newest = 0;
+    // The input is delayed by one sample, that one is silence
+    fill = 1;
+    position = 0;
+  }
+
+  void process(const float *in, float *out, std::size_t count)
+  {
+    if (partition == 0) {
+      head.process(in, out, count);
+      return;
+    }
+    while (count > 0) {
+      const std::size_t block = std::min(count, partition);
+      // Kept apart, out may be in
+      std::copy(in, in + block, chunk.begin());
+      head.process(chunk.data(), out, block);
+      for (std::size_t k = 0; k < block; k++) {
+        out[k] += tail[position];
+        if (++position == partition) {
+          std::swap(tail, next_tail);
+          position = 0;
+        }
+        input[partition + fill] = chunk[k];
+        // One sample ahead of the output, the next tail is always ready before it is needed
+        if (++fill == partition)
+          complete_block();
+      }
+      in += block;
+      out += block;
+      count -= block;
+    }
+  }
+
+  // Overlap-save, the block is transformed together with the one before it
+  void complete_block()
+  {
+    const std::size_t size = 2 * partition;
+    std::copy(input.begin(), input.end(), scratch.begin());
+    transform->forward(scratch.data());
+    newest = (newest + 1) % partitions;
+    std::copy(scratch.begin(), scratch.end(), spectra.begin() + newest * size);
+
+    // Real signals, the upper half of the spectrum mirrors the lower one
+    std::fill(scratch.begin(), scratch.end(), std::complex<float>());
+    for (std::size_t p = 1; p <= partitions; p++) {
+      const std::size_t block = (newest + partitions - (p - 1)) % partitions;
+      multiply_accumulate(&spectra[block * size], &filters[(p - 1) * size], scratch.data(), partition + 1);
+    }
+    for (std::size_t k = 1; k < partition; k++)
+      scratch[size - k] = std::conj(scratch[k]);
+    transform->inverse(scratch.data());
+    // The first half wrapped around, the second is the linear convolution
+    for (std::size_t k = 0; k < partition; k++)
+      next_tail[k] = scratch[partition + k].real();
+
+    std::copy(input.begin() + partition, input.end(), input.begin());
+    fill = 0;
+  }
+
+  detail::FirFilter head;
+  std::size_t partition;
+  std::unique_ptr<detail::Transform> transform;
+  // Older partitions of the filter, then the spectra of as many past blocks, newest at newest
+  std::size_t partitions = 0;
+  std::vector<std::complex<float>> filters;
+  std::vector<std::complex<float>> spectra;
+  std::size_t newest = 0;
+  // The previous block and the one being filled
+  std::vector<float> input;
+  std::size_t fill = 0;
+  // Output of the older partitions for the current and the next block
+  std::vector<float> tail;
+  std::vector<float> next_tail;
+  std::size_t position = 0;
+  std::vector<float> chunk;
+  std::vector<std::complex<float>> scratch;
+};
+
+Convolver::Convolver(const std::vector<float> &taps, std::size_t block_size)
+{
+  if (taps.empty())
+    throw std::invalid_argument("a convolver needs at least one tap");
+  m_state.reset(new State(taps, choose_partition(taps.size(), block_size)));
+}
+
+Convolver::Convolver(std::unique_ptr<State> state)
+    : m_state(std::move(state))
+{
+}
+
+Convolver Convolver::partitioned(const std::vector<float> &taps, std::size_t partition)
+{
+  if (taps.empty())
+    throw std::invalid_argument("a convolver needs at least one tap");
+  const bool power_of_two = (partition & (partition - 1)) == 0;
+  if (partition != 0 && (!power_of_two || partition < MIN_TRANSFORM / 2 || partition > MAX_TRANSFORM / 2 ||
+                         partition >= taps.size()))
+    throw std::invalid_argument("partitions are a power of two from " + std::to_string(MIN_TRANSFORM / 2) + " to " +
+                                std::to_string(MAX_TRANSFORM / 2) + " below the number of taps, not " +
+                                std::to_string(partition));
+  return Convolver(std::unique_ptr<State>(new State(taps, partition)));
+}
+
+Convolver::~Convolver() = default;
+Convolver::Convolver(Convolver &&other) noexcept = default;
+Convolver &Convolver::operator=(Convolver &&other) noexcept = default;
+
+void Convolver::process(const float *in, float *out, std::size_t count)
+{
+  m_state->process(in, out, count);
+}
+
+void Convolver::reset()
+{
+  m_state->reset();
+}
+
+std::size_t Convolver::partition_size() const
+{
+  return m_state->partition;
+}
+}
+}
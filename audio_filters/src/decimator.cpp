@@ -0,0 +1,135 @@
+#include <audio_filters/decimator.h>
+#include <audio_filters/kernels.h>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+const double PI = 3.14159265358979323846;
+// Transition width of a Blackman window in cycles per sample, times the taps
+const double BLACKMAN_TRANSITION = 5.5;
+}
+
+namespace audio
+{
+namespace filters
+{
+std::vector<float> design_lowpass(double cutoff, std::size_t taps)
+{
+  if (cutoff <= 0 || cutoff >= 0.5)
+    throw std::invalid_argument("lowpass cutoff has to be between 0 and half the sample rate");
+  if (taps == 0)
+    throw std::invalid_argument("a lowpass needs at least one tap");
+  std::vector<float> designed(taps);
+  const double middle = (taps - 1) / 2.0;
+  double sum = 0;
+  for (std::size_t i = 0; i < taps; i++) {
+    const double t = i - middle;
+    const double sinc = t == 0 ? 2 * cutoff : std::sin(2 * PI * cutoff * t) / (PI * t);
+    const double phase = taps == 1 ? 0 : 2 * PI * i / (taps - 1);
+    const double window = 0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2 * phase);
+    designed[i] = static_cast<float>(sinc * window);
+    sum += designed[i];
+  }
+  // Unity gain at DC
+  for (float &tap : designed)
+    tap = static_cast<float>(tap / sum);
+  return designed;
+}
+
+Decimator::Decimator(const std::vector<float> &taps, std::uint32_t factor)
+    : m_taps(taps), m_factor(factor)
+{
+  if (taps.empty())
+    throw std::invalid_argument("a decimator needs at least one tap");
+  if (factor == 0)
+    throw std::invalid_argument("a decimator needs a factor of at least 1");
+  m_history.resize(2 * taps.size() - 1);
+}
+
+std::size_t Decimator::process(const float *in, std::size_t count, float *out)
+{
+  const std::size_t window = m_taps.size();
+  std::size_t written = 0;
+  while (count > 0) {
+    const std::size_t block = std::min(count, window);
+    std::copy(in, in + block, m_history.begin() + (window - 1));
+    // The window of the sample at position p of the block starts at p
+    std::size_t position = m_next;
+    for (; position < block; position += m_factor)
+      out[written++] = dot(m_history.data() + position, m_taps.data(), window);
+    m_next = position - block;
+    std::copy(m_history.begin() + block, m_history.begin() + block + (window - 1), m_history.begin());
+    in += block;
+    count -= block;
+  }
+  return written;
+}
+
+void Decimator::reset()
+{
+  std::fill(m_history.begin(), m_history.end(), 0.0F);
+  m_next = 0;
+}
+
+DecimatorCascade::DecimatorCascade(const std::vector<std::uint32_t> &factors, double passband)
+{
+  if (factors.empty())
+    throw std::invalid_argument("a decimator cascade needs at least one stage");
+  if (passband <= 0 || passband >= 0.5)
+    throw std::invalid_argument("the passband has to be between 0 and half the final rate");
+  double final_rate = 1.0;
+  for (std::uint32_t factor : factors) {
+    // A stage that keeps every sample would need a lowpass right at its own Nyquist rate
+    if (factor < 2)
+      throw std::invalid_argument("every stage of a decimator cascade needs a factor of at least 2, not " +
+                                  std::to_string(factor));
+    final_rate /= factor;
+  }
+
+  // Rates relative to the input. Whatever is above the output rate less the passband folds down
+  // onto the passband, so the stopband only has to start there.
+  const double pass = passband * final_rate;
+  double rate = 1.0;
+  for (std::uint32_t factor : factors) {
+    const double stop = rate / factor - pass;
+    const double width = (stop - pass) / rate;
+    std::size_t taps = static_cast<std::size_t>(std::ceil(BLACKMAN_TRANSITION / width));
+    // Odd, so the delay is a whole number of samples
+    taps |= 1;
+    m_stages.emplace_back(design_lowpass((pass + stop) / 2 / rate, taps), factor);
+    rate /= factor;
+  }
+  m_between.resize(m_stages.size() - 1);
+}
+
+std::size_t DecimatorCascade::process(const float *in, std::size_t count, float *out)
+{
+  for (std::size_t stage = 0; stage + 1 < m_stages.size(); stage++) {
+    std::vector<float> &between = m_between[stage];
+    const std::size_t most = count / m_stages[stage].factor() + 1;
+    if (between.size() < most)
+      between.resize(most);
+    count = m_stages[stage].process(in, count, between.data());
+    in = between.data();
+  }
+  return m_stages.back().process(in, count, out);
+}
+
+void DecimatorCascade::reset()
+{
+  for (Decimator &stage : m_stages)
+    stage.reset();
+}
+
+std::uint32_t DecimatorCascade::factor() const
+{
+  std::uint32_t product = 1;
+  for (const Decimator &stage : m_stages)
+    product *= stage.factor();
+  return product;
+}
+}
+}
@@ -0,0 +1,105 @@
+#include "fft.h"
+#include <metaFFT/radix2.h>
+#include <metaFFT/radix2_complex.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+namespace policies
+{
+using namespace metaFFT::radix2::std_complex;
+using namespace metaFFT::radix2::std_complex::unrolled_loop;
+}
+
+template <int N>
+class MetaTransform : public audio::filters::detail::Transform
+{
+public:
+  MetaTransform()
+      : Transform(N)
+  {
+  }
+
+  void forward(std::complex<float> *data) override
+  {
+    m_fft.forward(data);
+  }
+
+private:
+  metaFFT::radix2::in_place::fft<N, std::complex<float>, policies::bit_reverse_policy, policies::butterfly_policy> m_fft;
+};
+}
+
+namespace audio
+{
+namespace filters
+{
+namespace detail
+{
+Transform::Transform(std::size_t size)
+    : m_size(size)
+{
+}
+
+void Transform::inverse(std::complex<float> *data)
+{
+  for (std::size_t i = 0; i < m_size; i++)
+    data[i] = std::conj(data[i]);
+  forward(data);
+  for (std::size_t i = 0; i < m_size; i++)
+    data[i] = std::conj(data[i]) * m_scale;
+}
+
+void Transform::calibrate()
+{
+  std::vector<std::complex<float>> impulse(m_size);
+  impulse[0] = 1.0F;
+  forward(impulse.data());
+  inverse(impulse.data());
+  m_scale = 1.0F / impulse[0].real();
+
+  // An impulse at 0 comes back whatever order the bins are in. One further along only does if the
+  // forward transform leaves them in natural order, which inverse() and the convolution rely on.
+  std::vector<std::complex<float>> shifted(m_size);
+  shifted[1] = 1.0F;
+  forward(shifted.data());
+  inverse(shifted.data());
+  for (std::size_t i = 0; i < m_size; i++) {
+    if (std::abs(shifted[i] - std::complex<float>(i == 1 ? 1.0F : 0.0F)) > 1e-4F)
+      throw std::logic_error("the transform of size " + std::to_string(m_size) + " doesn't invert");
+  }
+}
+
+std::unique_ptr<Transform> make_transform(std::size_t size)
+{
+  std::unique_ptr<Transform> transform;
+  switch (size) {
+    case 64:
+      transform.reset(new MetaTransform<64>());
+      break;
+    case 128:
+      transform.reset(new MetaTransform<128>());
+      break;
+    case 256:
+      transform.reset(new MetaTransform<256>());
+      break;
+    case 512:
+      transform.reset(new MetaTransform<512>());
+      break;
+    case 1024:
+      transform.reset(new MetaTransform<1024>());
+      break;
+    case 2048:
+      transform.reset(new MetaTransform<2048>());
+      break;
+    default:
+      throw std::invalid_argument("no transform of size " + std::to_string(size));
+  }
+  transform->calibrate();
+  return transform;
+}
+}
+}
+}
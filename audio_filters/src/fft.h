@@ -0,0 +1,47 @@
+#ifndef VISUALIZER_FFT_H
+#define VISUALIZER_FFT_H
+#include <complex>
+#include <cstddef>
+#include <memory>
+
+namespace audio
+{
+namespace filters
+{
+namespace detail
+{
+// In place complex transform of one power of two size. metaFFT takes the size as a template
+// argument, make_transform() instantiates the sizes the convolution engine picks from.
+class Transform
+{
+public:
+  virtual ~Transform() = default;
+  virtual void forward(std::complex<float> *data) = 0;
+  // Forward transform of the conjugate, conjugated and scaled so inverse(forward(x)) gives x back
+  void inverse(std::complex<float> *data);
+  std::size_t size() const
+  {
+    return m_size;
+  }
+
+protected:
+  explicit Transform(std::size_t size);
+
+private:
+  friend std::unique_ptr<Transform> make_transform(std::size_t size);
+  // Measures the scale of a round trip, so it doesn't matter how the forward transform normalizes
+  void calibrate();
+
+  std::size_t m_size;
+  float m_scale = 1.0F;
+};
+
+const std::size_t MIN_TRANSFORM = 64;
+const std::size_t MAX_TRANSFORM = 2048;
+// Throws std::invalid_argument for sizes that aren't a power of two between the limits above
+std::unique_ptr<Transform> make_transform(std::size_t size);
+}
+}
+}
+
+#endif //VISUALIZER_FFT_H
@@ -1,6 +1,6 @@
 #include <audio_filters/filters.h>
+#include <stdexcept>
 #include <vector>
-#include <cstdint>
 
 namespace
 {
@@ -619,27 +619,30 @@ namespace audio
 {
 namespace filters
 {
-
-std::vector<float> filter_buffer(lowpas180FIR_constants.size());
-std::uint32_t buffer_point = 0;
-std::vector<float> lowpass(const std::vector<float> to_filter)
+const std::vector<float> &lowpass_taps(LowpassDesign design)
 {
-  std::vector<float> filtered;
-  for(float sample: to_filter)
-  {
-    float result = 0.0F;
-    for(uint32_t i = 0, buffer_pointer = buffer_point; i < lowpas180FIR_constants.size(); i++)
-    {
-      result += filter_buffer[buffer_pointer]*lowpas180FIR_constants[i];
-      buffer_pointer += 1;
-      buffer_pointer %= lowpas180FIR_constants.size();
-    }
-    filtered.push_back(result);
-    filter_buffer[buffer_point] = sample;
-    buffer_point += 1;
-    buffer_point %= lowpas180FIR_constants.size();
+  switch (design) {
+    case LowpassDesign::pass180_stop400:
+      return lowpas180FIR_constants;
+    case LowpassDesign::pass100_stop180:
+      return lowpass100hzstop180hz;
   }
-  return filtered;
+  throw std::invalid_argument("unknown lowpass design");
+}
+
+Lowpass::Lowpass(LowpassDesign design, std::size_t block_size)
+    : m_design(design), m_convolver(lowpass_taps(design), block_size)
+{
+}
+
+void Lowpass::process(const float *in, float *out, std::size_t count)
+{
+  m_convolver.process(in, out, count);
+}
+
+void Lowpass::reset()
+{
+  m_convolver.reset();
+}
 }
 }
-}
\ No newline at end of file
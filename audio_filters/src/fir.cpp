@@ -0,0 +1,83 @@
+#include "fir.h"
+#include <audio_filters/kernels.h>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+namespace
+{
+// Floats per cache line, which covers the widest vector loads
+const std::size_t ALIGNMENT = 16;
+
+std::size_t aligned_size(std::size_t count)
+{
+  return (count + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+}
+
+namespace audio
+{
+namespace filters
+{
+namespace detail
+{
+FirFilter::FirFilter(const std::vector<float> &taps)
+    : m_tap_count(taps.size())
+{
+  if (taps.empty())
+    throw std::invalid_argument("a FIR filter needs at least one tap");
+  // Room to move the start onto a cache line
+  m_storage.resize(aligned_size(m_tap_count) + 2 * m_tap_count + ALIGNMENT);
+  place();
+  std::copy(taps.begin(), taps.end(), m_taps);
+}
+
+FirFilter::FirFilter(const FirFilter &other)
+    : m_tap_count(other.m_tap_count), m_storage(other.m_storage.size())
+{
+  place();
+  std::copy(other.m_taps, other.m_taps + aligned_size(m_tap_count) + 2 * m_tap_count, m_taps);
+}
+
+FirFilter &FirFilter::operator=(const FirFilter &other)
+{
+  if (this != &other) {
+    FirFilter copy(other);
+    m_tap_count = copy.m_tap_count;
+    m_storage.swap(copy.m_storage);
+    m_taps = copy.m_taps;
+    m_history = copy.m_history;
+  }
+  return *this;
+}
+
+void FirFilter::place()
+{
+  const auto address = reinterpret_cast<std::uintptr_t>(m_storage.data());
+  const std::size_t misaligned = address / sizeof(float) % ALIGNMENT;
+  m_taps = m_storage.data() + (misaligned == 0 ? 0 : ALIGNMENT - misaligned);
+  m_history = m_taps + aligned_size(m_tap_count);
+}
+
+void FirFilter::process(const float *in, float *out, std::size_t count)
+{
+  const std::size_t window = m_tap_count;
+  while (count > 0) {
+    // At most a window at a time so the block fits behind the history
+    const std::size_t block = std::min(count, window);
+    std::copy(in, in + block, m_history + window);
+    fir(m_history, m_taps, window, out, block);
+    std::copy(m_history + block, m_history + block + window, m_history);
+    in += block;
+    out += block;
+    count -= block;
+  }
+}
+
+void FirFilter::reset()
+{
+  std::fill(m_history, m_history + 2 * m_tap_count, 0.0F);
+}
+}
+}
+}
@@ -0,0 +1,47 @@
+#ifndef VISUALIZER_FIR_H
+#define VISUALIZER_FIR_H
+#include <cstddef>
+#include <vector>
+
+namespace audio
+{
+namespace filters
+{
+namespace detail
+{
+// FIR filter over blocks of samples. The history is kept linear in a buffer twice the length of the
+// taps, the newest block goes behind the last taps - 1 samples so every output reads one contiguous
+// window, and only the tail is moved to the front afterwards. The taps are stored in the order of
+// that window, which is the impulse response reversed, aligned for the vector kernels.
+class FirFilter
+{
+public:
+  // taps[0] weighs the oldest sample of the window, the newest one isn't part of its own output yet
+  explicit FirFilter(const std::vector<float> &taps);
+  FirFilter(const FirFilter &other);
+  FirFilter &operator=(const FirFilter &other);
+  FirFilter(FirFilter &&other) = default;
+  FirFilter &operator=(FirFilter &&other) = default;
+
+  // in and out may be the same
+  void process(const float *in, float *out, std::size_t count);
+  void reset();
+  std::size_t taps() const
+  {
+    return m_tap_count;
+  }
+
+private:
+  void place();
+
+  std::size_t m_tap_count;
+  // Taps then history, both starting on a cache line
+  std::vector<float> m_storage;
+  float *m_taps = nullptr;
+  float *m_history = nullptr;
+};
+}
+}
+}
+
+#endif //VISUALIZER_FIR_H
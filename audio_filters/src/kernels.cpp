@@ -0,0 +1,591 @@
+#include <audio_filters/kernels.h>
+#include "simd.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+using audio::filters::SimdLevel;
+
+// One variant of every kernel, each handles its own tail
+struct Kernels
+{
+  SimdLevel level;
+  float (*dot)(const float *a, const float *b, size_t count);
+  void (*fir)(const float *samples, const float *taps, size_t tap_count, float *out, size_t count);
+  void (*biquad_lanes)(const float *coefficients, float *state, size_t sections, float *samples, size_t frames);
+  size_t (*interpolate_linear)(const float *in, size_t frames, uint32_t factor, float *out);
+  size_t (*best_match)(const float *pattern, size_t pattern_size, const float *samples, size_t count);
+};
+
+// Scalar versions, also the reference the others are checked against and used for their tails
+float dot_scalar(const float *a, const float *b, size_t count)
+{
+  float sum = 0.0F;
+  for (size_t i = 0; i < count; i++)
+    sum += a[i] * b[i];
+  return sum;
+}
+
+void fir_scalar(const float *samples, const float *taps, size_t tap_count, float *out, size_t count)
+{
+  for (size_t k = 0; k < count; k++)
+    out[k] = dot_scalar(samples + k, taps, tap_count);
+}
+
+// A section at a time over all frames, so its state and coefficients stay in registers
+void biquad_lanes_scalar(const float *coefficients, float *state, size_t sections, float *samples, size_t frames)
+{
+  const size_t lanes = audio::filters::BIQUAD_LANES;
+  for (size_t s = 0; s < sections; s++) {
+    const float *c = coefficients + s * 5 * lanes;
+    float *z = state + s * 2 * lanes;
+    for (size_t lane = 0; lane < lanes; lane++) {
+      const float b0 = c[lane], b1 = c[lanes + lane], b2 = c[2 * lanes + lane];
+      const float a1 = c[3 * lanes + lane], a2 = c[4 * lanes + lane];
+      float z1 = z[lane], z2 = z[lanes + lane];
+      for (size_t f = 0; f < frames; f++) {
+        float &x = samples[f * lanes + lane];
+        const float y = b0 * x + z1;
+        z1 = b1 * x - a1 * y + z2;
+        z2 = b2 * x - a2 * y;
+        x = y;
+      }
+      z[lane] = z1;
+      z[lanes + lane] = z2;
+    }
+  }
+}
+
+void interpolate_from(const float *in, size_t begin, size_t frames, uint32_t factor, float *out)
+{
+  for (size_t i = begin; i + 1 < frames; i++) {
+    const float k = in[i + 1] - in[i];
+    for (uint32_t j = 0; j < factor; j++)
+      out[i * factor + j] = k * (float(j) / factor) + in[i];
+  }
+}
+
+size_t interpolated_count(size_t frames, uint32_t factor)
+{
+  return frames > 1 ? (frames - 1) * factor : 0;
+}
+
+size_t interpolate_linear_scalar(const float *in, size_t frames, uint32_t factor, float *out)
+{
+  interpolate_from(in, 0, frames, factor, out);
+  return interpolated_count(frames, factor);
+}
+
+// The vector versions accumulate every offset in pattern order too, one offset per lane. With FMA they
+// only round differently, offsets that match about equally well may still come out different.
+float squared_error(const float *pattern, size_t pattern_size, const float *samples)
+{
+  float error = 0.0F;
+  for (size_t j = 0; j < pattern_size; j++) {
+    const float difference = pattern[j] - samples[j];
+    error += difference * difference;
+  }
+  return error;
+}
+
+// Folds the errors of offsets [begin, begin + count) into the best one so far, the first of equals wins
+void keep_best(const float *errors, size_t begin, size_t count, size_t &best, float &best_error)
+{
+  for (size_t i = 0; i < count; i++) {
+    if (errors[i] < best_error) {
+      best_error = errors[i];
+      best = begin + i;
+    }
+  }
+}
+
+size_t best_match_from(const float *pattern, size_t pattern_size, const float *samples, size_t begin, size_t offsets,
+                       size_t best, float best_error)
+{
+  for (size_t offset = begin; offset < offsets; offset++) {
+    const float error = squared_error(pattern, pattern_size, samples + offset);
+    keep_best(&error, offset, 1, best, best_error);
+  }
+  return best;
+}
+
+size_t match_offsets(size_t pattern_size, size_t count)
+{
+  return count >= pattern_size ? count - pattern_size + 1 : 0;
+}
+
+size_t best_match_scalar(const float *pattern, size_t pattern_size, const float *samples, size_t count)
+{
+  return best_match_from(pattern, pattern_size, samples, 0, match_offsets(pattern_size, count), 0,
+                         std::numeric_limits<float>::infinity());
+}
+
+const Kernels SCALAR{SimdLevel::scalar, &dot_scalar, &fir_scalar, &biquad_lanes_scalar, &interpolate_linear_scalar,
+                     &best_match_scalar};
+
+#ifdef FILTERS_SSE2
+float dot_sse2(const float *a, const float *b, size_t count)
+{
+  __m128 sum0 = _mm_setzero_ps();
+  __m128 sum1 = _mm_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+  }
+  if (i + 4 <= count) {
+    sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    i += 4;
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, _mm_add_ps(sum0, sum1));
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + dot_scalar(a + i, b + i, count - i);
+}
+
+// Sixteen outputs per pass over the taps, every tap is loaded once for all of them and the windows
+// of the outputs are the same samples shifted by a lane
+void fir_sse2(const float *samples, const float *taps, size_t tap_count, float *out, size_t count)
+{
+  size_t k = 0;
+  for (; k + 16 <= count; k += 16) {
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    __m128 sum2 = _mm_setzero_ps();
+    __m128 sum3 = _mm_setzero_ps();
+    for (size_t i = 0; i < tap_count; i++) {
+      const __m128 tap = _mm_set1_ps(taps[i]);
+      const float *window = samples + k + i;
+      sum0 = _mm_add_ps(sum0, _mm_mul_ps(tap, _mm_loadu_ps(window)));
+      sum1 = _mm_add_ps(sum1, _mm_mul_ps(tap, _mm_loadu_ps(window + 4)));
+      sum2 = _mm_add_ps(sum2, _mm_mul_ps(tap, _mm_loadu_ps(window + 8)));
+      sum3 = _mm_add_ps(sum3, _mm_mul_ps(tap, _mm_loadu_ps(window + 12)));
+    }
+    _mm_storeu_ps(out + k, sum0);
+    _mm_storeu_ps(out + k + 4, sum1);
+    _mm_storeu_ps(out + k + 8, sum2);
+    _mm_storeu_ps(out + k + 12, sum3);
+  }
+  for (; k + 4 <= count; k += 4) {
+    __m128 sum = _mm_setzero_ps();
+    for (size_t i = 0; i < tap_count; i++)
+      sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(taps[i]), _mm_loadu_ps(samples + k + i)));
+    _mm_storeu_ps(out + k, sum);
+  }
+  for (; k < count; k++)
+    out[k] = dot_sse2(samples + k, taps, tap_count);
+}
+
+// The lanes in two halves of four
+void biquad_lanes_sse2(const float *coefficients, float *state, size_t sections, float *samples, size_t frames)
+{
+  const size_t lanes = audio::filters::BIQUAD_LANES;
+  for (size_t s = 0; s < sections; s++) {
+    for (size_t half = 0; half < lanes; half += 4) {
+      const float *c = coefficients + s * 5 * lanes + half;
+      float *z = state + s * 2 * lanes + half;
+      const __m128 b0 = _mm_loadu_ps(c), b1 = _mm_loadu_ps(c + lanes), b2 = _mm_loadu_ps(c + 2 * lanes);
+      const __m128 a1 = _mm_loadu_ps(c + 3 * lanes), a2 = _mm_loadu_ps(c + 4 * lanes);
+      __m128 z1 = _mm_loadu_ps(z), z2 = _mm_loadu_ps(z + lanes);
+      for (size_t f = 0; f < frames; f++) {
+        float *x = samples + f * lanes + half;
+        const __m128 in = _mm_loadu_ps(x);
+        const __m128 y = _mm_add_ps(_mm_mul_ps(b0, in), z1);
+        z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, in), _mm_mul_ps(a1, y)), z2);
+        z2 = _mm_sub_ps(_mm_mul_ps(b2, in), _mm_mul_ps(a2, y));
+        _mm_storeu_ps(x, y);
+      }
+      _mm_storeu_ps(z, z1);
+      _mm_storeu_ps(z + lanes, z2);
+    }
+  }
+}
+
+size_t interpolate_linear_sse2(const float *in, size_t frames, uint32_t factor, float *out)
+{
+  if (factor != 4)
+    return interpolate_linear_scalar(in, frames, factor, out);
+
+  const __m128 steps = _mm_setr_ps(0.0F, 0.25F, 0.5F, 0.75F);
+  size_t i = 0;
+  // The next input of the last lane has to be there too
+  for (; i + 5 <= frames; i += 4) {
+    const __m128 now = _mm_loadu_ps(in + i);
+    const __m128 k = _mm_sub_ps(_mm_loadu_ps(in + i + 1), now);
+    float *lines = out + i * 4;
+    _mm_storeu_ps(lines, _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(k, k, 0x00), steps), _mm_shuffle_ps(now, now, 0x00)));
+    _mm_storeu_ps(lines + 4, _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(k, k, 0x55), steps), _mm_shuffle_ps(now, now, 0x55)));
+    _mm_storeu_ps(lines + 8, _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(k, k, 0xaa), steps), _mm_shuffle_ps(now, now, 0xaa)));
+    _mm_storeu_ps(lines + 12, _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(k, k, 0xff), steps), _mm_shuffle_ps(now, now, 0xff)));
+  }
+  interpolate_from(in, i, frames, factor, out);
+  return interpolated_count(frames, factor);
+}
+
+// Four offsets at once, one per lane
+size_t best_match_sse2(const float *pattern, size_t pattern_size, const float *samples, size_t count)
+{
+  const size_t offsets = match_offsets(pattern_size, count);
+  size_t best = 0;
+  float best_error = std::numeric_limits<float>::infinity();
+  size_t offset = 0;
+  for (; offset + 4 <= offsets; offset += 4) {
+    __m128 error = _mm_setzero_ps();
+    for (size_t j = 0; j < pattern_size; j++) {
+      const __m128 difference = _mm_sub_ps(_mm_set1_ps(pattern[j]), _mm_loadu_ps(samples + offset + j));
+      error = _mm_add_ps(error, _mm_mul_ps(difference, difference));
+    }
+    float errors[4];
+    _mm_storeu_ps(errors, error);
+    keep_best(errors, offset, 4, best, best_error);
+  }
+  return best_match_from(pattern, pattern_size, samples, offset, offsets, best, best_error);
+}
+
+const Kernels SSE2{SimdLevel::sse2, &dot_sse2, &fir_sse2, &biquad_lanes_sse2, &interpolate_linear_sse2,
+                   &best_match_sse2};
+#endif
+
+#ifdef FILTERS_AVX2
+FILTERS_AVX2 float dot_avx2(const float *a, const float *b, size_t count)
+{
+  __m256 sum0 = _mm256_setzero_ps();
+  __m256 sum1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+    sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+  }
+  if (i + 8 <= count) {
+    sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+    i += 8;
+  }
+  const __m256 sum = _mm256_add_ps(sum0, sum1);
+  __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+  half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+  half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 0x55));
+  return _mm_cvtss_f32(half) + dot_scalar(a + i, b + i, count - i);
+}
+
+FILTERS_AVX2 void fir_avx2(const float *samples, const float *taps, size_t tap_count, float *out, size_t count)
+{
+  size_t k = 0;
+  for (; k + 32 <= count; k += 32) {
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    __m256 sum2 = _mm256_setzero_ps();
+    __m256 sum3 = _mm256_setzero_ps();
+    for (size_t i = 0; i < tap_count; i++) {
+      const __m256 tap = _mm256_broadcast_ss(taps + i);
+      const float *window = samples + k + i;
+      sum0 = _mm256_fmadd_ps(tap, _mm256_loadu_ps(window), sum0);
+      sum1 = _mm256_fmadd_ps(tap, _mm256_loadu_ps(window + 8), sum1);
+      sum2 = _mm256_fmadd_ps(tap, _mm256_loadu_ps(window + 16), sum2);
+      sum3 = _mm256_fmadd_ps(tap, _mm256_loadu_ps(window + 24), sum3);
+    }
+    _mm256_storeu_ps(out + k, sum0);
+    _mm256_storeu_ps(out + k + 8, sum1);
+    _mm256_storeu_ps(out + k + 16, sum2);
+    _mm256_storeu_ps(out + k + 24, sum3);
+  }
+  for (; k + 8 <= count; k += 8) {
+    __m256 sum = _mm256_setzero_ps();
+    for (size_t i = 0; i < tap_count; i++)
+      sum = _mm256_fmadd_ps(_mm256_broadcast_ss(taps + i), _mm256_loadu_ps(samples + k + i), sum);
+    _mm256_storeu_ps(out + k, sum);
+  }
+  for (; k < count; k++)
+    out[k] = dot_avx2(samples + k, taps, tap_count);
+}
+
+FILTERS_AVX2 void biquad_lanes_avx2(const float *coefficients, float *state, size_t sections, float *samples,
+                                    size_t frames)
+{
+  const size_t lanes = audio::filters::BIQUAD_LANES;
+  for (size_t s = 0; s < sections; s++) {
+    const float *c = coefficients + s * 5 * lanes;
+    float *z = state + s * 2 * lanes;
+    const __m256 b0 = _mm256_loadu_ps(c), b1 = _mm256_loadu_ps(c + lanes), b2 = _mm256_loadu_ps(c + 2 * lanes);
+    const __m256 a1 = _mm256_loadu_ps(c + 3 * lanes), a2 = _mm256_loadu_ps(c + 4 * lanes);
+    __m256 z1 = _mm256_loadu_ps(z), z2 = _mm256_loadu_ps(z + lanes);
+    for (size_t f = 0; f < frames; f++) {
+      float *x = samples + f * lanes;
+      const __m256 in = _mm256_loadu_ps(x);
+      const __m256 y = _mm256_fmadd_ps(b0, in, z1);
+      z1 = _mm256_fmadd_ps(b1, in, _mm256_fnmadd_ps(a1, y, z2));
+      z2 = _mm256_fnmadd_ps(a2, y, _mm256_mul_ps(b2, in));
+      _mm256_storeu_ps(x, y);
+    }
+    _mm256_storeu_ps(z, z1);
+    _mm256_storeu_ps(z + lanes, z2);
+  }
+}
+
+// Two inputs per register, each spread over four lanes
+FILTERS_AVX2 size_t interpolate_linear_avx2(const float *in, size_t frames, uint32_t factor, float *out)
+{
+  if (factor != 4)
+    return interpolate_linear_scalar(in, frames, factor, out);
+
+  const __m256 steps = _mm256_setr_ps(0.0F, 0.25F, 0.5F, 0.75F, 0.0F, 0.25F, 0.5F, 0.75F);
+  const __m256i pairs[4] = {_mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1), _mm256_setr_epi32(2, 2, 2, 2, 3, 3, 3, 3),
+                            _mm256_setr_epi32(4, 4, 4, 4, 5, 5, 5, 5), _mm256_setr_epi32(6, 6, 6, 6, 7, 7, 7, 7)};
+  size_t i = 0;
+  for (; i + 9 <= frames; i += 8) {
+    const __m256 now = _mm256_loadu_ps(in + i);
+    const __m256 k = _mm256_sub_ps(_mm256_loadu_ps(in + i + 1), now);
+    for (int pair = 0; pair < 4; pair++) {
+      const __m256 line = _mm256_add_ps(_mm256_mul_ps(_mm256_permutevar8x32_ps(k, pairs[pair]), steps),
+                                        _mm256_permutevar8x32_ps(now, pairs[pair]));
+      _mm256_storeu_ps(out + i * 4 + pair * 8, line);
+    }
+  }
+  interpolate_from(in, i, frames, factor, out);
+  return interpolated_count(frames, factor);
+}
+
+FILTERS_AVX2 size_t best_match_avx2(const float *pattern, size_t pattern_size, const float *samples, size_t count)
+{
+  const size_t offsets = match_offsets(pattern_size, count);
+  size_t best = 0;
+  float best_error = std::numeric_limits<float>::infinity();
+  size_t offset = 0;
+  for (; offset + 8 <= offsets; offset += 8) {
+    __m256 error = _mm256_setzero_ps();
+    for (size_t j = 0; j < pattern_size; j++) {
+      const __m256 difference = _mm256_sub_ps(_mm256_set1_ps(pattern[j]), _mm256_loadu_ps(samples + offset + j));
+      error = _mm256_add_ps(error, _mm256_mul_ps(difference, difference));
+    }
+    float errors[8];
+    _mm256_storeu_ps(errors, error);
+    keep_best(errors, offset, 8, best, best_error);
+  }
+  return best_match_from(pattern, pattern_size, samples, offset, offsets, best, best_error);
+}
+
+const Kernels AVX2{SimdLevel::avx2, &dot_avx2, &fir_avx2, &biquad_lanes_avx2, &interpolate_linear_avx2,
+                   &best_match_avx2};
+#endif
+
+#ifdef FILTERS_AVX512
+FILTERS_AVX512 float dot_avx512(const float *a, const float *b, size_t count)
+{
+  __m512 sum0 = _mm512_setzero_ps();
+  __m512 sum1 = _mm512_setzero_ps();
+  size_t i = 0;
+  for (; i + 32 <= count; i += 32) {
+    sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), sum0);
+    sum1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), sum1);
+  }
+  if (i + 16 <= count) {
+    sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), sum0);
+    i += 16;
+  }
+  float lanes[16];
+  _mm512_storeu_ps(lanes, _mm512_add_ps(sum0, sum1));
+  float sum = 0.0F;
+  for (float lane : lanes)
+    sum += lane;
+  return sum + dot_scalar(a + i, b + i, count - i);
+}
+
+FILTERS_AVX512 void fir_avx512(const float *samples, const float *taps, size_t tap_count, float *out, size_t count)
+{
+  size_t k = 0;
+  for (; k + 64 <= count; k += 64) {
+    __m512 sum0 = _mm512_setzero_ps();
+    __m512 sum1 = _mm512_setzero_ps();
+    __m512 sum2 = _mm512_setzero_ps();
+    __m512 sum3 = _mm512_setzero_ps();
+    for (size_t i = 0; i < tap_count; i++) {
+      const __m512 tap = _mm512_set1_ps(taps[i]);
+      const float *window = samples + k + i;
+      sum0 = _mm512_fmadd_ps(tap, _mm512_loadu_ps(window), sum0);
+      sum1 = _mm512_fmadd_ps(tap, _mm512_loadu_ps(window + 16), sum1);
+      sum2 = _mm512_fmadd_ps(tap, _mm512_loadu_ps(window + 32), sum2);
+      sum3 = _mm512_fmadd_ps(tap, _mm512_loadu_ps(window + 48), sum3);
+    }
+    _mm512_storeu_ps(out + k, sum0);
+    _mm512_storeu_ps(out + k + 16, sum1);
+    _mm512_storeu_ps(out + k + 32, sum2);
+    _mm512_storeu_ps(out + k + 48, sum3);
+  }
+  for (; k + 16 <= count; k += 16) {
+    __m512 sum = _mm512_setzero_ps();
+    for (size_t i = 0; i < tap_count; i++)
+      sum = _mm512_fmadd_ps(_mm512_set1_ps(taps[i]), _mm512_loadu_ps(samples + k + i), sum);
+    _mm512_storeu_ps(out + k, sum);
+  }
+  for (; k < count; k++)
+    out[k] = dot_avx512(samples + k, taps, tap_count);
+}
+
+// Four inputs per register, each spread over four lanes
+FILTERS_AVX512 size_t interpolate_linear_avx512(const float *in, size_t frames, uint32_t factor, float *out)
+{
+  if (factor != 4)
+    return interpolate_linear_scalar(in, frames, factor, out);
+
+  const __m512 steps = _mm512_setr_ps(0.0F, 0.25F, 0.5F, 0.75F, 0.0F, 0.25F, 0.5F, 0.75F,
+                                      0.0F, 0.25F, 0.5F, 0.75F, 0.0F, 0.25F, 0.5F, 0.75F);
+  const __m512i spread = _mm512_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3);
+  size_t i = 0;
+  for (; i + 17 <= frames; i += 16) {
+    const __m512 now = _mm512_loadu_ps(in + i);
+    const __m512 k = _mm512_sub_ps(_mm512_loadu_ps(in + i + 1), now);
+    for (int quad = 0; quad < 4; quad++) {
+      const __m512i lanes = _mm512_add_epi32(spread, _mm512_set1_epi32(quad * 4));
+      // The zero masked form, GCC 12 warns about the undefined pass-through of the plain one
+      const __m512 line = _mm512_add_ps(_mm512_mul_ps(_mm512_maskz_permutexvar_ps(0xFFFF, lanes, k), steps),
+                                        _mm512_maskz_permutexvar_ps(0xFFFF, lanes, now));
+      _mm512_storeu_ps(out + i * 4 + quad * 16, line);
+    }
+  }
+  interpolate_from(in, i, frames, factor, out);
+  return interpolated_count(frames, factor);
+}
+
+FILTERS_AVX512 size_t best_match_avx512(const float *pattern, size_t pattern_size, const float *samples, size_t count)
+{
+  const size_t offsets = match_offsets(pattern_size, count);
+  size_t best = 0;
+  float best_error = std::numeric_limits<float>::infinity();
+  size_t offset = 0;
+  for (; offset + 16 <= offsets; offset += 16) {
+    __m512 error = _mm512_setzero_ps();
+    for (size_t j = 0; j < pattern_size; j++) {
+      const __m512 difference = _mm512_sub_ps(_mm512_set1_ps(pattern[j]), _mm512_loadu_ps(samples + offset + j));
+      error = _mm512_add_ps(error, _mm512_mul_ps(difference, difference));
+    }
+    float errors[16];
+    _mm512_storeu_ps(errors, error);
+    keep_best(errors, offset, 16, best, best_error);
+  }
+  return best_match_from(pattern, pattern_size, samples, offset, offsets, best, best_error);
+}
+
+// Eight biquad lanes fill an AVX2 register already
+const Kernels AVX512{SimdLevel::avx512, &dot_avx512, &fir_avx512, &biquad_lanes_avx2, &interpolate_linear_avx512,
+                     &best_match_avx512};
+#endif
+
+// Null for levels this build or this cpu can't run
+const Kernels *kernels_for(SimdLevel level)
+{
+  static const audio::filters::detail::CpuFeatures cpu = audio::filters::detail::detect_cpu();
+  switch (level) {
+    case SimdLevel::scalar:
+      return &SCALAR;
+    case SimdLevel::sse2:
+#ifdef FILTERS_SSE2
+      return cpu.sse2 ? &SSE2 : nullptr;
+#else
+      break;
+#endif
+    case SimdLevel::avx2:
+#ifdef FILTERS_AVX2
+      return cpu.avx2 ? &AVX2 : nullptr;
+#else
+      break;
+#endif
+    case SimdLevel::avx512:
+#ifdef FILTERS_AVX512
+      return cpu.avx512 ? &AVX512 : nullptr;
+#else
+      break;
+#endif
+  }
+  return nullptr;
+}
+
+const Kernels *best_kernels()
+{
+  const char *requested = std::getenv("AUDIO_FILTERS_SIMD");
+  const SimdLevel levels[] = {SimdLevel::avx512, SimdLevel::avx2, SimdLevel::sse2, SimdLevel::scalar};
+  // Names nobody knows are ignored
+  bool allowed = true;
+  for (SimdLevel level : levels)
+    allowed = allowed && (requested == nullptr || std::strcmp(requested, audio::filters::simd_level_name(level)) != 0);
+  for (SimdLevel level : levels) {
+    allowed = allowed || std::strcmp(requested, audio::filters::simd_level_name(level)) == 0;
+    const Kernels *kernels = kernels_for(level);
+    if (allowed && kernels != nullptr)
+      return kernels;
+  }
+  return &SCALAR;
+}
+
+std::atomic<const Kernels *> active{nullptr};
+
+const Kernels &kernels()
+{
+  const Kernels *current = active.load(std::memory_order_acquire);
+  if (current == nullptr) {
+    current = best_kernels();
+    active.store(current, std::memory_order_release);
+  }
+  return *current;
+}
+}
+
+namespace audio
+{
+namespace filters
+{
+SimdLevel simd_level()
+{
+  return kernels().level;
+}
+
+bool select_simd_level(SimdLevel level)
+{
+  const Kernels *selected = kernels_for(level);
+  if (selected == nullptr)
+    return false;
+  active.store(selected, std::memory_order_release);
+  return true;
+}
+
+const char *simd_level_name(SimdLevel level)
+{
+  switch (level) {
+    case SimdLevel::scalar:
+      return "scalar";
+    case SimdLevel::sse2:
+      return "sse2";
+    case SimdLevel::avx2:
+      return "avx2";
+    case SimdLevel::avx512:
+      return "avx512";
+  }
+  return "unknown";
+}
+
+float dot(const float *a, const float *b, std::size_t count)
+{
+  return kernels().dot(a, b, count);
+}
+
+void fir(const float *samples, const float *taps, std::size_t tap_count, float *out, std::size_t count)
+{
+  kernels().fir(samples, taps, tap_count, out, count);
+}
+
+void biquad_lanes(const float *coefficients, float *state, std::size_t sections, float *samples, std::size_t frames)
+{
+  kernels().biquad_lanes(coefficients, state, sections, samples, frames);
+}
+
+std::size_t interpolate_linear(const float *in, std::size_t frames, std::uint32_t factor, float *out)
+{
+  return kernels().interpolate_linear(in, frames, factor, out);
+}
+
+std::size_t best_match(const float *pattern, std::size_t pattern_size, const float *samples, std::size_t count)
+{
+  return kernels().best_match(pattern, pattern_size, samples, count);
+}
+}
+}
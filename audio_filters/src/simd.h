@@ -0,0 +1,67 @@
+#ifndef VISUALIZER_FILTERS_SIMD_H
+#define VISUALIZER_FILTERS_SIMD_H
+
+// Every variant is compiled into the same binary whatever the target, through function attributes on
+// GCC and Clang. MSVC takes the intrinsics without any flags. Which ones run is decided from CPUID.
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FILTERS_SSE2
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FILTERS_AVX2 __attribute__((target("avx2,fma")))
+#define FILTERS_AVX512 __attribute__((target("avx512f")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <immintrin.h>
+#include <intrin.h>
+#define FILTERS_AVX2
+#define FILTERS_AVX512
+#endif
+
+namespace audio
+{
+namespace filters
+{
+namespace detail
+{
+struct CpuFeatures
+{
+  bool sse2 = false;
+  // AVX2 together with FMA, every cpu with one has the other
+  bool avx2 = false;
+  bool avx512 = false;
+};
+
+inline CpuFeatures detect_cpu()
+{
+  CpuFeatures features;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  features.sse2 = __builtin_cpu_supports("sse2");
+  features.avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  features.avx512 = __builtin_cpu_supports("avx512f");
+#elif defined(_MSC_VER) && defined(_M_X64)
+  int registers[4];
+  __cpuid(registers, 0);
+  const int leaves = registers[0];
+  __cpuid(registers, 1);
+  features.sse2 = (registers[3] & (1 << 26)) != 0;
+  const bool fma = (registers[2] & (1 << 12)) != 0;
+  // The OS has to save the wider registers on context switches, XCR0 says which ones it does
+  const bool osxsave = (registers[2] & (1 << 27)) != 0;
+  const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+  const bool ymm_saved = (xcr0 & 0x6) == 0x6;
+  const bool zmm_saved = (xcr0 & 0xe6) == 0xe6;
+  if (leaves >= 7) {
+    __cpuidex(registers, 7, 0);
+    features.avx2 = ymm_saved && fma && (registers[1] & (1 << 5)) != 0;
+    features.avx512 = zmm_saved && (registers[1] & (1 << 16)) != 0;
+  }
+#endif
+  return features;
+}
+}
+}
+}
+
+#endif //VISUALIZER_FILTERS_SIMD_H
@@ -0,0 +1,133 @@
+#include <audio_filters/biquad.h>
+#include <audio_filters/filters.h>
+#include <audio_filters/kernels.h>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// The 180 Hz lowpass at 48 kHz two ways: the 301 tap FIR Lowpass and a 4th order Butterworth cascade,
+// alone and eight channels at a time in a BiquadBank. First what each lets through at the edges of
+// the FIR's band, then samples per second in 480 frame blocks at every level this cpu has.
+namespace
+{
+typedef std::chrono::steady_clock Clock;
+
+const double PI = 3.14159265358979323846;
+const double RATE = 48000.0;
+const std::size_t BLOCK = 480;
+const std::size_t BLOCKS = 4000;
+const std::size_t CHANNELS = audio::filters::BIQUAD_LANES;
+// Written with every block so the work isn't optimized away
+volatile float last_output;
+
+std::vector<float> noise(std::size_t count)
+{
+  std::mt19937 random_source(5);
+  std::uniform_real_distribution<float> uniform(-1.0F, 1.0F);
+  std::vector<float> values(count);
+  for (float &value : values)
+    value = uniform(random_source);
+  return values;
+}
+
+double decibels(std::complex<double> response)
+{
+  return 20 * std::log10(std::abs(response));
+}
+
+double fir_response(const std::vector<float> &taps, double hz)
+{
+  std::complex<double> sum = 0.0;
+  for (std::size_t i = 0; i < taps.size(); i++)
+    sum += double(taps[i]) * std::polar(1.0, -2 * PI * hz / RATE * i);
+  return decibels(sum);
+}
+
+double biquad_response(const std::vector<audio::filters::Biquad> &sections, double hz)
+{
+  const std::complex<double> z = std::polar(1.0, -2 * PI * hz / RATE);
+  std::complex<double> product = 1.0;
+  for (const audio::filters::Biquad &s : sections)
+    product *= (double(s.b0) + double(s.b1) * z + double(s.b2) * z * z) / (1.0 + double(s.a1) * z + double(s.a2) * z * z);
+  return decibels(product);
+}
+
+// Millions of samples a second over every channel processed
+template<typename Process>
+double throughput(std::size_t channels, Process process)
+{
+  const auto start = Clock::now();
+  for (std::size_t i = 0; i < BLOCKS; i++)
+    process(i % 8 * BLOCK);
+  const std::chrono::duration<double> elapsed = Clock::now() - start;
+  return channels * BLOCK * BLOCKS / elapsed.count() / 1e6;
+}
+
+void report(const char *name, const char *level, double rate)
+{
+  std::cout << std::setw(20) << name << std::setw(8) << level << std::fixed << std::setprecision(1) << std::setw(10)
+            << rate << " M samples/s" << std::endl;
+}
+}
+
+int main()
+{
+  const std::vector<float> &taps = audio::filters::lowpass_taps(audio::filters::LowpassDesign::pass180_stop400);
+  const std::vector<audio::filters::Biquad> butterworth = audio::filters::butterworth_lowpass(180 / RATE, 4);
+
+  std::cout << std::setw(20) << "response dB" << std::setw(10) << "90 Hz" << std::setw(10) << "180 Hz" << std::setw(10)
+            << "400 Hz" << std::setw(10) << "1 kHz" << std::endl;
+  std::cout << std::fixed << std::setprecision(1) << std::setw(20) << "FIR, 301 taps";
+  for (double hz : {90.0, 180.0, 400.0, 1000.0})
+    std::cout << std::setw(10) << fir_response(taps, hz);
+  std::cout << std::endl << std::setw(20) << "Butterworth, 4th";
+  for (double hz : {90.0, 180.0, 400.0, 1000.0})
+    std::cout << std::setw(10) << biquad_response(butterworth, hz);
+  std::cout << std::endl << std::endl;
+
+  const std::vector<float> input = noise(8 * BLOCK);
+  std::vector<float> output(BLOCK);
+  std::vector<std::vector<float>> planes(CHANNELS, std::vector<float>(BLOCK));
+  std::vector<const float *> in(CHANNELS);
+  std::vector<float *> out(CHANNELS);
+  for (std::size_t c = 0; c < CHANNELS; c++)
+    out[c] = planes[c].data();
+
+  const audio::filters::SimdLevel levels[] = {audio::filters::SimdLevel::scalar, audio::filters::SimdLevel::sse2,
+                                              audio::filters::SimdLevel::avx2, audio::filters::SimdLevel::avx512};
+  const audio::filters::SimdLevel previous = audio::filters::simd_level();
+  for (audio::filters::SimdLevel level : levels) {
+    if (!audio::filters::select_simd_level(level))
+      continue;
+    const char *name = audio::filters::simd_level_name(level);
+
+    audio::filters::Lowpass fir(audio::filters::LowpassDesign::pass180_stop400, BLOCK);
+    report("FIR", name, throughput(1, [&](std::size_t offset) {
+             fir.process(input.data() + offset, output.data(), BLOCK);
+             last_output = output[0];
+           }));
+
+    // The cascade doesn't go through the kernels, it is the same at every level
+    audio::filters::BiquadCascade cascade(butterworth);
+    report("cascade", name, throughput(1, [&](std::size_t offset) {
+             cascade.process(input.data() + offset, output.data(), BLOCK);
+             last_output = output[0];
+           }));
+
+    audio::filters::BiquadBank bank(std::vector<std::vector<audio::filters::Biquad>>(CHANNELS, butterworth));
+    report("bank, 8 channels", name, throughput(CHANNELS, [&](std::size_t offset) {
+             // Every channel gets its own stretch of the input
+             for (std::size_t c = 0; c < CHANNELS; c++)
+               in[c] = input.data() + (offset + c * BLOCK) % input.size();
+             bank.process(in.data(), out.data(), BLOCK);
+             last_output = out[0][0];
+           }));
+  }
+  audio::filters::select_simd_level(previous);
+  return 0;
+}
@@ -0,0 +1,233 @@
+#include "check.h"
+#include <audio_filters/biquad.h>
+#include <audio_filters/kernels.h>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+// The designs by their response at DC, at the frequency they were designed for and at Nyquist, worked
+// out from the coefficients. Then BiquadBank, channel per lane and bands, against a BiquadCascade per
+// lane at every level this cpu runs, over blocks of uneven size so they straddle the bank's chunks.
+namespace
+{
+using audio::filters::Biquad;
+using audio::filters::SimdLevel;
+
+const double PI = 3.14159265358979323846;
+// Absolute for responses of 0, relative otherwise. The coefficients are floats, which moves the
+// response of the low cutoffs most, their poles sit closest to the unit circle.
+const double RESPONSE_TOLERANCE = 1e-3;
+// Relative to the largest output, see kernels_test
+const float BANK_TOLERANCE = 1e-5F;
+const double CUTOFFS[] = {0.005, 0.05, 0.2, 0.4};
+
+std::mt19937 random_source(13);
+
+std::vector<float> noise(std::size_t count)
+{
+  std::uniform_real_distribution<float> uniform(-1.0F, 1.0F);
+  std::vector<float> values(count);
+  for (float &value : values)
+    value = uniform(random_source);
+  return values;
+}
+
+double response(const std::vector<Biquad> &sections, double frequency)
+{
+  // z to the -1 on the unit circle
+  const std::complex<double> z = std::polar(1.0, -2 * PI * frequency);
+  double magnitude = 1.0;
+  for (const Biquad &s : sections)
+    magnitude *= std::abs((double(s.b0) + double(s.b1) * z + double(s.b2) * z * z) /
+                          (1.0 + double(s.a1) * z + double(s.a2) * z * z));
+  return magnitude;
+}
+
+bool responds(const std::vector<Biquad> &sections, double frequency, double expected)
+{
+  const double actual = response(sections, frequency);
+  const double off = expected == 0.0 ? actual : std::fabs(actual / expected - 1.0);
+  if (off <= RESPONSE_TOLERANCE)
+    return true;
+  std::cerr << "response at " << frequency << " is " << actual << " instead of " << expected << std::endl;
+  return false;
+}
+
+void designs_respond_as_designed()
+{
+  const double gain = std::pow(10.0, 6.0 / 20);
+  for (double cutoff : CUTOFFS) {
+    for (double q : {0.5, std::sqrt(0.5), 2.0}) {
+      // The cookbook's passes are q at their cutoff
+      const std::vector<Biquad> lowpass = {Biquad::lowpass(cutoff, q)};
+      CHECK(responds(lowpass, 0.0, 1.0) && responds(lowpass, cutoff, q) && responds(lowpass, 0.5, 0.0));
+      const std::vector<Biquad> highpass = {Biquad::highpass(cutoff, q)};
+      CHECK(responds(highpass, 0.0, 0.0) && responds(highpass, cutoff, q) && responds(highpass, 0.5, 1.0));
+      const std::vector<Biquad> bandpass = {Biquad::bandpass(cutoff, q)};
+      CHECK(responds(bandpass, 0.0, 0.0) && responds(bandpass, cutoff, 1.0) && responds(bandpass, 0.5, 0.0));
+    }
+    // Shelves are half their gain in dB at the cutoff
+    const std::vector<Biquad> low_shelf = {Biquad::low_shelf(cutoff, 6.0)};
+    CHECK(responds(low_shelf, 0.0, gain) && responds(low_shelf, cutoff, std::sqrt(gain)) &&
+          responds(low_shelf, 0.5, 1.0));
+    const std::vector<Biquad> high_shelf = {Biquad::high_shelf(cutoff, 6.0)};
+    CHECK(responds(high_shelf, 0.0, 1.0) && responds(high_shelf, cutoff, std::sqrt(gain)) &&
+          responds(high_shelf, 0.5, gain));
+
+    // Butterworth cascades are 3 dB down at the cutoff whatever their order, and flat either side
+    for (unsigned order : {2u, 4u, 8u}) {
+      const std::vector<Biquad> lowpass = audio::filters::butterworth_lowpass(cutoff, order);
+      CHECK(lowpass.size() == order / 2);
+      CHECK(responds(lowpass, 0.0, 1.0) && responds(lowpass, cutoff, std::sqrt(0.5)) && responds(lowpass, 0.5, 0.0));
+      CHECK(response(lowpass, cutoff / 2) > 0.95);
+      const std::vector<Biquad> highpass = audio::filters::butterworth_highpass(cutoff, order);
+      CHECK(responds(highpass, 0.0, 0.0) && responds(highpass, cutoff, std::sqrt(0.5)) &&
+            responds(highpass, 0.5, 1.0));
+    }
+  }
+
+  // First order, so only about 3 dB down at the cutoff when it is well below Nyquist
+  for (double cutoff : {0.0005, 0.002}) {
+    const std::vector<Biquad> dc_block = {Biquad::dc_block(cutoff)};
+    CHECK(responds(dc_block, 0.0, 0.0));
+    CHECK(std::fabs(response(dc_block, cutoff) - std::sqrt(0.5)) < 0.01);
+    CHECK(std::fabs(response(dc_block, 0.5) - 1.0) < 0.01);
+  }
+}
+
+// What comes out of the cascade matches the response worked out above
+void cascade_filters_a_tone()
+{
+  const double cutoff = 0.05;
+  audio::filters::BiquadCascade cascade(audio::filters::butterworth_lowpass(cutoff, 4));
+  const std::size_t count = 1 << 14;
+  std::vector<float> samples(count);
+  for (std::size_t i = 0; i < count; i++)
+    samples[i] = static_cast<float>(std::sin(2 * PI * cutoff * i));
+  cascade.process(samples.data(), samples.data(), count);
+  double sum = 0.0;
+  for (std::size_t i = count / 2; i < count; i++)
+    sum += double(samples[i]) * samples[i];
+  CHECK(std::fabs(std::sqrt(sum / (count / 2)) - 0.5) < 1e-3);
+}
+
+// Cascades of different lengths, so the bank pads the shorter ones
+std::vector<std::vector<Biquad>> cascades(std::size_t count)
+{
+  std::vector<std::vector<Biquad>> result;
+  for (std::size_t i = 0; i < count; i++) {
+    const double cutoff = 0.01 + 0.05 * i;
+    switch (i % 4) {
+      case 0:
+        result.push_back(audio::filters::butterworth_lowpass(cutoff, 8));
+        break;
+      case 1:
+        result.push_back(audio::filters::butterworth_highpass(cutoff, 2));
+        break;
+      case 2:
+        result.push_back({Biquad::bandpass(cutoff, 4.0), Biquad::high_shelf(cutoff, -6.0)});
+        break;
+      default:
+        result.push_back({Biquad::dc_block(0.001), Biquad::low_shelf(cutoff, 9.0), Biquad::lowpass(0.3)});
+        break;
+    }
+  }
+  return result;
+}
+
+// Feeds the frames in blocks of 1 to 700, the same blocks to the bank and the cascades
+template<typename F>
+void in_blocks(std::size_t frames, F f)
+{
+  std::minstd_rand sizes(9);
+  for (std::size_t done = 0; done < frames;) {
+    const std::size_t block = std::min<std::size_t>(sizes() % 700 + 1, frames - done);
+    f(done, block);
+    done += block;
+  }
+}
+
+float largest_difference(const std::vector<std::vector<float>> &a, const std::vector<std::vector<float>> &b)
+{
+  float peak = 1.0F, largest = 0.0F;
+  for (std::size_t lane = 0; lane < a.size(); lane++) {
+    for (std::size_t i = 0; i < a[lane].size(); i++) {
+      peak = std::max(peak, std::fabs(a[lane][i]));
+      largest = std::max(largest, std::fabs(a[lane][i] - b[lane][i]));
+    }
+  }
+  return largest / peak;
+}
+
+void bank_matches_cascades(SimdLevel level, std::size_t lanes)
+{
+  const std::size_t frames = 5000;
+  const std::vector<std::vector<Biquad>> designs = cascades(lanes);
+  std::vector<std::vector<float>> input, expected, actual(lanes, std::vector<float>(frames));
+  for (std::size_t lane = 0; lane < lanes; lane++) {
+    input.push_back(noise(frames));
+    expected.push_back(input.back());
+    audio::filters::BiquadCascade(designs[lane]).process(expected[lane].data(), expected[lane].data(), frames);
+  }
+
+  const SimdLevel previous = audio::filters::simd_level();
+  audio::filters::select_simd_level(level);
+  audio::filters::BiquadBank bank(designs);
+  CHECK(bank.lanes() == lanes);
+  for (int pass = 0; pass < 2; pass++) {
+    // A second pass after reset has to come out the same
+    bank.reset();
+    in_blocks(frames, [&](std::size_t done, std::size_t block) {
+      std::vector<const float *> in;
+      std::vector<float *> out;
+      for (std::size_t lane = 0; lane < lanes; lane++) {
+        in.push_back(input[lane].data() + done);
+        out.push_back(actual[lane].data() + done);
+      }
+      bank.process(in.data(), out.data(), block);
+    });
+    const float off = largest_difference(expected, actual);
+    if (!CHECK(off <= BANK_TOLERANCE))
+      std::cerr << lanes << " lanes at " << audio::filters::simd_level_name(level) << " are off by " << off
+                << std::endl;
+  }
+
+  // Bands: the first channel's input through every cascade
+  for (std::size_t lane = 0; lane < lanes; lane++) {
+    expected[lane] = input[0];
+    audio::filters::BiquadCascade(designs[lane]).process(expected[lane].data(), expected[lane].data(), frames);
+  }
+  bank.reset();
+  in_blocks(frames, [&](std::size_t done, std::size_t block) {
+    std::vector<float *> out;
+    for (std::size_t lane = 0; lane < lanes; lane++)
+      out.push_back(actual[lane].data() + done);
+    bank.process_bands(input[0].data() + done, out.data(), block);
+  });
+  const float off = largest_difference(expected, actual);
+  if (!CHECK(off <= BANK_TOLERANCE))
+    std::cerr << lanes << " bands at " << audio::filters::simd_level_name(level) << " are off by " << off
+              << std::endl;
+  audio::filters::select_simd_level(previous);
+}
+}
+
+int main()
+{
+  designs_respond_as_designed();
+  cascade_filters_a_tone();
+
+  const SimdLevel levels[] = {SimdLevel::scalar, SimdLevel::sse2, SimdLevel::avx2, SimdLevel::avx512};
+  for (SimdLevel level : levels) {
+    const SimdLevel previous = audio::filters::simd_level();
+    if (!audio::filters::select_simd_level(level))
+      continue;
+    audio::filters::select_simd_level(previous);
+    for (std::size_t lanes : {1u, 3u, 5u, 8u})
+      bank_matches_cascades(level, lanes);
+  }
+  return test::result("biquad_test");
+}
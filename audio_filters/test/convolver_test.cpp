@@ -0,0 +1,142 @@
+#include "check.h"
+#include <audio_filters/convolver.h>
+#include <audio_filters/filters.h>
+#include <audio_filters/kernels.h>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+// The partitioned FFT convolution at every partition size against direct form, over blocks of
+// uneven size so partitions and blocks never line up. The inputs are within [-1, 1], so no output
+// exceeds the sum of the magnitudes of the taps, the tolerance is relative to that.
+namespace
+{
+const float TOLERANCE = 1e-5F;
+const std::size_t SAMPLES = 1 << 14;
+const std::size_t TAP_COUNTS[] = {301, 1000, 2500};
+
+std::mt19937 random_source(11);
+
+std::vector<float> noise(std::size_t count)
+{
+  std::uniform_real_distribution<float> uniform(-1.0F, 1.0F);
+  std::vector<float> values(count);
+  for (float &value : values)
+    value = uniform(random_source);
+  return values;
+}
+
+// Feeds the input in blocks of 1 to 700 samples, the same blocks for every convolver
+std::vector<float> run(audio::filters::Convolver &convolver, const std::vector<float> &input)
+{
+  std::minstd_rand sizes(3);
+  std::vector<float> output(input.size());
+  for (std::size_t done = 0; done < input.size();) {
+    const std::size_t block = std::min<std::size_t>(sizes() % 700 + 1, input.size() - done);
+    convolver.process(input.data() + done, output.data() + done, block);
+    done += block;
+  }
+  return output;
+}
+
+float largest_difference(const std::vector<float> &a, const std::vector<float> &b)
+{
+  float largest = 0.0F;
+  for (std::size_t i = 0; i < a.size(); i++)
+    largest = std::max(largest, std::fabs(a[i] - b[i]));
+  return largest;
+}
+
+// Direct form itself against the definition: out[n] is the sum of taps[i] * in[n - taps + i]
+void direct_form_matches_the_definition()
+{
+  const std::vector<float> taps = noise(301);
+  const std::vector<float> input = noise(4096);
+  auto convolver = audio::filters::Convolver::partitioned(taps, 0);
+  const std::vector<float> output = run(convolver, input);
+
+  double largest = 0.0, magnitude = 0.0;
+  for (float tap : taps)
+    magnitude += std::fabs(tap);
+  for (std::size_t n = 0; n < input.size(); n++) {
+    double expected = 0.0;
+    for (std::size_t i = 0; i < taps.size(); i++) {
+      if (n + i >= taps.size())
+        expected += double(taps[i]) * input[n + i - taps.size()];
+    }
+    largest = std::max(largest, std::fabs(expected - output[n]));
+  }
+  if (!CHECK(largest <= TOLERANCE * magnitude))
+    std::cerr << "direct form is off by " << largest / magnitude << std::endl;
+}
+
+void partitions_match_direct_form()
+{
+  for (std::size_t tap_count : TAP_COUNTS) {
+    const std::vector<float> taps = noise(tap_count);
+    const std::vector<float> input = noise(SAMPLES);
+    float magnitude = 0.0F;
+    for (float tap : taps)
+      magnitude += std::fabs(tap);
+
+    auto direct = audio::filters::Convolver::partitioned(taps, 0);
+    const std::vector<float> expected = run(direct, input);
+    for (std::size_t partition = 32; partition <= 1024 && partition < tap_count; partition *= 2) {
+      auto convolver = audio::filters::Convolver::partitioned(taps, partition);
+      CHECK(convolver.partition_size() == partition);
+      const float off = largest_difference(run(convolver, input), expected) / magnitude;
+      // Starting over gives the same output again
+      convolver.reset();
+      const float off_after_reset = largest_difference(run(convolver, input), expected) / magnitude;
+      if (!CHECK(off <= TOLERANCE && off_after_reset <= TOLERANCE))
+        std::cerr << tap_count << " taps in partitions of " << partition << " are off by "
+                  << std::max(off, off_after_reset) << std::endl;
+    }
+  }
+}
+
+void bad_partitions_are_rejected()
+{
+  const std::vector<float> taps = noise(500);
+  for (std::size_t partition : {1u, 16u, 48u, 512u, 2048u}) {
+    bool threw = false;
+    try {
+      audio::filters::Convolver::partitioned(taps, partition);
+    }
+    catch (const std::invalid_argument &) {
+      threw = true;
+    }
+    CHECK(threw);
+  }
+}
+
+// The crossovers documented with Convolver
+void estimate_follows_the_crossovers()
+{
+  const audio::filters::SimdLevel previous = audio::filters::simd_level();
+  const audio::filters::SimdLevel levels[] = {audio::filters::SimdLevel::scalar, audio::filters::SimdLevel::sse2,
+                                              audio::filters::SimdLevel::avx2, audio::filters::SimdLevel::avx512};
+  const std::vector<float> &lowpass = audio::filters::lowpass_taps(audio::filters::LowpassDesign::pass180_stop400);
+  const std::vector<float> long_filter = noise(8192);
+  for (audio::filters::SimdLevel level : levels) {
+    if (!audio::filters::select_simd_level(level))
+      continue;
+    const bool partitioned = audio::filters::Convolver(lowpass, 512).partition_size() != 0;
+    CHECK(partitioned == (level == audio::filters::SimdLevel::scalar));
+    CHECK(audio::filters::Convolver(long_filter, 512).partition_size() != 0);
+  }
+  audio::filters::select_simd_level(previous);
+}
+}
+
+int main()
+{
+  direct_form_matches_the_definition();
+  partitions_match_direct_form();
+  bad_partitions_are_rejected();
+  estimate_follows_the_crossovers();
+  return test::result("convolver_test");
+}
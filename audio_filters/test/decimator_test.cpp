@@ -0,0 +1,65 @@
+#include "check.h"
+#include <audio_filters/decimator.h>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// A cascade from 48 kHz to 1.5 kHz in stages of 4, 4 and 2. What is in the passband comes through,
+// what would fold onto it doesn't, and stages that don't decimate are refused up front.
+namespace
+{
+const double PI = 3.14159265358979323846;
+const std::size_t SAMPLES = 1 << 16;
+// Outputs until every stage's lowpass saw only the signal
+const std::size_t SETTLE = 64;
+
+// RMS of the cascade's output for a tone at the given fraction of the input rate
+double output_rms(double frequency)
+{
+  audio::filters::DecimatorCascade cascade({4, 4, 2});
+  std::vector<float> input(SAMPLES);
+  for (std::size_t i = 0; i < SAMPLES; i++)
+    input[i] = static_cast<float>(std::sin(2 * PI * frequency * i));
+  std::vector<float> output(SAMPLES / cascade.factor() + 1);
+  const std::size_t written = cascade.process(input.data(), input.size(), output.data());
+
+  double sum = 0;
+  for (std::size_t i = SETTLE; i < written; i++)
+    sum += double(output[i]) * output[i];
+  return std::sqrt(sum / (written - SETTLE));
+}
+
+void passes_the_passband_and_rejects_aliases()
+{
+  CHECK(audio::filters::DecimatorCascade({4, 4, 2}).factor() == 32);
+  // 240 Hz at 48 kHz, well inside the 300 Hz passband of the 1.5 kHz output
+  CHECK(std::fabs(output_rms(0.005) - std::sqrt(0.5)) < 0.01);
+  // 5 kHz and 9.6 kHz would fold onto the passband
+  CHECK(output_rms(5000.0 / 48000) < 1e-3);
+  CHECK(output_rms(0.2) < 1e-3);
+}
+
+void stages_below_two_are_refused()
+{
+  const std::vector<std::vector<std::uint32_t>> cascades = {{1}, {4, 1, 2}, {0, 4}};
+  for (const std::vector<std::uint32_t> &factors : cascades) {
+    std::string message;
+    try {
+      audio::filters::DecimatorCascade cascade(factors);
+    }
+    catch (const std::invalid_argument &error) {
+      message = error.what();
+    }
+    CHECK(message.find("at least 2") != std::string::npos);
+  }
+}
+}
+
+int main()
+{
+  passes_the_passband_and_rejects_aliases();
+  stages_below_two_are_refused();
+  return test::result("decimator_test");
+}
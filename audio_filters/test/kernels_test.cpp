@@ -0,0 +1,254 @@
+#include "check.h"
+#include <audio_filters/biquad.h>
+#include <audio_filters/kernels.h>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Every kernel at every level this cpu runs, against the scalar version on the same input. The sizes
+// cover empty inputs and every tail a register width leaves. Only the order of the additions and
+// fused multiply-adds differ between levels, the tolerances below bound what that may change.
+namespace
+{
+using audio::filters::SimdLevel;
+
+// Relative to the sum of the magnitudes of the products, a few roundings of that sum at most
+const float DOT_TOLERANCE = 1e-6F;
+// Relative to the largest output. The recursion carries a rounding difference into every later
+// frame, where the gain of the sections can grow it.
+const float BIQUAD_TOLERANCE = 1e-5F;
+// Absolute, on inputs within [-1, 1]
+const float INTERPOLATE_TOLERANCE = 1e-6F;
+// Relative to the error of the offset scalar found. Offsets that match about equally well may be
+// told apart differently, but the one found mustn't match noticeably worse.
+const float MATCH_TOLERANCE = 1e-5F;
+
+const std::size_t COUNTS[] = {0, 1, 3, 4, 7, 8, 9, 15, 16, 17, 31, 33, 63, 65, 100, 1000};
+const std::size_t TAP_COUNTS[] = {1, 2, 5, 8, 15, 16, 17, 33, 64, 101, 301};
+
+std::mt19937 random_source(7);
+
+std::vector<float> noise(std::size_t count)
+{
+  std::uniform_real_distribution<float> uniform(-1.0F, 1.0F);
+  std::vector<float> values(count);
+  for (float &value : values)
+    value = uniform(random_source);
+  return values;
+}
+
+const char *name(SimdLevel level)
+{
+  return audio::filters::simd_level_name(level);
+}
+
+// Runs f at scalar and then at level, the level active before is restored afterwards
+template<typename F>
+void compare(SimdLevel level, F f)
+{
+  const SimdLevel previous = audio::filters::simd_level();
+  audio::filters::select_simd_level(SimdLevel::scalar);
+  f(false);
+  audio::filters::select_simd_level(level);
+  f(true);
+  audio::filters::select_simd_level(previous);
+}
+
+void dot_matches(SimdLevel level)
+{
+  float worst = 0.0F;
+  for (std::size_t count : COUNTS) {
+    const std::vector<float> a = noise(count), b = noise(count);
+    float magnitude = 0.0F;
+    for (std::size_t i = 0; i < count; i++)
+      magnitude += std::fabs(a[i] * b[i]);
+    float expected = 0.0F, actual = 0.0F;
+    compare(level, [&](bool vector) { (vector ? actual : expected) = audio::filters::dot(a.data(), b.data(), count); });
+    if (magnitude > 0.0F)
+      worst = std::max(worst, std::fabs(actual - expected) / magnitude);
+    else
+      CHECK(actual == 0.0F && expected == 0.0F);
+  }
+  if (!CHECK(worst <= DOT_TOLERANCE))
+    std::cerr << "dot at " << name(level) << " is off by " << worst << std::endl;
+}
+
+void fir_matches(SimdLevel level)
+{
+  float worst = 0.0F;
+  for (std::size_t taps_count : TAP_COUNTS) {
+    for (std::size_t count : COUNTS) {
+      const std::vector<float> taps = noise(taps_count);
+      const std::vector<float> samples = noise(count + taps_count - 1);
+      // One guard value past the end, no kernel may write it
+      std::vector<float> expected(count + 1, 42.0F), actual(count + 1, 42.0F);
+      compare(level, [&](bool vector) {
+        audio::filters::fir(samples.data(), taps.data(), taps_count, (vector ? actual : expected).data(), count);
+      });
+      CHECK(actual[count] == 42.0F);
+      for (std::size_t k = 0; k < count; k++) {
+        float magnitude = 0.0F;
+        for (std::size_t i = 0; i < taps_count; i++)
+          magnitude += std::fabs(taps[i] * samples[k + i]);
+        worst = std::max(worst, std::fabs(actual[k] - expected[k]) / magnitude);
+      }
+    }
+  }
+  if (!CHECK(worst <= DOT_TOLERANCE))
+    std::cerr << "fir at " << name(level) << " is off by " << worst << std::endl;
+}
+
+// A different cascade on every lane, lowpasses, highpasses, band passes and shelves
+std::vector<float> lane_coefficients(std::size_t sections)
+{
+  const std::size_t lanes = audio::filters::BIQUAD_LANES;
+  std::vector<float> coefficients(sections * 5 * lanes);
+  for (std::size_t s = 0; s < sections; s++) {
+    for (std::size_t lane = 0; lane < lanes; lane++) {
+      const double cutoff = 0.01 + 0.05 * lane + 0.02 * s;
+      audio::filters::Biquad biquad;
+      switch ((lane + s) % 4) {
+        case 0:
+          biquad = audio::filters::Biquad::lowpass(cutoff);
+          break;
+        case 1:
+          biquad = audio::filters::Biquad::highpass(cutoff);
+          break;
+        case 2:
+          biquad = audio::filters::Biquad::bandpass(cutoff, 2.0);
+          break;
+        default:
+          biquad = audio::filters::Biquad::low_shelf(cutoff, 6.0);
+          break;
+      }
+      const float values[] = {biquad.b0, biquad.b1, biquad.b2, biquad.a1, biquad.a2};
+      for (std::size_t c = 0; c < 5; c++)
+        coefficients[(s * 5 + c) * lanes + lane] = values[c];
+    }
+  }
+  return coefficients;
+}
+
+void biquad_lanes_matches(SimdLevel level)
+{
+  const std::size_t lanes = audio::filters::BIQUAD_LANES;
+  float worst = 0.0F;
+  for (std::size_t sections = 1; sections <= 6; sections++) {
+    const std::vector<float> coefficients = lane_coefficients(sections);
+    for (std::size_t frames : COUNTS) {
+      const std::vector<float> input = noise(frames * lanes);
+      std::vector<float> expected = input, actual = input;
+      // The state carries over, so every block is run twice in a row
+      std::vector<float> expected_state(sections * 2 * lanes), actual_state(sections * 2 * lanes);
+      float peak = 1.0F;
+      compare(level, [&](bool vector) {
+        std::vector<float> &samples = vector ? actual : expected;
+        std::vector<float> &state = vector ? actual_state : expected_state;
+        for (int pass = 0; pass < 2; pass++) {
+          if (pass == 1)
+            samples = input;
+          audio::filters::biquad_lanes(coefficients.data(), state.data(), sections, samples.data(), frames);
+        }
+      });
+      for (float value : expected)
+        peak = std::max(peak, std::fabs(value));
+      for (std::size_t i = 0; i < expected.size(); i++)
+        worst = std::max(worst, std::fabs(actual[i] - expected[i]) / peak);
+      for (std::size_t i = 0; i < expected_state.size(); i++)
+        worst = std::max(worst, std::fabs(actual_state[i] - expected_state[i]) / peak);
+    }
+  }
+  if (!CHECK(worst <= BIQUAD_TOLERANCE))
+    std::cerr << "biquad_lanes at " << name(level) << " is off by " << worst << std::endl;
+}
+
+void interpolate_linear_matches(SimdLevel level)
+{
+  float worst = 0.0F;
+  bool counts = true;
+  for (std::uint32_t factor : {1u, 2u, 3u, 4u, 8u}) {
+    for (std::size_t frames : COUNTS) {
+      const std::vector<float> input = noise(frames);
+      const std::size_t size = frames > 1 ? (frames - 1) * factor : 0;
+      std::vector<float> expected(size + 1, 42.0F), actual(size + 1, 42.0F);
+      std::size_t expected_count = 0, actual_count = 0;
+      compare(level, [&](bool vector) {
+        (vector ? actual_count : expected_count) =
+            audio::filters::interpolate_linear(input.data(), frames, factor, (vector ? actual : expected).data());
+      });
+      counts &= actual_count == size && expected_count == size && actual[size] == 42.0F;
+      for (std::size_t i = 0; i < size; i++)
+        worst = std::max(worst, std::fabs(actual[i] - expected[i]));
+    }
+  }
+  CHECK(counts);
+  if (!CHECK(worst <= INTERPOLATE_TOLERANCE))
+    std::cerr << "interpolate_linear at " << name(level) << " is off by " << worst << std::endl;
+}
+
+float squared_error(const float *pattern, std::size_t size, const float *samples)
+{
+  double error = 0.0;
+  for (std::size_t j = 0; j < size; j++)
+    error += double(pattern[j] - samples[j]) * (pattern[j] - samples[j]);
+  return float(error);
+}
+
+void best_match_matches(SimdLevel level)
+{
+  bool found = true;
+  bool exact = true;
+  for (std::size_t pattern_size : {1u, 7u, 16u, 17u, 64u, 600u}) {
+    for (std::size_t count : COUNTS) {
+      std::vector<float> samples = noise(count + pattern_size);
+      // A copy of the pattern hidden in the samples, it has to be found exactly
+      const std::vector<float> pattern = noise(pattern_size);
+      const std::size_t hidden = count / 3;
+      std::copy(pattern.begin(), pattern.end(), samples.begin() + hidden);
+      std::size_t expected = 0, actual = 0;
+      compare(level, [&](bool vector) {
+        (vector ? actual : expected) =
+            audio::filters::best_match(pattern.data(), pattern_size, samples.data(), samples.size());
+      });
+      exact &= actual == hidden && expected == hidden;
+
+      // Noise only, where the best offsets can be close
+      const std::vector<float> noisy = noise(count + pattern_size);
+      compare(level, [&](bool vector) {
+        (vector ? actual : expected) =
+            audio::filters::best_match(pattern.data(), pattern_size, noisy.data(), noisy.size());
+      });
+      const float expected_error = squared_error(pattern.data(), pattern_size, noisy.data() + expected);
+      const float actual_error = squared_error(pattern.data(), pattern_size, noisy.data() + actual);
+      found &= actual + pattern_size <= noisy.size() && actual_error <= expected_error * (1.0F + MATCH_TOLERANCE);
+    }
+  }
+  if (!CHECK(exact))
+    std::cerr << "best_match at " << name(level) << " missed an exact copy" << std::endl;
+  if (!CHECK(found))
+    std::cerr << "best_match at " << name(level) << " found a worse offset than scalar" << std::endl;
+}
+}
+
+int main()
+{
+  const SimdLevel levels[] = {SimdLevel::scalar, SimdLevel::sse2, SimdLevel::avx2, SimdLevel::avx512};
+  for (SimdLevel level : levels) {
+    // Levels this build or cpu lacks can't be selected, there is nothing to compare then
+    const SimdLevel previous = audio::filters::simd_level();
+    if (!audio::filters::select_simd_level(level))
+      continue;
+    audio::filters::select_simd_level(previous);
+    std::cout << "checking " << name(level) << std::endl;
+
+    dot_matches(level);
+    fir_matches(level);
+    biquad_lanes_matches(level);
+    interpolate_linear_matches(level);
+    best_match_matches(level);
+  }
+  return test::result("kernels_test");
+}
@@ -0,0 +1,74 @@
+#ifndef VISUALIZER_CAPTURE_ENGINE_H
+#define VISUALIZER_CAPTURE_ENGINE_H
+#include <audio_loopback/loopback_recorder.h>
+#include <audio_loopback/sample_ring.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace audio
+{
+typedef StampedRing<float, BlockStamp> CaptureRing;
+
+struct EngineStats
+{
+  // Times the engine thread came back from waiting for its descriptors
+  std::uint64_t wakeups;
+  std::uint64_t blocks;
+  std::uint64_t frames;
+  // Frames that didn't fit into the ring of their stream
+  std::uint64_t dropped_frames;
+  // Blocks with samples missing in front of them from the device, or cut short by a full ring
+  std::uint64_t discontinuities;
+  // Reads or recoveries that failed at the devices of the epoll thread
+  std::uint64_t errors;
+  // Cpu time used by the engine thread, not by the threads of sound servers it falls back to
+  std::chrono::microseconds cpu_time;
+};
+
+/// Captures many streams at once, each into a ring of its own.
+/// Streams whose backend can be read without a thread of its own (ALSA, pipes, files, generators)
+/// all share one epoll thread, devices are serviced when their descriptor is ready and clock paced
+/// sources on a timerfd. Streams of sound servers are read by their backend's loop thread,
+/// which all streams of that backend share. Rings only ever hold whole frames. Linux only.
+class CaptureEngine
+{
+public:
+  CaptureEngine();
+  ~CaptureEngine();
+
+  CaptureEngine(const CaptureEngine &) = delete;
+  CaptureEngine &operator=(const CaptureEngine &) = delete;
+
+  /// Opens a stream on the named backend, the default backend if empty, and returns its index.
+  /// Streams can only be added before start().
+  std::size_t add_stream(const AudioSinkInfo &sink, const CaptureOptions &options, const std::string &backend = "");
+
+  /// Consumer side of the stream's ring, interleaved in the stream's format.
+  /// Every block delivered comes with its flags and timing, see StampedRing. Blocks flagged
+  /// BUFFER_DISCONTINUITY, or with gap set, don't follow on from the samples read before them.
+  /// A block the ring cut short is flagged BUFFER_GAP itself, the block after it has gap set.
+  /// Set a LagPolicy on it before start(), the engine writes through it. Under block the thread
+  /// delivering to the ring waits for the consumer, which holds up every other stream that thread
+  /// serves, so it only suits files and generators. Unthrottled sources are only read while their
+  /// ring has room whatever the policy.
+  CaptureRing &ring(std::size_t stream);
+  StreamInfo info(std::size_t stream) const;
+
+  /// Starts the streams, promoting the epoll thread as asked before it reads its first block.
+  /// Streams of sound servers are promoted by the realtime options they were added with, see their info().
+  RealtimeGrant start(const RealtimeOptions &realtime = RealtimeOptions());
+  /// Stops every stream for good, also done by the destructor
+  void stop();
+
+  EngineStats stats() const;
+
+private:
+  class Impl;
+  std::unique_ptr<Impl> m_impl;
+};
+}
+
+#endif //VISUALIZER_CAPTURE_ENGINE_H
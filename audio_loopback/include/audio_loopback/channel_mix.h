@@ -0,0 +1,69 @@
+#ifndef VISUALIZER_CHANNEL_MIX_H
+#define VISUALIZER_CHANNEL_MIX_H
+#include <audio_loopback/loopback_recorder.h>
+#include <cstdint>
+#include <vector>
+
+namespace audio
+{
+// Blocks with more than two channels are in WAVE order: FL FR FC LFE BL BR SL SR.
+// Every backend asks its sound system for that order, or gets it from the device as is.
+
+/// Most outputs a matrix can mix to, they are all accumulated in registers at once
+constexpr std::uint32_t MAX_MIX_OUTPUTS = 8;
+
+/// Weight of every input channel in every output channel
+class DownmixMatrix
+{
+public:
+  /// All weights zero
+  DownmixMatrix(std::uint32_t inputs, std::uint32_t outputs);
+
+  /// ITU-R BS.775 fold down to left and right, centre and surrounds at -3 dB, LFE left out.
+  /// Rows are normalised to a gain of one so in phase full scale input doesn't clip.
+  static DownmixMatrix stereo(std::uint32_t inputs);
+  /// The stereo fold down summed to one channel
+  static DownmixMatrix mono(std::uint32_t inputs);
+
+  std::uint32_t inputs() const
+  {
+    return m_inputs;
+  }
+
+  std::uint32_t outputs() const
+  {
+    return m_outputs;
+  }
+
+  float &operator()(std::uint32_t output, std::uint32_t input)
+  {
+    return m_weights[output * m_inputs + input];
+  }
+
+  float operator()(std::uint32_t output, std::uint32_t input) const
+  {
+    return m_weights[output * m_inputs + input];
+  }
+
+  /// Row major, one row of inputs() weights per output
+  const float *weights() const
+  {
+    return m_weights.data();
+  }
+
+private:
+  std::uint32_t m_inputs;
+  std::uint32_t m_outputs;
+  std::vector<float> m_weights;
+};
+
+/// Splits an interleaved block into one plane per channel and mixes it through the matrix,
+/// reading every frame only once. planes holds view.format.channels pointers and mixed
+/// matrix.outputs() pointers to at least view.frames floats, either may be null to skip it.
+void deinterleave_downmix(const BufferView &view, float *const *planes, const DownmixMatrix &matrix, float *const *mixed);
+
+/// Splits an interleaved block into one plane per channel
+void deinterleave(const BufferView &view, float *const *planes);
+}
+
+#endif //VISUALIZER_CHANNEL_MIX_H
@@ -0,0 +1,27 @@
+#ifndef VISUALIZER_FAULT_INJECTION_H
+#define VISUALIZER_FAULT_INJECTION_H
+#include <chrono>
+#include <cstdint>
+
+namespace audio
+{
+// What the "faults" backend injected into all of its streams since the process started
+struct InjectedFaults
+{
+  // Blocks delivered late by jitter
+  std::uint64_t late;
+  std::uint64_t bursts;
+  std::uint64_t short_reads;
+  // Blocks lost on the way, and the frames in them
+  std::uint64_t dropped;
+  std::uint64_t dropped_frames;
+  std::uint64_t stalls;
+  // Time deliveries were held up by jitter, bursts and stalls together
+  std::chrono::microseconds held_up;
+};
+
+// Safe to call from any thread, take the difference of two calls for a single capture. Linux only.
+InjectedFaults injected_faults();
+}
+
+#endif //VISUALIZER_FAULT_INJECTION_H
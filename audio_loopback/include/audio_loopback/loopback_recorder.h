@@ -1,6 +1,11 @@
 #pragma once
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -25,13 +30,247 @@ struct AudioSinkInfo
     bool capture_device;
 };
 
+struct StreamFormat
+{
+    uint32_t sample_rate;
+    uint32_t channels;
+};
+
+enum BufferFlags : uint32_t
+{
+    // The device overran before this block, samples are missing in front of it
+    BUFFER_XRUN = 1u << 0,
+    // Samples are missing in front of this block for another reason: a hole the sound server
+    // reported, a failed read, or a consumer too far behind to take them. Rings of the capture
+    // engine also flag the block they cut short, see CaptureEngine::ring().
+    BUFFER_GAP = 1u << 1,
+    // Either of them, state carried over from earlier blocks (filters, alignment) doesn't apply any more
+    BUFFER_DISCONTINUITY = BUFFER_XRUN | BUFFER_GAP,
+};
+
+// When a block was captured, filled in by the backend that delivers it
+struct BlockTiming
+{
+    // steady_clock time the backend took the block from the device or sound server
+    std::chrono::steady_clock::time_point timestamp;
+    // Frames of the stream before this block, holes the sound system reported included
+    uint64_t position;
+    // How long before timestamp the first frame of the block went through the device, as the sound
+    // system reports it. Negative for loopback of an output whose samples haven't been played yet.
+    std::chrono::microseconds latency;
+
+    // When the given frame of the block was captured, or played for loopback of an output
+    std::chrono::steady_clock::time_point device_time(uint64_t frame, uint32_t sample_rate) const
+    {
+        return timestamp - latency + std::chrono::microseconds(frame * 1000000 / sample_rate);
+    }
+};
+
+// What rings keep of a block besides its samples
+struct BlockStamp
+{
+    uint32_t flags;
+    BlockTiming timing;
+};
+
+// Non-owning view of interleaved float samples in memory owned by the backend.
+// The memory is reused for the next read, so the view is only valid inside the callback.
+struct BufferView
+{
+    const float *data;
+    uint32_t frames;
+    StreamFormat format;
+    uint32_t flags;
+    BlockTiming timing;
+
+    BlockStamp stamp() const
+    {
+        return BlockStamp{flags, timing};
+    }
+
+    // Only meaningful for stereo blocks, see channel_mix.h for any other channel count
+    const StereoPacket *packets() const
+    {
+        return reinterpret_cast<const StereoPacket *>(data);
+    }
+};
+
+// Encodings of raw interleaved little endian samples
+enum class SampleFormat
+{
+    float32,
+    int16,
+    int24,
+    // 24 bit samples in the low three bytes of 32 bit words
+    int24_32,
+    int32,
+};
+
+// How sources that aren't driven by a device clock (files, generators) deliver their blocks
+enum class Pacing
+{
+    // One block per block duration of wall clock time, like a device would
+    realtime,
+    // As fast as the consumer takes them, for benchmarking the pipeline
+    unthrottled,
+};
+
+// Opt-in measures against the capture thread being preempted or page faulting on a loaded machine
+struct RealtimeOptions
+{
+    bool enabled = false;
+    // SCHED_FIFO priority, asked for directly and through rtkit if that is refused. 0 keeps the normal policy.
+    int priority = 20;
+    // Core to pin the thread to, -1 leaves it to the scheduler
+    int cpu = -1;
+    // Locks every page the process has mapped so far, which includes the rings and backend buffers
+    bool lock_memory = true;
+    // Stack touched up front so the thread doesn't fault on it later
+    std::size_t prefault_stack_bytes = 256 * 1024;
+};
+
+// Which of the requested measures the system allowed
+struct RealtimeGrant
+{
+    bool scheduling = false;
+    // Scheduling was granted by rtkit rather than by the kernel directly
+    bool rtkit = false;
+    // Why scheduling was refused, empty when it was granted or nothing said why
+    std::string scheduling_error;
+    bool pinned = false;
+    bool memory_locked = false;
+    bool stack_prefaulted = false;
+};
+
+// Lets a session size its blocks after how often they are consumed instead of a fixed latency.
+// Blocks shrink towards one per blocks_per_consume of the consumer's interval and grow to the
+// latency budget when nothing consumes them, keeping the wakeups down while the consumer is idle.
+struct AdaptiveBlockOptions
+{
+    bool enabled = false;
+    // Longest block, the size an idle consumer gets
+    std::chrono::microseconds latency_budget{40000};
+    // Shortest block, however fast the consumer
+    std::chrono::microseconds min_block{2000};
+    // Blocks per consumer interval, more than one keeps a fresh block there for every frame despite jitter
+    uint32_t blocks_per_consume = 2;
+};
+
+struct CaptureOptions
+{
+    // Requested capture latency, the backend sizes its fragments from this
+    std::chrono::microseconds latency{10000};
+    // Frames per device period for backends that drive the hardware directly, 0 derives it from latency
+    uint32_t period_frames = 0;
+    Pacing pacing = Pacing::realtime;
+    // Requested rate and channel count, zeros leave the choice to the device or source
+    StreamFormat format{0, 0};
+    // Encoding of sources that carry no header, like raw pcm on a pipe
+    SampleFormat sample_format = SampleFormat::float32;
+    // Applied to whichever thread delivers the blocks, when it delivers the first one
+    RealtimeOptions realtime;
+    // Only for sessions, latency is the starting point then
+    AdaptiveBlockOptions adaptive;
+};
+
+// What the backend actually negotiated for a capture
+struct StreamInfo
+{
+    StreamFormat format;
+    std::chrono::microseconds latency;
+    uint32_t fragment_frames;
+    // Encoding the device or source delivers, blocks are converted to float before the callback
+    SampleFormat sample_format = SampleFormat::float32;
+    // Ready once the first block was delivered, only valid() if realtime was enabled
+    std::shared_future<RealtimeGrant> realtime;
+};
+
+// What a session is doing right now
+struct CaptureMetrics
+{
+    // Frames in the block delivered last
+    uint32_t block_frames;
+    // Blocks delivered per second since metrics were taken last
+    double wakeups_per_second;
+    // How often the consumer reported taking blocks lately, 0 when it is idle
+    double consumer_hz;
+    // Reads that failed at the sound system since the capture started, on every device it switched to
+    uint64_t errors;
+    // How long the sound server's realtime callback took on the current device, 99th percentile and
+    // worst. Zero for backends that don't measure it, only JACK does.
+    std::chrono::microseconds process_p99;
+    std::chrono::microseconds process_max;
+};
+
 typedef std::vector<StereoPacket> AudioBuffer;
 typedef std::function<bool(const AudioBuffer& buffer)> CaptureCallback;
+typedef std::function<bool(const BufferView& view)> BufferCallback;
+
+// Backends compiled into this build, the first one is used unless another is selected.
+// The AUDIO_LOOPBACK_BACKEND environment variable overrides the default.
+std::vector<std::string> available_backends();
+// Switches the backend used by the functions below. Detached captures on the previous backend are
+// stopped, sessions keep running on it until they switch device.
+bool select_backend(const std::string &name);
 
 std::vector<AudioSinkInfo> list_sinks();
 AudioSinkInfo get_default_sink(bool capture);
 
-// Captures data on the specified audiosink until the capture callback returns false
+// A running capture, stopped when the session is destroyed or the callback returns false.
+// None of the methods may be called from inside the callback.
+class CaptureSession
+{
+public:
+    struct State;
+
+    CaptureSession() = default;
+    explicit CaptureSession(std::shared_ptr<State> state);
+    CaptureSession(CaptureSession &&other) = default;
+    CaptureSession &operator=(CaptureSession &&other) = default;
+    CaptureSession(const CaptureSession &) = delete;
+    CaptureSession &operator=(const CaptureSession &) = delete;
+
+    // What the current device negotiated
+    StreamInfo info() const;
+    // False once stopped, or once the callback returned false
+    bool running() const;
+
+    // Nothing is delivered while paused, the first block after resume() is flagged BUFFER_GAP.
+    // Sound servers that can stop the stream do so, otherwise its blocks are dropped.
+    void pause();
+    void resume();
+    bool paused() const;
+
+    // Once this returns the callback won't be called any more
+    void stop();
+
+    // Moves the capture to another device of the selected backend. The old device keeps delivering until
+    // the new one delivers its first block, which is flagged BUFFER_GAP. If the new device can't be opened
+    // this throws and the capture carries on from the old one.
+    StreamInfo switch_device(const AudioSinkInfo &sink);
+    // Between the last block from the old device and the first from the new one, at the last switch
+    std::chrono::microseconds last_switch_gap() const;
+
+    // Called by the consumer whenever it takes what was delivered, the cadence adaptive blocks follow
+    void consumed();
+    CaptureMetrics metrics() const;
+
+    // Leaves the capture running until the callback returns false or another backend is selected
+    void detach();
+
+private:
+    std::shared_ptr<State> m_state;
+};
+
+// Captures data on the specified audiosink until the session is stopped or the callback returns false
+CaptureSession capture_data(BufferCallback callback, const AudioSinkInfo &sink, const CaptureOptions &options);
+void capture_data(BufferCallback callback, const AudioSinkInfo &sink);
+
+// Applies the realtime options to the calling thread, for threads of the application like the renderer
+RealtimeGrant promote_current_thread(const RealtimeOptions &options);
+
+// Compatibility wrapper, copies every block into an AudioBuffer before calling back.
+// Blocks with another channel count than two are folded down to stereo first.
 void capture_data(CaptureCallback callback, const AudioSinkInfo &sink);
 }
 
@@ -4,5 +4,9 @@
 #include "loopback_recorder.h"
 
 std::ostream &operator<<(std::ostream &os, const audio::AudioSinkInfo &info);
+std::ostream &operator<<(std::ostream &os, audio::SampleFormat format);
+std::ostream &operator<<(std::ostream &os, const audio::StreamInfo &info);
+std::ostream &operator<<(std::ostream &os, const audio::RealtimeGrant &grant);
+std::ostream &operator<<(std::ostream &os, const audio::CaptureMetrics &metrics);
 
 #endif //VISUALIZER_OSTREAM_OPERATORS_H
@@ -0,0 +1,330 @@
+#ifndef VISUALIZER_SAMPLE_RING_H
+#define VISUALIZER_SAMPLE_RING_H
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+namespace audio
+{
+// Head and tail live on separate cache lines so the producer and the consumer
+// don't invalidate each other's line on every update.
+constexpr std::size_t CACHE_LINE_SIZE = 64;
+
+/// Single producer, single consumer ring buffer.
+/// The producer never blocks, samples that don't fit are dropped and counted.
+/// The consumer sees every sample the producer published, in order.
+template<typename T>
+class SampleRing
+{
+public:
+  explicit SampleRing(std::size_t min_capacity)
+      : m_capacity(round_up_pow2(min_capacity)),
+        m_mask(m_capacity - 1),
+        m_data(new T[m_capacity])
+  {
+  }
+
+  SampleRing(const SampleRing &) = delete;
+  SampleRing &operator=(const SampleRing &) = delete;
+
+  // Plain new only aligns to 16 bytes before C++17, rings on the heap still get their own cache lines
+  static void *operator new(std::size_t size)
+  {
+    void *block = ::operator new(size + CACHE_LINE_SIZE + sizeof(void *));
+    const std::uintptr_t start = reinterpret_cast<std::uintptr_t>(block) + sizeof(void *);
+    void *aligned = reinterpret_cast<void *>((start + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1));
+    static_cast<void **>(aligned)[-1] = block;
+    return aligned;
+  }
+
+  static void operator delete(void *aligned)
+  {
+    if (aligned != nullptr)
+      ::operator delete(static_cast<void **>(aligned)[-1]);
+  }
+
+  /// Producer side. Returns the number of samples written.
+  std::size_t write(const T *data, std::size_t count)
+  {
+    const std::size_t head = m_head.load(std::memory_order_relaxed);
+    if (m_capacity - (head - m_cached_tail) < count)
+      m_cached_tail = m_tail.load(std::memory_order_acquire);
+
+    const std::size_t to_write = std::min(count, m_capacity - (head - m_cached_tail));
+    const std::size_t offset = head & m_mask;
+    const std::size_t first = std::min(to_write, m_capacity - offset);
+    std::copy(data, data + first, m_data.get() + offset);
+    std::copy(data + first, data + to_write, m_data.get());
+    m_head.store(head + to_write, std::memory_order_release);
+
+    if (to_write < count)
+      m_dropped.fetch_add(count - to_write, std::memory_order_relaxed);
+    return to_write;
+  }
+
+  /// Producer side. Number of samples that fit without dropping any.
+  std::size_t writable()
+  {
+    m_cached_tail = m_tail.load(std::memory_order_acquire);
+    return m_capacity - (m_head.load(std::memory_order_relaxed) - m_cached_tail);
+  }
+
+  /// Consumer side. Returns the number of samples read.
+  std::size_t read(T *data, std::size_t count)
+  {
+    const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (m_cached_head - tail < count)
+      m_cached_head = m_head.load(std::memory_order_acquire);
+
+    const std::size_t to_read = std::min(count, m_cached_head - tail);
+    const std::size_t offset = tail & m_mask;
+    const std::size_t first = std::min(to_read, m_capacity - offset);
+    std::copy(m_data.get() + offset, m_data.get() + offset + first, data);
+    std::copy(m_data.get(), m_data.get() + (to_read - first), data + first);
+    m_tail.store(tail + to_read, std::memory_order_release);
+    return to_read;
+  }
+
+  /// Consumer side. Discards up to count of the oldest samples, returns the number discarded.
+  std::size_t skip(std::size_t count)
+  {
+    const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (m_cached_head - tail < count)
+      m_cached_head = m_head.load(std::memory_order_acquire);
+
+    const std::size_t to_skip = std::min(count, m_cached_head - tail);
+    m_tail.store(tail + to_skip, std::memory_order_release);
+    return to_skip;
+  }
+
+  /// Consumer side. Number of samples ready to be read.
+  std::size_t available() const
+  {
+    return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_relaxed);
+  }
+
+  /// Producer side. Samples written so far, which is the position the next write starts at.
+  std::size_t written() const
+  {
+    return m_head.load(std::memory_order_relaxed);
+  }
+
+  /// Consumer side. Samples read so far, which is the position of the next sample read.
+  std::size_t read_position() const
+  {
+    return m_tail.load(std::memory_order_relaxed);
+  }
+
+  /// Samples the producer had to drop because the consumer was too far behind.
+  std::uint64_t dropped() const
+  {
+    return m_dropped.load(std::memory_order_relaxed);
+  }
+
+  std::size_t capacity() const
+  {
+    return m_capacity;
+  }
+
+private:
+  static std::size_t round_up_pow2(std::size_t value)
+  {
+    std::size_t result = 1;
+    while (result < value)
+      result <<= 1;
+    return result;
+  }
+
+  const std::size_t m_capacity;
+  const std::size_t m_mask;
+  const std::unique_ptr<T[]> m_data;
+
+  // Written by the producer
+  alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_head{0};
+  std::size_t m_cached_tail = 0;
+  std::atomic<std::uint64_t> m_dropped{0};
+
+  // Written by the consumer
+  alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_tail{0};
+  std::size_t m_cached_head = 0;
+};
+
+/// What a StampedRing does once its consumer lags behind
+enum class LagPolicy
+{
+  /// The ring fills up and the producer drops new samples until the consumer catches up
+  drop_newest,
+  /// The consumer skips every block but the newest
+  drop_oldest,
+  /// The producer waits for room and nothing is lost, for offline sources only since a device can't wait
+  block,
+  /// The consumer keeps one block in every few, more of them the further behind it is
+  decimate,
+};
+
+/// A SampleRing that carries a stamp, like the timing of a captured block, with every write.
+/// Stamps go through a ring of their own and are published after their samples, so the samples
+/// of every stamp the consumer takes are already readable, or were dropped.
+/// Writes are cut to whole frames of frame_size samples, so interleaved channels never shift.
+template<typename T, typename Stamp>
+class StampedRing
+{
+public:
+  struct Block
+  {
+    /// Ring position of the block's first sample, compare with position() on the consumer side
+    std::size_t position;
+    /// Samples of the block that fit into the ring
+    std::size_t samples;
+    /// Samples or stamps in front of this block were dropped, it doesn't follow on from the block before
+    bool gap;
+    Stamp stamp;
+  };
+
+  StampedRing(std::size_t min_capacity, std::size_t max_blocks, std::size_t frame_size = 1)
+      : m_samples(new SampleRing<T>(min_capacity)), m_blocks(new SampleRing<Block>(max_blocks)),
+        m_frame_size(std::max<std::size_t>(frame_size, 1))
+  {
+  }
+
+  /// Set before the producer starts. The consumer counts as lagging once more than max_lag samples
+  /// are waiting from the start of the next block, 0 means half the ring. drop_oldest and decimate
+  /// are applied by next_block(), consumers that only read() get drop_newest.
+  void set_lag_policy(LagPolicy policy, std::size_t max_lag = 0)
+  {
+    m_policy = policy;
+    m_max_lag = max_lag != 0 ? max_lag : capacity() / 2;
+  }
+
+  /// Producer side. How many of count samples the next write() takes, in whole frames.
+  /// Waits for room under LagPolicy::block like write() does, so a producer can flag a block it
+  /// knows will be cut short before writing it.
+  std::size_t room(std::size_t count)
+  {
+    if (m_policy == LagPolicy::block) {
+      const std::size_t needed = std::min(count, capacity() - capacity() % m_frame_size);
+      while ((m_samples->writable() < needed || m_blocks->writable() == 0) && !m_closed.load(std::memory_order_acquire))
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    const std::size_t fits = std::min(count, m_samples->writable());
+    return fits - fits % m_frame_size;
+  }
+
+  /// Producer side. Returns the number of samples written, the block is published even if none fit.
+  /// Waits for room under LagPolicy::block, until the consumer closes the ring. Samples that don't
+  /// fit are dropped and the next block is flagged with gap.
+  std::size_t write(const T *data, std::size_t count, const Stamp &stamp)
+  {
+    const std::size_t fits = room(count);
+
+    Block block;
+    block.position = m_samples->written();
+    block.samples = m_samples->write(data, fits);
+    block.gap = m_gap;
+    block.stamp = stamp;
+    const bool published = m_blocks->write(&block, 1) == 1;
+    m_gap = block.samples < count || !published;
+    if (block.samples < count)
+      m_dropped.fetch_add(count - block.samples, std::memory_order_relaxed);
+    return block.samples;
+  }
+
+  /// Producer side. Number of samples that fit without dropping any.
+  std::size_t writable()
+  {
+    return m_samples->writable();
+  }
+
+  /// Consumer side. Returns the number of samples read.
+  std::size_t read(T *data, std::size_t count)
+  {
+    return m_samples->read(data, count);
+  }
+
+  /// Consumer side. Takes the oldest block that hasn't been taken yet, or a later one if the lag
+  /// policy skips blocks, which sets gap. Read the block's samples before taking the next one.
+  bool next_block(Block &block)
+  {
+    if (m_blocks->read(&block, 1) != 1)
+      return false;
+    if (m_policy != LagPolicy::drop_oldest && m_policy != LagPolicy::decimate)
+      return true;
+
+    const std::size_t lag = position() + available() - std::min(block.position, position());
+    if (lag <= m_max_lag)
+      return true;
+    // Decimating keeps every n-th block, n growing with the lag, dropping keeps only the newest
+    std::size_t to_skip = m_policy == LagPolicy::decimate ? lag / m_max_lag : m_blocks->available();
+    Block next;
+    while (to_skip-- > 0 && m_blocks->read(&next, 1) == 1) {
+      const std::size_t end = block.position + block.samples;
+      if (end > position())
+        m_skipped += m_samples->skip(end - position());
+      block = next;
+      block.gap = true;
+    }
+    return true;
+  }
+
+  /// Consumer side. Samples the lag policy skipped to catch up.
+  std::uint64_t skipped() const
+  {
+    return m_skipped;
+  }
+
+  /// Consumer side. Stops the producer from waiting for room, for good, before the consumer goes away.
+  void close()
+  {
+    m_closed.store(true, std::memory_order_release);
+  }
+
+  /// Consumer side. Number of samples ready to be read.
+  std::size_t available() const
+  {
+    return m_samples->available();
+  }
+
+  /// Consumer side. Ring position of the next sample read.
+  std::size_t position() const
+  {
+    return m_samples->read_position();
+  }
+
+  /// Samples the producer had to drop because the consumer was too far behind.
+  std::uint64_t dropped() const
+  {
+    return m_dropped.load(std::memory_order_relaxed);
+  }
+
+  /// Stamps dropped because the consumer didn't take blocks as fast as they came
+  std::uint64_t dropped_blocks() const
+  {
+    return m_blocks->dropped();
+  }
+
+  std::size_t capacity() const
+  {
+    return m_samples->capacity();
+  }
+
+private:
+  // Each ring keeps its counters on cache lines of its own
+  const std::unique_ptr<SampleRing<T>> m_samples;
+  const std::unique_ptr<SampleRing<Block>> m_blocks;
+  const std::size_t m_frame_size;
+  LagPolicy m_policy = LagPolicy::drop_newest;
+  std::size_t m_max_lag = 0;
+  std::atomic<bool> m_closed{false};
+  // Written by the producer
+  bool m_gap = false;
+  std::atomic<std::uint64_t> m_dropped{0};
+  // Written by the consumer
+  std::uint64_t m_skipped = 0;
+};
+}
+
+#endif //VISUALIZER_SAMPLE_RING_H
@@ -0,0 +1,303 @@
+#include "block_source.h"
+#include "sample_convert.h"
+#include <alsa/asoundlib.h>
+#include <poll.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+    const uint32_t CHANNELS = 2;
+    // Tried in order, the first rate the hardware runs at natively is used
+    const unsigned int RATES[] = {48000, 44100, 96000, 192000};
+
+    struct FormatEntry
+    {
+        snd_pcm_format_t alsa;
+        audio::SampleFormat encoding;
+    };
+    const FormatEntry FORMATS[] = {
+        {SND_PCM_FORMAT_FLOAT_LE, audio::SampleFormat::float32},
+        {SND_PCM_FORMAT_S32_LE, audio::SampleFormat::int32},
+        {SND_PCM_FORMAT_S24_LE, audio::SampleFormat::int24_32},
+        {SND_PCM_FORMAT_S24_3LE, audio::SampleFormat::int24},
+        {SND_PCM_FORMAT_S16_LE, audio::SampleFormat::int16},
+    };
+    const uint32_t PERIODS_PER_BUFFER = 4;
+    // Upper bound on how long a stop waits for a blocking reader to notice
+    const int POLL_TIMEOUT_MS = 100;
+
+    void check(int result, const char *what)
+    {
+        if (result < 0)
+            throw std::runtime_error(std::string(what) + ": " + snd_strerror(result));
+    }
+}
+
+// Reads straight out of the mmap'ed DMA ring. Float devices are handed to the consumer in place,
+// integer formats are converted into a buffer that is reused between periods.
+class AlsaSource : public audio::detail::BlockSource
+{
+public:
+    AlsaSource(const std::string &device, const audio::CaptureOptions &options)
+    {
+        check(snd_pcm_open(&m_pcm, device.c_str(), SND_PCM_STREAM_CAPTURE, SND_PCM_NONBLOCK), "snd_pcm_open");
+        // The destructor doesn't run when the constructor throws, the handle is closed here then
+        try {
+            configure(device, options);
+        }
+        catch (...) {
+            snd_pcm_close(m_pcm);
+            m_pcm = nullptr;
+            throw;
+        }
+    }
+
+    ~AlsaSource() override
+    {
+        if (m_pcm != nullptr)
+            snd_pcm_close(m_pcm);
+    }
+
+    audio::StreamFormat format() const override
+    {
+        return m_stream_format;
+    }
+
+    audio::SampleFormat sample_format() const override
+    {
+        return m_encoding;
+    }
+
+    int poll_fd() const override
+    {
+        return m_fds.empty() ? -1 : m_fds[0].fd;
+    }
+
+    uint64_t queued_frames() const override
+    {
+        return m_queued;
+    }
+
+    uint64_t errors() const override
+    {
+        return m_errors.load(std::memory_order_relaxed);
+    }
+
+    void set_nonblocking() override
+    {
+        m_nonblocking = true;
+    }
+
+    bool next(audio::BufferView &view, uint32_t max_frames) override
+    {
+        // The previous view is only handed back to the device once the consumer is done with it
+        if (!commit())
+            return false;
+
+        snd_pcm_sframes_t available = snd_pcm_avail_update(m_pcm);
+        if (available < 0) {
+            m_pending_flags |= recover(static_cast<int>(available));
+            return false;
+        }
+        if (static_cast<snd_pcm_uframes_t>(available) < m_period) {
+            if (!m_nonblocking)
+                wait();
+            return false;
+        }
+
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t frames = std::min<snd_pcm_uframes_t>(available, std::max<snd_pcm_uframes_t>(max_frames, 1));
+        int result = snd_pcm_mmap_begin(m_pcm, &areas, &m_offset, &frames);
+        if (result < 0) {
+            m_pending_flags |= recover(result);
+            return false;
+        }
+        m_mapped = frames;
+        m_queued = static_cast<snd_pcm_uframes_t>(available) - frames;
+
+        // Interleaved access, so every channel shares the first area
+        const uint8_t *base = static_cast<const uint8_t *>(areas[0].addr) + (areas[0].first + m_offset * areas[0].step) / 8;
+        view = audio::BufferView{deliverable(base, frames), static_cast<uint32_t>(frames), m_stream_format, m_pending_flags,
+                                 audio::BlockTiming()};
+        m_pending_flags = 0;
+        return true;
+    }
+private:
+    // Sets up the opened pcm for mmap capture close to the options and starts it
+    void configure(const std::string &device, const audio::CaptureOptions &options)
+    {
+        snd_pcm_hw_params_t *hw_params;
+        snd_pcm_hw_params_alloca(&hw_params);
+        check(snd_pcm_hw_params_any(m_pcm, hw_params), "snd_pcm_hw_params_any");
+        check(snd_pcm_hw_params_set_access(m_pcm, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED),
+              "mmap access not supported");
+
+        // Whichever of these the hardware takes is read as is and converted by our own kernels
+        m_format = SND_PCM_FORMAT_UNKNOWN;
+        for (const auto &format : FORMATS) {
+            if (snd_pcm_hw_params_set_format(m_pcm, hw_params, format.alsa) == 0) {
+                m_format = format.alsa;
+                m_encoding = format.encoding;
+                break;
+            }
+        }
+        if (m_format == SND_PCM_FORMAT_UNKNOWN)
+            throw std::runtime_error("no supported sample format on " + device);
+
+        unsigned int rate = options.format.sample_rate;
+        for (unsigned int native : RATES) {
+            if (rate == 0 && snd_pcm_hw_params_test_rate(m_pcm, hw_params, native, 0) == 0)
+                rate = native;
+        }
+        if (rate == 0)
+            rate = RATES[0];
+        unsigned int channels = options.format.channels != 0 ? options.format.channels : CHANNELS;
+        check(snd_pcm_hw_params_set_rate_near(m_pcm, hw_params, &rate, nullptr), "snd_pcm_hw_params_set_rate_near");
+        check(snd_pcm_hw_params_set_channels_near(m_pcm, hw_params, &channels), "snd_pcm_hw_params_set_channels_near");
+
+        snd_pcm_uframes_t period = options.period_frames;
+        if (period == 0)
+            period = static_cast<snd_pcm_uframes_t>(options.latency.count() * rate / 1000000);
+        check(snd_pcm_hw_params_set_period_size_near(m_pcm, hw_params, &period, nullptr),
+              "snd_pcm_hw_params_set_period_size_near");
+        snd_pcm_uframes_t buffer = period * PERIODS_PER_BUFFER;
+        check(snd_pcm_hw_params_set_buffer_size_near(m_pcm, hw_params, &buffer),
+              "snd_pcm_hw_params_set_buffer_size_near");
+        check(snd_pcm_hw_params(m_pcm, hw_params), "snd_pcm_hw_params");
+
+        // Only wake up once a whole period is ready
+        snd_pcm_sw_params_t *sw_params;
+        snd_pcm_sw_params_alloca(&sw_params);
+        check(snd_pcm_sw_params_current(m_pcm, sw_params), "snd_pcm_sw_params_current");
+        check(snd_pcm_sw_params_set_avail_min(m_pcm, sw_params, period), "snd_pcm_sw_params_set_avail_min");
+        check(snd_pcm_sw_params(m_pcm, sw_params), "snd_pcm_sw_params");
+
+        m_stream_format = audio::StreamFormat{rate, channels};
+        m_period = period;
+        if (m_format != SND_PCM_FORMAT_FLOAT_LE)
+            m_converted.resize(period * channels);
+
+        m_fds.resize(snd_pcm_poll_descriptors_count(m_pcm));
+        snd_pcm_poll_descriptors(m_pcm, m_fds.data(), m_fds.size());
+
+        check(snd_pcm_start(m_pcm), "snd_pcm_start");
+    }
+
+    bool commit()
+    {
+        if (m_mapped == 0)
+            return true;
+        const snd_pcm_uframes_t frames = m_mapped;
+        m_mapped = 0;
+        snd_pcm_sframes_t committed = snd_pcm_mmap_commit(m_pcm, m_offset, frames);
+        if (committed < 0 || static_cast<snd_pcm_uframes_t>(committed) != frames) {
+            m_pending_flags |= recover(committed < 0 ? static_cast<int>(committed) : -EPIPE);
+            return false;
+        }
+        return true;
+    }
+
+    // Blocking mode only, the timeout bounds how long a stop waits for the reading thread
+    void wait()
+    {
+        if (poll(m_fds.data(), m_fds.size(), POLL_TIMEOUT_MS) <= 0)
+            return;
+        unsigned short revents;
+        snd_pcm_poll_descriptors_revents(m_pcm, m_fds.data(), m_fds.size(), &revents);
+        if (revents & POLLERR)
+            m_pending_flags |= recover(-EPIPE);
+    }
+
+    const float *deliverable(const uint8_t *data, snd_pcm_uframes_t frames)
+    {
+        if (m_format == SND_PCM_FORMAT_FLOAT_LE)
+            return reinterpret_cast<const float *>(data);
+
+        const size_t samples = frames * m_stream_format.channels;
+        m_converted.resize(std::max(m_converted.size(), samples));
+        audio::detail::convert_to_float(m_encoding, data, m_converted.data(), samples);
+        return m_converted.data();
+    }
+
+    // Restarts the device after an xrun, the returned flags mark the next delivered block.
+    // A failed restart is counted, the next read tries again.
+    uint32_t recover(int error)
+    {
+        if (snd_pcm_recover(m_pcm, error, 1) < 0 || snd_pcm_start(m_pcm) < 0)
+            m_errors.fetch_add(1, std::memory_order_relaxed);
+        return audio::BUFFER_XRUN;
+    }
+
+    snd_pcm_t *m_pcm = nullptr;
+    snd_pcm_format_t m_format = SND_PCM_FORMAT_UNKNOWN;
+    audio::SampleFormat m_encoding = audio::SampleFormat::float32;
+    snd_pcm_uframes_t m_period = 0;
+    audio::StreamFormat m_stream_format{0, 0};
+    std::vector<pollfd> m_fds;
+    bool m_nonblocking = false;
+    snd_pcm_uframes_t m_offset = 0;
+    snd_pcm_uframes_t m_mapped = 0;
+    // Captured after the mapped block, the device is that far ahead of it
+    snd_pcm_uframes_t m_queued = 0;
+    uint32_t m_pending_flags = 0;
+    std::vector<float> m_converted;
+    std::atomic<uint64_t> m_errors{0};
+};
+
+class AlsaBackend : public audio::detail::SourceBackend
+{
+public:
+    std::vector<audio::AudioSinkInfo> list_sinks() override
+    {
+        std::vector<audio::AudioSinkInfo> sinks;
+        void **hints;
+        if (snd_device_name_hint(-1, "pcm", &hints) < 0)
+            return sinks;
+
+        for (void **hint = hints; *hint != nullptr; hint++) {
+            char *name = snd_device_name_get_hint(*hint, "NAME");
+            char *description = snd_device_name_get_hint(*hint, "DESC");
+            char *direction = snd_device_name_get_hint(*hint, "IOID");
+            // A missing IOID means the pcm can do both directions
+            if (name != nullptr && (direction == nullptr || std::string(direction) == "Input"))
+                sinks.push_back(audio::AudioSinkInfo{description != nullptr ? description : name, name, true});
+            free(name);
+            free(description);
+            free(direction);
+        }
+        snd_device_name_free_hint(hints);
+        return sinks;
+    }
+
+    // Without a sound server loopback comes from snd-aloop, whatever plays on
+    // hw:Loopback,0 can be captured on hw:Loopback,1
+    audio::AudioSinkInfo get_default_sink(bool capture) override
+    {
+        if (capture)
+            return audio::AudioSinkInfo{"default", "default", true};
+        return audio::AudioSinkInfo{"Loopback", "hw:Loopback,1", false};
+    }
+
+    std::unique_ptr<audio::detail::BlockSource> open_source(const audio::AudioSinkInfo &sink,
+                                                            const audio::CaptureOptions &options) override
+    {
+        return std::unique_ptr<audio::detail::BlockSource>(
+            new AlsaSource(sink.device_id.empty() ? "hw:Loopback,1" : sink.device_id, options));
+    }
+};
+
+namespace audio
+{
+namespace detail
+{
+    std::unique_ptr<CaptureBackend> make_alsa_backend()
+    {
+        return std::unique_ptr<CaptureBackend>(new AlsaBackend());
+    }
+}
+}
@@ -0,0 +1,53 @@
+#ifndef VISUALIZER_BLOCK_CLOCK_H
+#define VISUALIZER_BLOCK_CLOCK_H
+#include <audio_loopback/loopback_recorder.h>
+#include <chrono>
+#include <cstdint>
+
+namespace audio
+{
+namespace detail
+{
+// Stamps the blocks of one stream with their timing as they are taken from the device,
+// and with the flags of whatever went wrong since the previous block
+class BlockClock
+{
+public:
+  // latency is how long before now the first frame of the block went through the device
+  void stamp(BufferView &view, std::chrono::microseconds latency)
+  {
+    view.timing.timestamp = std::chrono::steady_clock::now();
+    view.timing.position = m_position;
+    view.timing.latency = latency;
+    view.flags |= m_pending_flags;
+    m_pending_flags = 0;
+    m_position += view.frames;
+  }
+
+  // For sources that know how many frames the device captured after the block, instead of a latency
+  void stamp_queued(BufferView &view, uint64_t queued_frames)
+  {
+    stamp(view, std::chrono::microseconds((view.frames + queued_frames) * 1000000 / view.format.sample_rate));
+  }
+
+  // Frames the stream lost, later blocks still count them in their position
+  void skip(uint64_t frames)
+  {
+    m_position += frames;
+    mark(BUFFER_GAP);
+  }
+
+  // Flags for the next block, for failures noticed between blocks
+  void mark(uint32_t flags)
+  {
+    m_pending_flags |= flags;
+  }
+
+private:
+  uint64_t m_position = 0;
+  uint32_t m_pending_flags = 0;
+};
+}
+}
+
+#endif //VISUALIZER_BLOCK_CLOCK_H
@@ -0,0 +1,100 @@
+#ifndef VISUALIZER_BLOCK_SOURCE_H
+#define VISUALIZER_BLOCK_SOURCE_H
+#include "block_clock.h"
+#include "capture_backend.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace audio
+{
+namespace detail
+{
+// Produces blocks on demand instead of calling back from its own thread.
+// Sources with a poll_fd() are paced by whatever writes to it, the rest by the caller.
+class BlockSource
+{
+public:
+  virtual ~BlockSource() = default;
+
+  virtual StreamFormat format() const = 0;
+  // Encoding of the underlying data, next() always delivers floats
+  virtual SampleFormat sample_format() const
+  {
+    return SampleFormat::float32;
+  }
+  // Points view at the next block of at most max_frames. Returns false when no block is ready,
+  // for now or, once finished() is true, for good. The view stays valid until the next call.
+  virtual bool next(BufferView &view, uint32_t max_frames) = 0;
+  virtual bool finished() const
+  {
+    return false;
+  }
+  // Frames the device captured after the block next() last returned, for the block's timing
+  virtual uint64_t queued_frames() const
+  {
+    return 0;
+  }
+  // Frames lost in front of the block next() last returned, the block's position counts them.
+  // Taken once, the next call returns only what was lost after that block.
+  virtual uint64_t lost_frames()
+  {
+    return 0;
+  }
+  // Reads or recoveries that failed at the device so far, safe to call from any thread
+  virtual uint64_t errors() const
+  {
+    return 0;
+  }
+
+  // Readable whenever next() has a block, -1 if the source never waits for data
+  virtual int poll_fd() const
+  {
+    return -1;
+  }
+  // Makes next() return false instead of waiting for data, for use from an event loop
+  virtual void set_nonblocking()
+  {
+  }
+};
+
+// Runs a BlockSource on its own thread and delivers its blocks with the requested pacing
+class SourceStream : public CaptureStream
+{
+public:
+  SourceStream(std::unique_ptr<BlockSource> source, BufferCallback callback);
+  ~SourceStream() override;
+
+  StreamInfo start(const CaptureOptions &options);
+  StreamInfo info() const override;
+  // The source isn't read while paused, files and generators carry on where they were
+  bool set_paused(bool paused) override;
+  bool set_block_frames(uint32_t frames) override;
+  uint64_t errors() const override;
+
+private:
+  void run(Pacing pacing);
+
+  std::unique_ptr<BlockSource> m_source;
+  BufferCallback m_callback;
+  StreamInfo m_info;
+  std::atomic<bool> m_running{false};
+  std::atomic<bool> m_paused{false};
+  std::atomic<uint32_t> m_block_frames{0};
+  std::thread m_thread;
+};
+
+// Frames per block for a source, from the period size or else the latency target
+uint32_t block_frames(const CaptureOptions &options, StreamFormat format);
+
+// Backend whose captures are BlockSources, each stream runs one on a SourceStream
+class SourceBackend : public CaptureBackend
+{
+public:
+  std::unique_ptr<CaptureStream> open_stream(BufferCallback callback, const AudioSinkInfo &sink,
+                                             const CaptureOptions &options) override;
+};
+}
+}
+
+#endif //VISUALIZER_BLOCK_SOURCE_H
@@ -0,0 +1,58 @@
+#ifndef VISUALIZER_CAPTURE_BACKEND_H
+#define VISUALIZER_CAPTURE_BACKEND_H
+#include "capture_stream.h"
+#include <audio_loopback/loopback_recorder.h>
+#include <memory>
+#include <vector>
+
+namespace audio
+{
+namespace detail
+{
+class BlockSource;
+
+// A sound system the public capture functions can be routed to.
+// Destroying a backend stops every capture it started.
+class CaptureBackend
+{
+public:
+  virtual ~CaptureBackend() = default;
+
+  virtual std::vector<AudioSinkInfo> list_sinks() = 0;
+  virtual AudioSinkInfo get_default_sink(bool capture) = 0;
+  // Captures until the returned stream is destroyed
+  virtual std::unique_ptr<CaptureStream> open_stream(BufferCallback callback, const AudioSinkInfo &sink,
+                                                     const CaptureOptions &options) = 0;
+  // Captures until the callback returns false or the backend is destroyed
+  StreamInfo capture_data(BufferCallback callback, const AudioSinkInfo &sink, const CaptureOptions &options);
+
+  // Backends that can be read without a thread of their own return a source, the rest nullptr
+  virtual std::unique_ptr<BlockSource> open_source(const AudioSinkInfo &sink, const CaptureOptions &options);
+
+private:
+  std::vector<std::unique_ptr<CaptureStream>> m_detached;
+};
+
+// A new instance of a compiled in backend, nullptr for unknown names.
+// An empty name gives the default backend.
+std::unique_ptr<CaptureBackend> make_backend(const std::string &name);
+
+std::unique_ptr<CaptureBackend> make_pulseaudio_backend();
+std::unique_ptr<CaptureBackend> make_file_backend();
+std::unique_ptr<CaptureBackend> make_generator_backend();
+std::unique_ptr<CaptureBackend> make_pipe_backend();
+// Wraps the sources of another backend, see fault_source.cc
+std::unique_ptr<CaptureBackend> make_fault_backend();
+#ifdef AUDIO_LOOPBACK_HAVE_PIPEWIRE
+std::unique_ptr<CaptureBackend> make_pipewire_backend();
+#endif
+#ifdef AUDIO_LOOPBACK_HAVE_ALSA
+std::unique_ptr<CaptureBackend> make_alsa_backend();
+#endif
+#ifdef AUDIO_LOOPBACK_HAVE_JACK
+std::unique_ptr<CaptureBackend> make_jack_backend();
+#endif
+}
+}
+
+#endif //VISUALIZER_CAPTURE_BACKEND_H
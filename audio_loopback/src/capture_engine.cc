@@ -0,0 +1,399 @@
+#include <audio_loopback/capture_engine.h>
+#include "block_source.h"
+#include "realtime.h"
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <future>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace
+{
+// Bounds the blocks taken from one ready descriptor per wakeup, so a flooded pipe can't starve the rest
+const uint32_t MAX_BLOCKS_PER_WAKEUP = 16;
+const int MAX_EVENTS = 64;
+// Rings hold this much audio whatever the block size, a render frame or two at the slowest
+const uint32_t RING_MILLISECONDS = 500;
+
+enum class State
+{
+  idle,
+  running,
+  stopped,
+};
+
+std::chrono::microseconds thread_cpu_time(pthread_t thread)
+{
+  clockid_t clock;
+  timespec time;
+  if (pthread_getcpuclockid(thread, &clock) != 0 || clock_gettime(clock, &time) != 0)
+    return std::chrono::microseconds(0);
+  return std::chrono::microseconds(time.tv_sec * 1000000LL + time.tv_nsec / 1000);
+}
+}
+
+namespace audio
+{
+class CaptureEngine::Impl
+{
+public:
+  struct Stream
+  {
+    Stream(StreamFormat format, uint32_t block_frames)
+        : ring(new CaptureRing(ring_frames(format, block_frames) * format.channels,
+                               ring_frames(format, block_frames) / std::max<uint32_t>(block_frames / 4, 1),
+                               format.channels))
+    {
+    }
+
+    // Stamps are sized for blocks down to a quarter of the nominal block, sound servers vary theirs
+    static size_t ring_frames(StreamFormat format, uint32_t block_frames)
+    {
+      return std::max<size_t>(size_t(format.sample_rate) * RING_MILLISECONDS / 1000, 4 * block_frames);
+    }
+
+    std::unique_ptr<CaptureRing> ring;
+    StreamInfo info;
+    // Null for streams read by their backend's own thread
+    std::unique_ptr<detail::BlockSource> source;
+    uint32_t block_frames = 0;
+    detail::BlockClock clock;
+    // Clock paced sources wake up on this timer, -1 for descriptor driven or unthrottled ones
+    int timer = -1;
+    bool unthrottled = false;
+    bool registered = false;
+  };
+
+  ~Impl()
+  {
+    stop();
+    // The backends stop their own threads, which may still be calling into the rings
+    backends.clear();
+    for (auto &stream : streams) {
+      if (stream->timer >= 0)
+        close(stream->timer);
+    }
+    if (wakeup >= 0)
+      close(wakeup);
+    if (epoll >= 0)
+      close(epoll);
+  }
+
+  detail::CaptureBackend &backend(const std::string &name)
+  {
+    auto &backend = backends[name];
+    if (!backend)
+      backend = detail::make_backend(name);
+    if (!backend)
+      throw std::runtime_error("unknown backend " + name);
+    return *backend;
+  }
+
+  size_t add_stream(const AudioSinkInfo &sink, const CaptureOptions &options, const std::string &name)
+  {
+    if (state != State::idle)
+      throw std::logic_error("streams can only be added before the engine starts");
+
+    auto &capture_backend = backend(name);
+    auto source = capture_backend.open_source(sink, options);
+    if (source)
+      return add_source(std::move(source), options);
+
+    // Sound servers call back from their loop thread, straight into the ring. Nothing is delivered
+    // before start(), which is also when the streams vector stops changing.
+    const size_t index = streams.size();
+    std::shared_future<RealtimeGrant> grant;
+    auto callback = detail::realtime_callback(
+        [this, index](const BufferView &view) {
+          const State current = state.load(std::memory_order_acquire);
+          if (current == State::running)
+            deliver(*streams[index], view);
+          return current != State::stopped;
+        },
+        options.realtime, grant);
+    auto info = capture_backend.capture_data(callback, sink, options);
+    info.realtime = grant;
+    std::unique_ptr<Stream> stream(new Stream(info.format, info.fragment_frames));
+    stream->info = info;
+    streams.push_back(std::move(stream));
+    return index;
+  }
+
+  size_t add_source(std::unique_ptr<detail::BlockSource> source, const CaptureOptions &options)
+  {
+    const StreamFormat format = source->format();
+    const uint32_t frames = detail::block_frames(options, format);
+    std::unique_ptr<Stream> stream(new Stream(format, frames));
+    stream->block_frames = frames;
+    stream->info.format = format;
+    stream->info.fragment_frames = frames;
+    stream->info.sample_format = source->sample_format();
+    stream->info.latency = std::chrono::microseconds(uint64_t(frames) * 1000000 / format.sample_rate);
+
+    open_epoll();
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = stream.get();
+    int fd = source->poll_fd();
+    if (fd >= 0) {
+      source->set_nonblocking();
+    }
+    else if (options.pacing == Pacing::realtime) {
+      stream->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+      if (stream->timer < 0)
+        throw std::runtime_error("could not create a timerfd");
+      fd = stream->timer;
+    }
+    else {
+      stream->unthrottled = true;
+    }
+    if (fd >= 0) {
+      if (epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) != 0)
+        throw std::runtime_error("could not add a stream to epoll");
+      stream->registered = true;
+    }
+
+    stream->source = std::move(source);
+    streams.push_back(std::move(stream));
+    return streams.size() - 1;
+  }
+
+  void open_epoll()
+  {
+    if (epoll >= 0)
+      return;
+    epoll = epoll_create1(EPOLL_CLOEXEC);
+    wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll < 0 || wakeup < 0)
+      throw std::runtime_error("could not create the engine's epoll descriptors");
+    // The stop event is the only one without a stream
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, wakeup, &event);
+  }
+
+  RealtimeGrant start(const RealtimeOptions &realtime)
+  {
+    State expected = State::idle;
+    if (!state.compare_exchange_strong(expected, State::running))
+      return RealtimeGrant();
+
+    for (auto &stream : streams) {
+      if (stream->timer < 0)
+        continue;
+      const uint64_t period = uint64_t(stream->block_frames) * 1000000000 / stream->info.format.sample_rate;
+      itimerspec spec{};
+      spec.it_interval.tv_sec = static_cast<time_t>(period / 1000000000);
+      spec.it_interval.tv_nsec = static_cast<long>(period % 1000000000);
+      spec.it_value = spec.it_interval;
+      timerfd_settime(stream->timer, 0, &spec, nullptr);
+    }
+    if (epoll < 0)
+      return RealtimeGrant();
+    // The thread promotes itself before it reads anything, start() returns once it knows what it got
+    std::promise<RealtimeGrant> promoted;
+    std::future<RealtimeGrant> grant = promoted.get_future();
+    thread = std::thread([this, realtime, &promoted] {
+      promoted.set_value(promote_current_thread(realtime));
+      run();
+    });
+    return grant.get();
+  }
+
+  void stop()
+  {
+    State expected = State::running;
+    if (!state.compare_exchange_strong(expected, State::stopped)) {
+      state = State::stopped;
+      return;
+    }
+    // A producer waiting for room under LagPolicy::block would never see the stop otherwise
+    for (auto &stream : streams)
+      stream->ring->close();
+    if (thread.joinable()) {
+      const uint64_t one = 1;
+      ssize_t written = write(wakeup, &one, sizeof(one));
+      (void) written;
+      thread.join();
+    }
+  }
+
+  void run()
+  {
+    std::vector<Stream *> unthrottled;
+    size_t active = 0;
+    for (auto &stream : streams) {
+      if (stream->unthrottled)
+        unthrottled.push_back(stream.get());
+      if (stream->source)
+        active++;
+    }
+
+    epoll_event events[MAX_EVENTS];
+    while (active > 0) {
+      // Unthrottled sources are serviced between waits, so the loop only polls while there are any
+      const int ready = epoll_wait(epoll, events, MAX_EVENTS, unthrottled.empty() ? -1 : 0);
+      wakeups.fetch_add(1, std::memory_order_relaxed);
+      if (ready < 0 && errno != EINTR)
+        break;
+
+      bool stopping = false;
+      for (int i = 0; i < ready; i++) {
+        Stream *stream = static_cast<Stream *>(events[i].data.ptr);
+        if (stream == nullptr) {
+          stopping = true;
+          continue;
+        }
+        uint64_t blocks = MAX_BLOCKS_PER_WAKEUP;
+        if (stream->timer >= 0) {
+          uint64_t expirations = 0;
+          if (read(stream->timer, &expirations, sizeof(expirations)) != sizeof(expirations))
+            continue;
+          blocks = expirations;
+        }
+        service(*stream, blocks);
+        if (stream->source->finished())
+          active -= retire(*stream);
+      }
+      if (stopping)
+        break;
+
+      // As fast as the consumer takes them, so a block is only made once it fits
+      for (auto it = unthrottled.begin(); it != unthrottled.end();) {
+        Stream &stream = **it;
+        if (stream.ring->writable() >= size_t(stream.block_frames) * stream.info.format.channels)
+          service(stream, 1);
+        if (stream.source->finished()) {
+          active -= retire(stream);
+          it = unthrottled.erase(it);
+        }
+        else {
+          ++it;
+        }
+      }
+    }
+    cpu_time = thread_cpu_time(pthread_self());
+  }
+
+  void service(Stream &stream, uint64_t blocks)
+  {
+    BufferView view;
+    for (uint64_t i = 0; i < blocks && stream.source->next(view, stream.block_frames); i++) {
+      if (const uint64_t lost = stream.source->lost_frames())
+        stream.clock.skip(lost);
+      stream.clock.stamp_queued(view, stream.source->queued_frames());
+      deliver(stream, view);
+    }
+  }
+
+  // Returns 1 the first time a finished source is taken out of the loop
+  size_t retire(Stream &stream)
+  {
+    if (!stream.registered && !stream.unthrottled)
+      return 0;
+    const int fd = stream.timer >= 0 ? stream.timer : stream.source->poll_fd();
+    if (stream.registered)
+      epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+    stream.registered = false;
+    stream.unthrottled = false;
+    return 1;
+  }
+
+  // Producer side of a stream's ring, whatever thread it runs on. The ring's lag policy decides what
+  // happens once it is full, a block it cuts short is flagged here and the ring flags the next one.
+  void deliver(Stream &stream, const BufferView &view)
+  {
+    const uint32_t channels = view.format.channels;
+    const size_t samples = size_t(view.frames) * channels;
+    BlockStamp stamp = view.stamp();
+    if (stream.ring->room(samples) < samples)
+      stamp.flags |= BUFFER_GAP;
+    const size_t written = stream.ring->write(view.data, samples, stamp) / channels;
+    if (stamp.flags & BUFFER_DISCONTINUITY)
+      discontinuities.fetch_add(1, std::memory_order_relaxed);
+
+    blocks.fetch_add(1, std::memory_order_relaxed);
+    frames.fetch_add(written, std::memory_order_relaxed);
+    if (written < view.frames)
+      dropped_frames.fetch_add(view.frames - written, std::memory_order_relaxed);
+  }
+
+  EngineStats stats()
+  {
+    EngineStats result;
+    result.wakeups = wakeups.load(std::memory_order_relaxed);
+    result.blocks = blocks.load(std::memory_order_relaxed);
+    result.frames = frames.load(std::memory_order_relaxed);
+    result.dropped_frames = dropped_frames.load(std::memory_order_relaxed);
+    result.discontinuities = discontinuities.load(std::memory_order_relaxed);
+    result.errors = 0;
+    for (auto &stream : streams) {
+      if (stream->source)
+        result.errors += stream->source->errors();
+    }
+    result.cpu_time = thread.joinable() ? thread_cpu_time(thread.native_handle()) : cpu_time;
+    return result;
+  }
+
+  std::atomic<State> state{State::idle};
+  std::map<std::string, std::unique_ptr<detail::CaptureBackend>> backends;
+  std::vector<std::unique_ptr<Stream>> streams;
+  int epoll = -1;
+  int wakeup = -1;
+  std::thread thread;
+
+  std::atomic<uint64_t> wakeups{0};
+  std::atomic<uint64_t> blocks{0};
+  std::atomic<uint64_t> frames{0};
+  std::atomic<uint64_t> dropped_frames{0};
+  std::atomic<uint64_t> discontinuities{0};
+  std::chrono::microseconds cpu_time{0};
+};
+
+CaptureEngine::CaptureEngine()
+    : m_impl(new Impl())
+{
+}
+
+CaptureEngine::~CaptureEngine() = default;
+
+size_t CaptureEngine::add_stream(const AudioSinkInfo &sink, const CaptureOptions &options, const std::string &backend)
+{
+  return m_impl->add_stream(sink, options, backend);
+}
+
+CaptureRing &CaptureEngine::ring(size_t stream)
+{
+  return *m_impl->streams.at(stream)->ring;
+}
+
+StreamInfo CaptureEngine::info(size_t stream) const
+{
+  return m_impl->streams.at(stream)->info;
+}
+
+RealtimeGrant CaptureEngine::start(const RealtimeOptions &realtime)
+{
+  return m_impl->start(realtime);
+}
+
+void CaptureEngine::stop()
+{
+  m_impl->stop();
+}
+
+EngineStats CaptureEngine::stats() const
+{
+  return m_impl->stats();
+}
+}
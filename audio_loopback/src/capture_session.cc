@@ -0,0 +1,374 @@
+#include "capture_stream.h"
+#include "realtime.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace
+{
+// A new device that hasn't delivered by then takes over anyway, so a silent device can't stall the switch
+const std::chrono::seconds SWITCH_TIMEOUT{2};
+// How often adaptive sessions measure the consumer and resize their blocks
+const std::chrono::milliseconds RETUNE_INTERVAL{250};
+
+std::mutex detached_mutex;
+std::vector<audio::CaptureSession> detached_sessions;
+}
+
+namespace audio
+{
+// Every stream of the session calls deliver() with the generation it was opened as. Only the active
+// generation reaches the callback, a newer one takes over with its first block once it is opened.
+struct CaptureSession::State
+{
+  State(BufferCallback callback, const CaptureOptions &options)
+      : callback(callback), options(options)
+  {
+  }
+
+  ~State()
+  {
+    stop_tuner();
+    running = false;
+    stream.reset();
+  }
+
+  void start_tuner()
+  {
+    tuner = std::thread([this] { tune(); });
+  }
+
+  // Must be called without control_mutex held, the tuner may be waiting for it
+  void stop_tuner()
+  {
+    {
+      std::lock_guard<std::mutex> lock(tuner_mutex);
+      tuner_stopping = true;
+    }
+    tuner_wake.notify_all();
+    if (tuner.joinable())
+      tuner.join();
+  }
+
+  void tune()
+  {
+    auto measured_at = std::chrono::steady_clock::now();
+    uint64_t measured_consumes = consumes.load(std::memory_order_relaxed);
+    double consumer_hz = 0;
+
+    std::unique_lock<std::mutex> lock(tuner_mutex);
+    while (!tuner_wake.wait_for(lock, RETUNE_INTERVAL, [this] { return tuner_stopping; })) {
+      const auto now = std::chrono::steady_clock::now();
+      const uint64_t count = consumes.load(std::memory_order_relaxed);
+      const double hz = (count - measured_consumes) / std::chrono::duration<double>(now - measured_at).count();
+      measured_at = now;
+      measured_consumes = count;
+      // Smoothed so a single slow frame doesn't resize the blocks, a whole idle interval does
+      consumer_hz = consumer_hz == 0 || hz == 0 ? hz : (consumer_hz + hz) / 2;
+      lock.unlock();
+      retune(consumer_hz);
+      lock.lock();
+    }
+  }
+
+  void retune(double consumer_hz)
+  {
+    std::lock_guard<std::mutex> control(control_mutex);
+    if (!stream || !running)
+      return;
+
+    const AdaptiveBlockOptions &adaptive = options.adaptive;
+    const double budget = std::chrono::duration<double>(adaptive.latency_budget).count();
+    const double shortest = std::chrono::duration<double>(adaptive.min_block).count();
+    double seconds = budget;
+    if (consumer_hz > 0)
+      seconds = 1.0 / (consumer_hz * std::max<uint32_t>(adaptive.blocks_per_consume, 1));
+    seconds = std::max(std::min(seconds, budget), shortest);
+
+    const uint32_t rate = info.format.sample_rate;
+    const uint32_t frames = std::max<uint32_t>(1, static_cast<uint32_t>(seconds * rate));
+    const uint32_t current = info.fragment_frames;
+    // Within a quarter of the current size isn't worth a resize, a consumer near a boundary would flap
+    if (current != 0 && frames * 4 < current * 5 && frames * 5 > current * 4)
+      return;
+    if (!stream->set_block_frames(frames))
+      return;
+    const StreamInfo resized = stream->info();
+    info.fragment_frames = resized.fragment_frames;
+    info.latency = resized.latency;
+  }
+
+  // Throws if the device can't be opened, nothing of the session changes then
+  std::unique_ptr<detail::CaptureStream> open(uint32_t generation, const AudioSinkInfo &sink, StreamInfo &opened_info)
+  {
+    std::shared_future<RealtimeGrant> grant;
+    auto delivered = detail::realtime_callback([this, generation](const BufferView &view) {
+                                                 return deliver(generation, view);
+                                               },
+                                               options.realtime, grant);
+    auto opened_stream = detail::open_stream(delivered, sink, options);
+    opened_info = opened_stream->info();
+    opened_info.realtime = grant;
+    return opened_stream;
+  }
+
+  bool deliver(uint32_t generation, const BufferView &view)
+  {
+    std::lock_guard<std::mutex> lock(deliver_mutex);
+    if (!running || generation < active)
+      return false;
+    // Still being opened, it may fail yet
+    if (generation > opened)
+      return true;
+    if (generation > active)
+      activate(generation);
+    delivered_blocks.fetch_add(1, std::memory_order_relaxed);
+    last_frames.store(view.frames, std::memory_order_relaxed);
+
+    const auto now = std::chrono::steady_clock::now();
+    if (awaiting_first) {
+      awaiting_first = false;
+      if (last_block != std::chrono::steady_clock::time_point())
+        switch_gap = std::chrono::duration_cast<std::chrono::microseconds>(now - last_block);
+    }
+    last_block = now;
+
+    if (paused) {
+      gap = true;
+      return true;
+    }
+    BufferView flagged = view;
+    if (gap)
+      flagged.flags |= BUFFER_GAP;
+    gap = false;
+    if (!callback(flagged))
+      running = false;
+    return running;
+  }
+
+  // Must be called with deliver_mutex held
+  void activate(uint32_t generation)
+  {
+    active = generation;
+    gap = true;
+    awaiting_first = true;
+    switched.notify_all();
+  }
+
+  BufferCallback callback;
+  CaptureOptions options;
+  std::atomic<bool> running{true};
+  std::atomic<bool> paused{false};
+
+  // Guards everything deliver() touches besides the atomics
+  std::mutex deliver_mutex;
+  std::condition_variable switched;
+  uint32_t active = 0;
+  uint32_t opened = 0;
+  bool gap = false;
+  bool awaiting_first = false;
+  std::chrono::steady_clock::time_point last_block;
+  std::chrono::microseconds switch_gap{0};
+
+  std::atomic<uint64_t> delivered_blocks{0};
+  std::atomic<uint32_t> last_frames{0};
+  std::atomic<uint64_t> consumes{0};
+  // Counts at the last metrics(), the rates are taken over the time since
+  mutable std::mutex metrics_mutex;
+  mutable std::chrono::steady_clock::time_point metrics_at = std::chrono::steady_clock::now();
+  mutable uint64_t metrics_blocks = 0;
+  mutable uint64_t metrics_consumes = 0;
+  mutable uint64_t metrics_errors = 0;
+  mutable std::chrono::microseconds metrics_process_p99{0};
+  mutable std::chrono::microseconds metrics_process_max{0};
+
+  std::mutex tuner_mutex;
+  std::condition_variable tuner_wake;
+  bool tuner_stopping = false;
+  std::thread tuner;
+
+  // Serializes pause, stop and switches. The stream is destroyed without deliver_mutex held,
+  // its callbacks may be waiting for it.
+  mutable std::mutex control_mutex;
+  bool native_pause = false;
+  // Errors of the streams switched away from
+  uint64_t retired_errors = 0;
+  StreamInfo info;
+  std::unique_ptr<detail::CaptureStream> stream;
+};
+
+CaptureSession::CaptureSession(std::shared_ptr<State> state)
+    : m_state(std::move(state))
+{
+}
+
+StreamInfo CaptureSession::info() const
+{
+  if (!m_state)
+    return StreamInfo{};
+  std::lock_guard<std::mutex> control(m_state->control_mutex);
+  return m_state->info;
+}
+
+bool CaptureSession::running() const
+{
+  return m_state && m_state->running;
+}
+
+void CaptureSession::pause()
+{
+  if (!m_state)
+    return;
+  std::lock_guard<std::mutex> control(m_state->control_mutex);
+  if (m_state->paused || !m_state->stream)
+    return;
+  m_state->paused = true;
+  m_state->native_pause = m_state->stream->set_paused(true);
+}
+
+void CaptureSession::resume()
+{
+  if (!m_state)
+    return;
+  std::lock_guard<std::mutex> control(m_state->control_mutex);
+  if (!m_state->paused || !m_state->stream)
+    return;
+  if (m_state->native_pause)
+    m_state->stream->set_paused(false);
+  m_state->paused = false;
+}
+
+bool CaptureSession::paused() const
+{
+  return m_state && m_state->paused;
+}
+
+void CaptureSession::stop()
+{
+  if (!m_state)
+    return;
+  m_state->stop_tuner();
+  std::lock_guard<std::mutex> control(m_state->control_mutex);
+  m_state->running = false;
+  m_state->stream.reset();
+}
+
+StreamInfo CaptureSession::switch_device(const AudioSinkInfo &sink)
+{
+  if (!m_state)
+    throw std::logic_error("switch_device on an empty session");
+  State &state = *m_state;
+  std::lock_guard<std::mutex> control(state.control_mutex);
+  if (!state.running || !state.stream)
+    throw std::logic_error("switch_device on a stopped session");
+
+  StreamInfo info;
+  uint32_t generation;
+  {
+    std::lock_guard<std::mutex> lock(state.deliver_mutex);
+    generation = state.opened + 1;
+  }
+  auto next = state.open(generation, sink, info);
+  if (state.paused)
+    state.native_pause = next->set_paused(true);
+
+  {
+    std::unique_lock<std::mutex> lock(state.deliver_mutex);
+    state.opened = generation;
+    // A paused stream may deliver nothing, it takes over right away
+    if (state.paused || !state.switched.wait_for(lock, SWITCH_TIMEOUT, [&state, generation] {
+          return state.active >= generation || !state.running;
+        })) {
+      if (state.active < generation)
+        state.activate(generation);
+    }
+  }
+
+  // Blocks of the old stream are turned away from here on
+  std::swap(state.stream, next);
+  state.info = info;
+  state.retired_errors += next->errors();
+  next.reset();
+  return info;
+}
+
+std::chrono::microseconds CaptureSession::last_switch_gap() const
+{
+  if (!m_state)
+    return std::chrono::microseconds(0);
+  std::lock_guard<std::mutex> lock(m_state->deliver_mutex);
+  return m_state->switch_gap;
+}
+
+void CaptureSession::consumed()
+{
+  if (m_state)
+    m_state->consumes.fetch_add(1, std::memory_order_relaxed);
+}
+
+CaptureMetrics CaptureSession::metrics() const
+{
+  CaptureMetrics metrics{0, 0, 0, 0, std::chrono::microseconds(0), std::chrono::microseconds(0)};
+  if (!m_state)
+    return metrics;
+  const State &state = *m_state;
+  std::lock_guard<std::mutex> lock(state.metrics_mutex);
+  const auto now = std::chrono::steady_clock::now();
+  const double elapsed = std::chrono::duration<double>(now - state.metrics_at).count();
+  const uint64_t blocks = state.delivered_blocks.load(std::memory_order_relaxed);
+  const uint64_t consumes = state.consumes.load(std::memory_order_relaxed);
+  metrics.block_frames = state.last_frames.load(std::memory_order_relaxed);
+  if (elapsed > 0) {
+    metrics.wakeups_per_second = (blocks - state.metrics_blocks) / elapsed;
+    metrics.consumer_hz = (consumes - state.metrics_consumes) / elapsed;
+  }
+  state.metrics_at = now;
+  state.metrics_blocks = blocks;
+  state.metrics_consumes = consumes;
+
+  // A switch holds control_mutex until the new device delivers, the values from last time stand in meanwhile
+  std::unique_lock<std::mutex> control(state.control_mutex, std::try_to_lock);
+  if (control && state.stream) {
+    state.metrics_errors = state.retired_errors + state.stream->errors();
+    if (!state.stream->process_times(state.metrics_process_p99, state.metrics_process_max))
+      state.metrics_process_p99 = state.metrics_process_max = std::chrono::microseconds(0);
+  }
+  metrics.errors = state.metrics_errors;
+  metrics.process_p99 = state.metrics_process_p99;
+  metrics.process_max = state.metrics_process_max;
+  return metrics;
+}
+
+void CaptureSession::detach()
+{
+  if (!m_state)
+    return;
+  std::lock_guard<std::mutex> lock(detached_mutex);
+  detached_sessions.push_back(std::move(*this));
+}
+
+CaptureSession capture_data(BufferCallback callback, const AudioSinkInfo &sink, const CaptureOptions &options)
+{
+  auto state = std::make_shared<CaptureSession::State>(callback, options);
+  std::lock_guard<std::mutex> control(state->control_mutex);
+  state->stream = state->open(0, sink, state->info);
+  if (options.adaptive.enabled)
+    state->start_tuner();
+  return CaptureSession(state);
+}
+
+namespace detail
+{
+void stop_detached_sessions()
+{
+  std::vector<CaptureSession> stopping;
+  {
+    std::lock_guard<std::mutex> lock(detached_mutex);
+    stopping.swap(detached_sessions);
+  }
+}
+}
+}
@@ -0,0 +1,57 @@
+#ifndef VISUALIZER_CAPTURE_STREAM_H
+#define VISUALIZER_CAPTURE_STREAM_H
+#include <audio_loopback/loopback_recorder.h>
+#include <chrono>
+#include <memory>
+
+namespace audio
+{
+namespace detail
+{
+// One running capture. Destroying it stops the capture and only returns once the callback
+// won't be called any more.
+class CaptureStream
+{
+public:
+  virtual ~CaptureStream() = default;
+
+  virtual StreamInfo info() const = 0;
+  // Stops or restarts the flow of blocks at the sound system, the first block after a restart is flagged
+  // BUFFER_GAP. False if the stream can't, the session then drops the blocks itself while paused.
+  virtual bool set_paused(bool paused)
+  {
+    (void) paused;
+    return false;
+  }
+  // Reads or recoveries that failed at the sound system so far, each left a gap flagged BUFFER_GAP.
+  // Safe to call from any thread.
+  virtual uint64_t errors() const
+  {
+    return 0;
+  }
+  // How long the sound server's realtime callback took so far, 99th percentile and worst.
+  // False if the backend doesn't measure it. Safe to call from any thread.
+  virtual bool process_times(std::chrono::microseconds &p99, std::chrono::microseconds &max) const
+  {
+    (void) p99;
+    (void) max;
+    return false;
+  }
+  // Changes the block size the sound system delivers, which it may round. False if it can't.
+  virtual bool set_block_frames(uint32_t frames)
+  {
+    (void) frames;
+    return false;
+  }
+};
+
+// Opens a capture on the platform's selected backend, throws if the device can't be opened
+std::unique_ptr<CaptureStream> open_stream(BufferCallback callback, const AudioSinkInfo &sink,
+                                           const CaptureOptions &options);
+
+// Stops every capture started without keeping its session, for when the backend is switched
+void stop_detached_sessions();
+}
+}
+
+#endif //VISUALIZER_CAPTURE_STREAM_H
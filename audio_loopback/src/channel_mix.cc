@@ -0,0 +1,268 @@
+#include <audio_loopback/channel_mix.h>
+#include "simd.h"
+#include <stdexcept>
+
+namespace
+{
+const float MINUS_3DB = 0.70710678F;
+
+enum Side
+{
+  LEFT,
+  RIGHT,
+  BOTH,
+  NONE,
+};
+
+// Where each channel of the WAVE layouts for a given count folds down to
+std::vector<Side> stereo_sides(uint32_t channels)
+{
+  switch (channels) {
+    case 1:
+      return {BOTH};
+    case 3:
+      return {LEFT, RIGHT, BOTH};
+    case 6:
+      return {LEFT, RIGHT, BOTH, NONE, LEFT, RIGHT};
+    case 8:
+      return {LEFT, RIGHT, BOTH, NONE, LEFT, RIGHT, LEFT, RIGHT};
+    case 5:
+      return {LEFT, RIGHT, BOTH, LEFT, RIGHT};
+    default:
+      break;
+  }
+  // Stereo, quad and anything unusual alternate between the sides
+  std::vector<Side> sides(channels);
+  for (uint32_t channel = 0; channel < channels; channel++)
+    sides[channel] = channel % 2 == 0 ? LEFT : RIGHT;
+  return sides;
+}
+
+struct MixJob
+{
+  const float *in;
+  uint32_t channels;
+  float *const *planes;
+  const float *weights;
+  uint32_t outputs;
+  float *const *mixed;
+};
+
+void mix_scalar(const MixJob &job, size_t begin, size_t frames)
+{
+  for (size_t frame = begin; frame < frames; frame++) {
+    const float *samples = job.in + frame * job.channels;
+    float acc[audio::MAX_MIX_OUTPUTS] = {};
+    for (uint32_t channel = 0; channel < job.channels; channel++) {
+      const float sample = samples[channel];
+      if (job.planes != nullptr)
+        job.planes[channel][frame] = sample;
+      for (uint32_t output = 0; output < job.outputs; output++)
+        acc[output] += job.weights[output * job.channels + channel] * sample;
+    }
+    if (job.mixed != nullptr) {
+      for (uint32_t output = 0; output < job.outputs; output++)
+        job.mixed[output][frame] = acc[output];
+    }
+  }
+}
+
+#ifdef AUDIO_SIMD_AVX2
+// Stores one channel's plane and adds it to every output
+AUDIO_SIMD_AVX2 inline void take_channel_avx2(const MixJob &job, size_t frame, uint32_t channel, __m256 samples,
+                                              __m256 *acc)
+{
+  if (job.planes != nullptr)
+    _mm256_storeu_ps(job.planes[channel] + frame, samples);
+  for (uint32_t output = 0; output < job.outputs; output++) {
+    const __m256 weight = _mm256_broadcast_ss(job.weights + output * job.channels + channel);
+    acc[output] = _mm256_add_ps(acc[output], _mm256_mul_ps(samples, weight));
+  }
+}
+
+AUDIO_SIMD_AVX2 inline void store_mixed_avx2(const MixJob &job, size_t frame, const __m256 *acc)
+{
+  if (job.mixed == nullptr)
+    return;
+  for (uint32_t output = 0; output < job.outputs; output++)
+    _mm256_storeu_ps(job.mixed[output] + frame, acc[output]);
+}
+
+// Eight frames of eight channels are an 8x8 transpose, no gathers needed
+AUDIO_SIMD_AVX2 size_t mix_8ch_avx2(const MixJob &job, size_t frames)
+{
+  size_t frame = 0;
+  for (; frame + 8 <= frames; frame += 8) {
+    const float *in = job.in + frame * 8;
+    const __m256 t0 = _mm256_unpacklo_ps(_mm256_loadu_ps(in), _mm256_loadu_ps(in + 8));
+    const __m256 t1 = _mm256_unpackhi_ps(_mm256_loadu_ps(in), _mm256_loadu_ps(in + 8));
+    const __m256 t2 = _mm256_unpacklo_ps(_mm256_loadu_ps(in + 16), _mm256_loadu_ps(in + 24));
+    const __m256 t3 = _mm256_unpackhi_ps(_mm256_loadu_ps(in + 16), _mm256_loadu_ps(in + 24));
+    const __m256 t4 = _mm256_unpacklo_ps(_mm256_loadu_ps(in + 32), _mm256_loadu_ps(in + 40));
+    const __m256 t5 = _mm256_unpackhi_ps(_mm256_loadu_ps(in + 32), _mm256_loadu_ps(in + 40));
+    const __m256 t6 = _mm256_unpacklo_ps(_mm256_loadu_ps(in + 48), _mm256_loadu_ps(in + 56));
+    const __m256 t7 = _mm256_unpackhi_ps(_mm256_loadu_ps(in + 48), _mm256_loadu_ps(in + 56));
+    const __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+    __m256 acc[audio::MAX_MIX_OUTPUTS];
+    for (uint32_t output = 0; output < job.outputs; output++)
+      acc[output] = _mm256_setzero_ps();
+    take_channel_avx2(job, frame, 0, _mm256_permute2f128_ps(s0, s4, 0x20), acc);
+    take_channel_avx2(job, frame, 1, _mm256_permute2f128_ps(s1, s5, 0x20), acc);
+    take_channel_avx2(job, frame, 2, _mm256_permute2f128_ps(s2, s6, 0x20), acc);
+    take_channel_avx2(job, frame, 3, _mm256_permute2f128_ps(s3, s7, 0x20), acc);
+    take_channel_avx2(job, frame, 4, _mm256_permute2f128_ps(s0, s4, 0x31), acc);
+    take_channel_avx2(job, frame, 5, _mm256_permute2f128_ps(s1, s5, 0x31), acc);
+    take_channel_avx2(job, frame, 6, _mm256_permute2f128_ps(s2, s6, 0x31), acc);
+    take_channel_avx2(job, frame, 7, _mm256_permute2f128_ps(s3, s7, 0x31), acc);
+    store_mixed_avx2(job, frame, acc);
+  }
+  return frame;
+}
+
+// Any other channel count gathers each channel's eight samples with a stride of one frame
+AUDIO_SIMD_AVX2 size_t mix_gather_avx2(const MixJob &job, size_t frames)
+{
+  const __m256i stride = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                            _mm256_set1_epi32(static_cast<int>(job.channels)));
+  size_t frame = 0;
+  for (; frame + 8 <= frames; frame += 8) {
+    const float *in = job.in + frame * job.channels;
+    __m256 acc[audio::MAX_MIX_OUTPUTS];
+    for (uint32_t output = 0; output < job.outputs; output++)
+      acc[output] = _mm256_setzero_ps();
+    for (uint32_t channel = 0; channel < job.channels; channel++)
+      take_channel_avx2(job, frame, channel, _mm256_i32gather_ps(in + channel, stride, 4), acc);
+    store_mixed_avx2(job, frame, acc);
+  }
+  return frame;
+}
+#endif
+
+#ifdef AUDIO_SIMD_SSE2
+inline void take_channel_sse2(const MixJob &job, size_t frame, uint32_t channel, __m128 samples, __m128 *acc)
+{
+  if (job.planes != nullptr)
+    _mm_storeu_ps(job.planes[channel] + frame, samples);
+  for (uint32_t output = 0; output < job.outputs; output++) {
+    const __m128 weight = _mm_set1_ps(job.weights[output * job.channels + channel]);
+    acc[output] = _mm_add_ps(acc[output], _mm_mul_ps(samples, weight));
+  }
+}
+
+inline void store_mixed_sse2(const MixJob &job, size_t frame, const __m128 *acc)
+{
+  if (job.mixed == nullptr)
+    return;
+  for (uint32_t output = 0; output < job.outputs; output++)
+    _mm_storeu_ps(job.mixed[output] + frame, acc[output]);
+}
+
+// Stereo and quad deinterleave with shuffles, four frames at a time
+size_t mix_sse2(const MixJob &job, size_t frames)
+{
+  if (job.channels != 2 && job.channels != 4)
+    return 0;
+
+  size_t frame = 0;
+  for (; frame + 4 <= frames; frame += 4) {
+    const float *in = job.in + frame * job.channels;
+    __m128 acc[audio::MAX_MIX_OUTPUTS];
+    for (uint32_t output = 0; output < job.outputs; output++)
+      acc[output] = _mm_setzero_ps();
+    if (job.channels == 2) {
+      const __m128 first = _mm_loadu_ps(in);
+      const __m128 second = _mm_loadu_ps(in + 4);
+      take_channel_sse2(job, frame, 0, _mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0)), acc);
+      take_channel_sse2(job, frame, 1, _mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1)), acc);
+    }
+    else {
+      __m128 row0 = _mm_loadu_ps(in);
+      __m128 row1 = _mm_loadu_ps(in + 4);
+      __m128 row2 = _mm_loadu_ps(in + 8);
+      __m128 row3 = _mm_loadu_ps(in + 12);
+      _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+      take_channel_sse2(job, frame, 0, row0, acc);
+      take_channel_sse2(job, frame, 1, row1, acc);
+      take_channel_sse2(job, frame, 2, row2, acc);
+      take_channel_sse2(job, frame, 3, row3, acc);
+    }
+    store_mixed_sse2(job, frame, acc);
+  }
+  return frame;
+}
+#endif
+}
+
+namespace audio
+{
+DownmixMatrix::DownmixMatrix(uint32_t inputs, uint32_t outputs)
+    : m_inputs(inputs), m_outputs(outputs), m_weights(size_t(inputs) * outputs, 0.0F)
+{
+  if (outputs > MAX_MIX_OUTPUTS)
+    throw std::invalid_argument("a downmix matrix has at most MAX_MIX_OUTPUTS outputs");
+}
+
+DownmixMatrix DownmixMatrix::stereo(uint32_t inputs)
+{
+  DownmixMatrix matrix(inputs, 2);
+  const std::vector<Side> sides = stereo_sides(inputs);
+  for (uint32_t input = 0; input < inputs; input++) {
+    // The front pair and a lone mono channel go in at full level, centre and surrounds at -3 dB
+    const float weight = inputs == 1 || input < 2 ? 1.0F : MINUS_3DB;
+    if (sides[input] == LEFT || sides[input] == BOTH)
+      matrix(0, input) = weight;
+    if (sides[input] == RIGHT || sides[input] == BOTH)
+      matrix(1, input) = weight;
+  }
+
+  for (uint32_t output = 0; output < 2; output++) {
+    float gain = 0.0F;
+    for (uint32_t input = 0; input < inputs; input++)
+      gain += matrix(output, input);
+    for (uint32_t input = 0; gain > 0.0F && input < inputs; input++)
+      matrix(output, input) /= gain;
+  }
+  return matrix;
+}
+
+DownmixMatrix DownmixMatrix::mono(uint32_t inputs)
+{
+  const DownmixMatrix folded = stereo(inputs);
+  DownmixMatrix matrix(inputs, 1);
+  for (uint32_t input = 0; input < inputs; input++)
+    matrix(0, input) = 0.5F * (folded(0, input) + folded(1, input));
+  return matrix;
+}
+
+void deinterleave_downmix(const BufferView &view, float *const *planes, const DownmixMatrix &matrix, float *const *mixed)
+{
+  if (matrix.inputs() != view.format.channels)
+    throw std::invalid_argument("the downmix matrix doesn't match the channel count of the block");
+
+  const MixJob job{view.data, view.format.channels, planes, matrix.weights(), mixed != nullptr ? matrix.outputs() : 0,
+                   mixed};
+  size_t done = 0;
+#ifdef AUDIO_SIMD_AVX2
+  if (detail::has_avx2())
+    done = job.channels == 8 ? mix_8ch_avx2(job, view.frames) : mix_gather_avx2(job, view.frames);
+#endif
+#ifdef AUDIO_SIMD_SSE2
+  if (done == 0)
+    done = mix_sse2(job, view.frames);
+#endif
+  mix_scalar(job, done, view.frames);
+}
+
+void deinterleave(const BufferView &view, float *const *planes)
+{
+  deinterleave_downmix(view, planes, DownmixMatrix(view.format.channels, 0), nullptr);
+}
+}
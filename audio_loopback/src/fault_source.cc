@@ -0,0 +1,297 @@
+#include "block_source.h"
+#include <audio_loopback/fault_injection.h>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace
+{
+// What goes wrong and how often, probabilities are per block
+struct FaultProfile
+{
+  uint32_t seed = 1;
+  // Every block is late by up to this much
+  double jitter_ms = 0.0;
+  // Blocks held back and then delivered back to back
+  double burst = 0.0;
+  uint32_t burst_blocks = 4;
+  // Blocks cut short at a random length, the rest comes with the next one
+  double short_read = 0.0;
+  // Blocks lost on the way, later positions still count them
+  double drop = 0.0;
+  // The delivering thread stalls, as if the previous callback took that long
+  double stall = 0.0;
+  double stall_ms = 50.0;
+};
+
+// Totals of every fault source, for audio::injected_faults()
+struct Counters
+{
+  std::atomic<uint64_t> late{0};
+  std::atomic<uint64_t> bursts{0};
+  std::atomic<uint64_t> short_reads{0};
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<uint64_t> dropped_frames{0};
+  std::atomic<uint64_t> stalls{0};
+  std::atomic<uint64_t> held_up_us{0};
+};
+
+Counters injected;
+
+void count(std::atomic<uint64_t> &counter, uint64_t amount = 1)
+{
+  counter.fetch_add(amount, std::memory_order_relaxed);
+}
+
+FaultProfile named_profile(const std::string &name)
+{
+  FaultProfile profile;
+  if (name == "jitter" || name == "all")
+    profile.jitter_ms = 3.0;
+  if (name == "bursty" || name == "all")
+    profile.burst = 0.02;
+  if (name == "short" || name == "all")
+    profile.short_read = 0.2;
+  if (name == "lossy" || name == "all")
+    profile.drop = 0.01;
+  if (name == "stalls" || name == "all")
+    profile.stall = 0.005;
+  if (name != "none" && name != "jitter" && name != "bursty" && name != "short" && name != "lossy" &&
+      name != "stalls" && name != "all")
+    throw std::invalid_argument("unknown fault profile " + name);
+  return profile;
+}
+
+// The whole of text must be a number that isn't negative
+double parse_value(const std::string &key, const std::string &text)
+{
+  size_t end = 0;
+  double value = 0.0;
+  try {
+    value = std::stod(text, &end);
+  }
+  catch (const std::logic_error &) {
+    end = 0;
+  }
+  if (end == 0 || end != text.size() || value < 0.0)
+    throw std::invalid_argument("fault " + key + " needs a number of at least 0, not '" + text + "'");
+  return value;
+}
+
+// A profile name followed by overrides: all,seed=7,drop=0.05
+FaultProfile parse_profile(const std::string &text)
+{
+  std::stringstream stream(text);
+  std::string item;
+  std::getline(stream, item, ',');
+  FaultProfile profile = named_profile(item.empty() ? "none" : item);
+  while (std::getline(stream, item, ',')) {
+    const size_t equals = item.find('=');
+    if (equals == std::string::npos)
+      throw std::invalid_argument("fault overrides are key=value, not " + item);
+    const std::string key = item.substr(0, equals);
+    const double value = parse_value(key, item.substr(equals + 1));
+    if (key == "seed")
+      profile.seed = static_cast<uint32_t>(value);
+    else if (key == "jitter")
+      profile.jitter_ms = value;
+    else if (key == "burst")
+      profile.burst = value;
+    else if (key == "burst_blocks")
+      profile.burst_blocks = static_cast<uint32_t>(value);
+    else if (key == "short")
+      profile.short_read = value;
+    else if (key == "drop")
+      profile.drop = value;
+    else if (key == "stall")
+      profile.stall = value;
+    else if (key == "stall_ms")
+      profile.stall_ms = value;
+    else
+      throw std::invalid_argument("unknown fault " + key);
+  }
+  return profile;
+}
+
+std::chrono::microseconds milliseconds(double ms)
+{
+  return std::chrono::microseconds(static_cast<int64_t>(ms * 1000));
+}
+}
+
+// Wraps the source of another backend and injects faults into its delivery. The faults of every
+// block are drawn in a fixed order from a seeded generator, so a seed always gives the same
+// sequence however the blocks end up timed.
+class FaultSource : public audio::detail::BlockSource
+{
+public:
+  FaultSource(std::unique_ptr<audio::detail::CaptureBackend> backend, std::unique_ptr<audio::detail::BlockSource> inner,
+              const FaultProfile &profile)
+      : m_backend(std::move(backend)), m_inner(std::move(inner)), m_profile(profile), m_random(profile.seed)
+  {
+  }
+
+  audio::StreamFormat format() const override
+  {
+    return m_inner->format();
+  }
+
+  audio::SampleFormat sample_format() const override
+  {
+    return m_inner->sample_format();
+  }
+
+  bool next(audio::BufferView &view, uint32_t max_frames) override
+  {
+    // Always five draws per block, whichever faults are enabled
+    const double jitter = m_uniform(m_random);
+    const bool burst = m_uniform(m_random) < m_profile.burst;
+    const double cut = m_uniform(m_random);
+    const bool short_read = cut < m_profile.short_read;
+    const bool drop = m_uniform(m_random) < m_profile.drop;
+    const bool stall = m_uniform(m_random) < m_profile.stall;
+
+    std::chrono::microseconds delay = milliseconds(jitter * m_profile.jitter_ms);
+    if (delay.count() > 0)
+      count(injected.late);
+    if (burst) {
+      count(injected.bursts);
+      const audio::StreamFormat stream_format = m_inner->format();
+      delay += std::chrono::microseconds(uint64_t(max_frames) * m_profile.burst_blocks * 1000000 /
+                                         stream_format.sample_rate);
+    }
+    if (stall) {
+      count(injected.stalls);
+      delay += milliseconds(m_profile.stall_ms);
+    }
+    if (delay.count() > 0) {
+      count(injected.held_up_us, uint64_t(delay.count()));
+      std::this_thread::sleep_for(delay);
+    }
+
+    if (drop && m_inner->next(view, max_frames)) {
+      count(injected.dropped);
+      count(injected.dropped_frames, view.frames);
+      m_lost += view.frames;
+    }
+    if (short_read && max_frames > 1) {
+      count(injected.short_reads);
+      // cut is below short_read, scaled back to [0, 1) for the length
+      max_frames = 1 + static_cast<uint32_t>(cut / m_profile.short_read * (max_frames - 1));
+    }
+    return m_inner->next(view, max_frames);
+  }
+
+  bool finished() const override
+  {
+    return m_inner->finished();
+  }
+
+  uint64_t queued_frames() const override
+  {
+    return m_inner->queued_frames();
+  }
+
+  uint64_t lost_frames() override
+  {
+    const uint64_t lost = m_lost;
+    m_lost = 0;
+    return lost;
+  }
+
+  uint64_t errors() const override
+  {
+    return m_inner->errors();
+  }
+
+  int poll_fd() const override
+  {
+    return m_inner->poll_fd();
+  }
+
+  void set_nonblocking() override
+  {
+    m_inner->set_nonblocking();
+  }
+
+private:
+  // Kept alive for its source
+  std::unique_ptr<audio::detail::CaptureBackend> m_backend;
+  std::unique_ptr<audio::detail::BlockSource> m_inner;
+  FaultProfile m_profile;
+  std::mt19937 m_random;
+  std::uniform_real_distribution<double> m_uniform{0.0, 1.0};
+  uint64_t m_lost = 0;
+};
+
+// Sinks of this backend are profile|backend|device, for example all,seed=7|generator|sine:440.
+// Profiles are none, jitter, bursty, short, lossy, stalls and all, followed by key=value overrides
+// of seed, jitter, burst, burst_blocks, short, drop, stall and stall_ms. Any backend that has
+// sources can be wrapped, sound servers can't.
+class FaultBackend : public audio::detail::SourceBackend
+{
+public:
+  std::vector<audio::AudioSinkInfo> list_sinks() override
+  {
+    return {audio::AudioSinkInfo{"Jittery sine", "jitter|generator|sine:440", false},
+            audio::AudioSinkInfo{"Bursty sine", "bursty|generator|sine:440", false},
+            audio::AudioSinkInfo{"Sine with short reads", "short|generator|sine:440", false},
+            audio::AudioSinkInfo{"Lossy sine", "lossy|generator|sine:440", false},
+            audio::AudioSinkInfo{"Stalling sine", "stalls|generator|sine:440", false},
+            audio::AudioSinkInfo{"Sine with every fault", "all|generator|sine:440", false}};
+  }
+
+  audio::AudioSinkInfo get_default_sink(bool capture) override
+  {
+    return audio::AudioSinkInfo{"Sine with every fault", "all|generator|sine:440", capture};
+  }
+
+  std::unique_ptr<audio::detail::BlockSource> open_source(const audio::AudioSinkInfo &sink,
+                                                          const audio::CaptureOptions &options) override
+  {
+    const std::string &spec = sink.device_id.empty() ? get_default_sink(false).device_id : sink.device_id;
+    const size_t first = spec.find('|');
+    const size_t second = first == std::string::npos ? first : spec.find('|', first + 1);
+    if (second == std::string::npos)
+      throw std::invalid_argument("the fault backend needs profile|backend|device as device id");
+
+    const std::string name = spec.substr(first + 1, second - first - 1);
+    auto backend = audio::detail::make_backend(name);
+    if (!backend)
+      throw std::invalid_argument("unknown backend " + name);
+    audio::AudioSinkInfo inner_sink = sink;
+    inner_sink.device_id = spec.substr(second + 1);
+    auto inner = backend->open_source(inner_sink, options);
+    if (!inner)
+      throw std::invalid_argument("the " + name + " backend has no sources to inject faults into");
+
+    return std::unique_ptr<audio::detail::BlockSource>(
+        new FaultSource(std::move(backend), std::move(inner), parse_profile(spec.substr(0, first))));
+  }
+};
+
+namespace audio
+{
+namespace detail
+{
+std::unique_ptr<CaptureBackend> make_fault_backend()
+{
+  return std::unique_ptr<CaptureBackend>(new FaultBackend());
+}
+}
+
+InjectedFaults injected_faults()
+{
+  return InjectedFaults{injected.late.load(std::memory_order_relaxed),
+                        injected.bursts.load(std::memory_order_relaxed),
+                        injected.short_reads.load(std::memory_order_relaxed),
+                        injected.dropped.load(std::memory_order_relaxed),
+                        injected.dropped_frames.load(std::memory_order_relaxed),
+                        injected.stalls.load(std::memory_order_relaxed),
+                        std::chrono::microseconds(injected.held_up_us.load(std::memory_order_relaxed))};
+}
+}
@@ -0,0 +1,334 @@
+#include "block_source.h"
+#include <audio_loopback/sample_ring.h>
+#include <jack/jack.h>
+#include <semaphore.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const uint32_t CHANNELS = 2;
+    const uint32_t MAX_CHANNELS = 8;
+    // Larger periods than this are truncated, the buffer is allocated before the client activates.
+    // Blocks of several periods are capped at the same size.
+    const uint32_t MAX_PERIOD_FRAMES = 8192;
+    const size_t RING_SAMPLES = 1 << 17;
+    // Enough stamps for periods down to 16 frames
+    const size_t RING_BLOCKS = RING_SAMPLES / 16;
+    // Process times are bucketed per microsecond, anything slower lands in the last bucket
+    const uint32_t HISTOGRAM_BUCKETS = 4096;
+
+    uint64_t monotonic_ns()
+    {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return uint64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+}
+
+// The process callback only interleaves into the ring and posts a semaphore, it never allocates,
+// locks or calls back into user code. A consumer thread drains the ring and runs the callback,
+// which the session promotes as its realtime options ask, the process thread is JACK's own.
+class JackStream : public audio::detail::CaptureStream
+{
+public:
+    JackStream(audio::BufferCallback callback, const audio::CaptureOptions &options)
+        : m_callback(callback),
+          m_channels(options.format.channels != 0 ? std::min(options.format.channels, MAX_CHANNELS) : CHANNELS),
+          m_ports(m_channels),
+          m_ring(RING_SAMPLES, RING_BLOCKS),
+          m_interleaved(MAX_PERIOD_FRAMES * m_channels),
+          m_block(2 * MAX_PERIOD_FRAMES * m_channels)
+    {
+        sem_init(&m_ready, 0, 0);
+        for (auto &bucket : m_process_histogram)
+            bucket = 0;
+        // A consumer that fell behind skips to the newest periods, the process callback only drops
+        // periods once the ring is full anyway
+        m_ring.set_lag_policy(audio::LagPolicy::drop_oldest);
+    }
+
+    audio::StreamInfo start(const std::string &source_client, const audio::CaptureOptions &options)
+    {
+        jack_status_t status;
+        m_client = jack_client_open("visualizer", JackNoStartServer, &status);
+        if (m_client == nullptr)
+            throw std::runtime_error("could not connect to the jack server");
+
+        for (uint32_t channel = 0; channel < m_channels; channel++) {
+            const std::string name = "in_" + std::to_string(channel + 1);
+            m_ports[channel] = jack_port_register(m_client, name.c_str(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+            if (m_ports[channel] == nullptr)
+                throw std::runtime_error("could not register jack port " + name);
+        }
+
+        // The rate and the period are the server's, blocks are made of as many periods as the options ask for
+        m_format = audio::StreamFormat{jack_get_sample_rate(m_client), m_channels};
+        m_period = jack_get_buffer_size(m_client);
+        set_block_frames(audio::detail::block_frames(options, m_format));
+        jack_set_process_callback(m_client, &JackStream::process, this);
+        jack_set_buffer_size_callback(m_client, &JackStream::buffer_size, this);
+        jack_set_xrun_callback(m_client, &JackStream::xrun, this);
+        m_running = true;
+        m_consumer = std::thread([this] { consume(); });
+        if (jack_activate(m_client) != 0)
+            throw std::runtime_error("could not activate the jack client");
+        connect(source_client);
+        return m_info;
+    }
+
+    // The graph keeps running whatever we do, so pausing is left to the session
+    audio::StreamInfo info() const override
+    {
+        return m_info;
+    }
+
+    // Rounded up to whole periods, the server's period is the same for every client
+    bool set_block_frames(uint32_t frames) override
+    {
+        frames = std::min(std::max<uint32_t>(frames, 1), MAX_PERIOD_FRAMES);
+        m_block_frames.store(frames, std::memory_order_relaxed);
+        const uint32_t period = std::max<uint32_t>(m_period.load(std::memory_order_relaxed), 1);
+        m_info.format = m_format;
+        m_info.fragment_frames = (frames + period - 1) / period * period;
+        m_info.latency = std::chrono::microseconds(uint64_t(m_info.fragment_frames) * 1000000 / m_format.sample_rate);
+        return true;
+    }
+
+    bool process_times(std::chrono::microseconds &p99, std::chrono::microseconds &max) const override
+    {
+        uint64_t counts[HISTOGRAM_BUCKETS];
+        uint64_t total = 0;
+        for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            counts[i] = m_process_histogram[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        if (total == 0)
+            return false;
+
+        const uint64_t rank = std::max<uint64_t>(1, total * 99 / 100);
+        uint64_t seen = 0;
+        uint32_t bucket = 0;
+        while (seen + counts[bucket] < rank)
+            seen += counts[bucket++];
+        p99 = std::chrono::microseconds(bucket);
+        uint32_t last = HISTOGRAM_BUCKETS - 1;
+        while (last > 0 && counts[last] == 0)
+            last--;
+        max = std::chrono::microseconds(last);
+        return true;
+    }
+
+    ~JackStream() override
+    {
+        if (m_client != nullptr) {
+            jack_deactivate(m_client);
+            jack_client_close(m_client);
+        }
+        m_running = false;
+        sem_post(&m_ready);
+        if (m_consumer.joinable())
+            m_consumer.join();
+        sem_destroy(&m_ready);
+    }
+private:
+    // An empty client name means whatever is currently feeding the physical outputs
+    void connect(const std::string &source_client)
+    {
+        const char **targets;
+        if (source_client.empty())
+            targets = jack_get_ports(m_client, nullptr, JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput | JackPortIsPhysical);
+        else
+            targets = jack_get_ports(m_client, ("^" + source_client + ":").c_str(), JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput);
+        if (targets == nullptr)
+            return;
+
+        for (uint32_t channel = 0; channel < m_channels && targets[channel] != nullptr; channel++) {
+            const char *our_port = jack_port_name(m_ports[channel]);
+            if (!source_client.empty()) {
+                jack_connect(m_client, targets[channel], our_port);
+                continue;
+            }
+            jack_port_t *target = jack_port_by_name(m_client, targets[channel]);
+            jack_latency_range_t range;
+            jack_port_get_latency_range(target, JackPlaybackLatency, &range);
+            m_playback_latency.store(range.max, std::memory_order_relaxed);
+            const char **feeding = jack_port_get_all_connections(m_client, target);
+            for (const char **port = feeding; port != nullptr && *port != nullptr; port++)
+                jack_connect(m_client, *port, our_port);
+            jack_free(feeding);
+        }
+        jack_free(targets);
+    }
+
+    static int process(jack_nframes_t frames, void *userdata)
+    {
+        auto self = static_cast<JackStream *>(userdata);
+        const uint64_t started = monotonic_ns();
+
+        const uint32_t channels = self->m_channels;
+        const float *inputs[MAX_CHANNELS];
+        for (uint32_t channel = 0; channel < channels; channel++)
+            inputs[channel] = static_cast<const float *>(jack_port_get_buffer(self->m_ports[channel], frames));
+
+        // Only whole frames go into the ring so the consumer never sees the channels shift
+        const uint32_t fits = static_cast<uint32_t>(self->m_ring.writable() / channels);
+        const uint32_t to_write = std::min(std::min(frames, MAX_PERIOD_FRAMES), fits);
+        float *interleaved = self->m_interleaved.data();
+        for (uint32_t frame = 0; frame < to_write; frame++)
+            for (uint32_t channel = 0; channel < channels; channel++)
+                *interleaved++ = inputs[channel][frame];
+        if (self->m_xrun.exchange(false, std::memory_order_relaxed))
+            self->m_clock.mark(audio::BUFFER_XRUN);
+        audio::BufferView view{self->m_interleaved.data(), to_write, self->m_format, 0, audio::BlockTiming()};
+        self->m_clock.stamp(view, self->latency(frames));
+        self->m_ring.write(view.data, to_write * channels, view.stamp());
+        // Frames that didn't fit are a gap in front of the next period
+        if (to_write < frames)
+            self->m_clock.skip(frames - to_write);
+        sem_post(&self->m_ready);
+
+        const uint64_t elapsed_us = (monotonic_ns() - started) / 1000;
+        self->m_process_histogram[std::min<uint64_t>(elapsed_us, HISTOGRAM_BUCKETS - 1)].fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+
+    void consume()
+    {
+        bool capturing = true;
+        // Periods gathered into the next block, which starts with the flags and timing of the first
+        uint32_t frames = 0;
+        uint32_t flags = 0;
+        audio::BlockTiming timing{};
+        while (m_running && capturing) {
+            sem_wait(&m_ready);
+            // Every period is a ring block of its own, its samples are in the ring before its stamp.
+            // Reading up to the block's end keeps the samples of a dropped stamp with the next block.
+            Ring::Block block;
+            while (capturing && m_ring.next_block(block)) {
+                const uint32_t block_flags = block.stamp.flags | (block.gap ? uint32_t(audio::BUFFER_GAP) : 0u);
+                // A discontinuity starts a block of its own, so its flags describe the block's first frame
+                if (frames != 0 && (block_flags & audio::BUFFER_DISCONTINUITY)) {
+                    capturing = m_callback(audio::BufferView{m_block.data(), frames, m_format, flags, timing});
+                    frames = 0;
+                }
+                if (frames == 0) {
+                    flags = block_flags;
+                    timing = block.stamp.timing;
+                }
+                const size_t end = block.position + block.samples;
+                const size_t room = m_block.size() - size_t(frames) * m_channels;
+                const size_t samples = m_ring.read(m_block.data() + size_t(frames) * m_channels,
+                                                   std::min(end - m_ring.position(), room));
+                frames += static_cast<uint32_t>(samples / m_channels);
+                if (capturing && frames >= m_block_frames.load(std::memory_order_relaxed)) {
+                    capturing = m_callback(audio::BufferView{m_block.data(), frames, m_format, flags, timing});
+                    frames = 0;
+                }
+            }
+        }
+    }
+
+    static int buffer_size(jack_nframes_t frames, void *userdata)
+    {
+        static_cast<JackStream *>(userdata)->m_period.store(frames, std::memory_order_relaxed);
+        return 0;
+    }
+
+    static int xrun(void *userdata)
+    {
+        static_cast<JackStream *>(userdata)->m_xrun.store(true, std::memory_order_relaxed);
+        return 0;
+    }
+
+    // The period was captured during the previous cycle, after the capture latency of whatever feeds our
+    // ports. Loopback of the physical outputs is only heard their playback latency after it reaches us.
+    std::chrono::microseconds latency(jack_nframes_t frames) const
+    {
+        jack_latency_range_t range;
+        jack_port_get_latency_range(m_ports[0], JackCaptureLatency, &range);
+        const int64_t frames_ago = int64_t(frames) + jack_frames_since_cycle_start(m_client) + range.max -
+                                   m_playback_latency.load(std::memory_order_relaxed);
+        return std::chrono::microseconds(frames_ago * 1000000 / m_format.sample_rate);
+    }
+
+    audio::BufferCallback m_callback;
+    jack_client_t *m_client = nullptr;
+    const uint32_t m_channels;
+    std::vector<jack_port_t *> m_ports;
+    audio::StreamFormat m_format{0, 0};
+    std::atomic<jack_nframes_t> m_period{0};
+    std::atomic<uint32_t> m_block_frames{1};
+    audio::StreamInfo m_info;
+    typedef audio::StampedRing<float, audio::BlockStamp> Ring;
+    Ring m_ring;
+    // Only touched by the process callback
+    audio::detail::BlockClock m_clock;
+    std::atomic<jack_nframes_t> m_playback_latency{0};
+    std::vector<float> m_interleaved;
+    std::vector<float> m_block;
+    std::atomic<bool> m_xrun{false};
+    std::atomic<uint64_t> m_process_histogram[HISTOGRAM_BUCKETS];
+    sem_t m_ready;
+    std::atomic<bool> m_running{false};
+    std::thread m_consumer;
+};
+
+class JackBackend : public audio::detail::CaptureBackend
+{
+public:
+    // Every client with audio outputs can be captured
+    std::vector<audio::AudioSinkInfo> list_sinks() override
+    {
+        std::vector<audio::AudioSinkInfo> sinks;
+        jack_client_t *client = jack_client_open("visualizer-query", JackNoStartServer, nullptr);
+        if (client == nullptr)
+            return sinks;
+
+        const char **ports = jack_get_ports(client, nullptr, JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput);
+        for (const char **port = ports; port != nullptr && *port != nullptr; port++) {
+            const std::string name(*port);
+            const std::string client_name = name.substr(0, name.find(':'));
+            bool known = false;
+            for (const auto &sink : sinks)
+                known = known || sink.device_id == client_name;
+            if (!known)
+                sinks.push_back(audio::AudioSinkInfo{client_name, client_name, false});
+        }
+        jack_free(ports);
+        jack_client_close(client);
+        return sinks;
+    }
+
+    audio::AudioSinkInfo get_default_sink(bool capture) override
+    {
+        if (capture)
+            return audio::AudioSinkInfo{"system", "system", true};
+        return audio::AudioSinkInfo{"playback", "", false};
+    }
+
+    std::unique_ptr<audio::detail::CaptureStream> open_stream(audio::BufferCallback callback,
+                                                              const audio::AudioSinkInfo &sink,
+                                                              const audio::CaptureOptions &options) override
+    {
+        std::unique_ptr<JackStream> stream(new JackStream(callback, options));
+        stream->start(sink.device_id, options);
+        return stream;
+    }
+};
+
+namespace audio
+{
+namespace detail
+{
+    std::unique_ptr<CaptureBackend> make_jack_backend()
+    {
+        return std::unique_ptr<CaptureBackend>(new JackBackend());
+    }
+}
+}
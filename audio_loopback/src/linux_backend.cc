@@ -1,90 +1,114 @@
-#include <audio_loopback/loopback_recorder.h>
-#include <cmath>
-#include <pulse/simple.h>
-#include <pulse/error.h>
-#include <thread>
-#include <unistd.h> // For STDOUT_FILENO
-#include <stdexcept>
-#include <iostream>
-namespace {
-    //pa_simple* pulse;
-    static const pa_sample_spec SAMPLE_SPEC = {
-            .format = PA_SAMPLE_FLOAT32,
-            .rate = 44100,
-            .channels = 2
-    };
-}
+#include "capture_backend.h"
+#include <cstdlib>
+#include <mutex>
 
-class PulseAudioWrapper
+namespace
 {
-public:
-    static constexpr uint32_t BUFSIZE = 256;
-    PulseAudioWrapper() {
-        pulse_simple_api = pa_simple_new(NULL,               // Use the default server.
-                              "Visualizer",           // Our application's name.
-                              PA_STREAM_RECORD,
-                                         NULL,               // Use the default device. //TODO CHECK
-                              "Record",            // Description of our stream.
-                              &SAMPLE_SPEC,                // Our sample format.
-                              NULL,               // Use default channel map
-                              NULL,               // Use default buffering attributes.
-                              NULL               // Ignore error code.
-        );
-    }
-
-    audio::AudioBuffer read_sink()
-    {
-        audio::AudioBuffer new_data;
-        audio::StereoPacket buf[BUFSIZE];
-        int32_t error;
-        if (pa_simple_read(pulse_simple_api, buf, sizeof(buf), &error) < 0)
-            std::cout << "error" << error;
-            //throw std::runtime_error("error reading from pulse audio");
+struct BackendEntry
+{
+    const char *name;
+    std::unique_ptr<audio::detail::CaptureBackend> (*make)();
+};
 
-        std::copy(std::begin(buf), std::end(buf), std::back_inserter(new_data));
-        return new_data;
-    }
+// The first entry is the default, which one that is gets decided at configure time
+const BackendEntry BACKENDS[] = {
+#ifdef AUDIO_LOOPBACK_HAVE_PIPEWIRE
+    {"pipewire", &audio::detail::make_pipewire_backend},
+#endif
+    {"pulse", &audio::detail::make_pulseaudio_backend},
+#ifdef AUDIO_LOOPBACK_HAVE_ALSA
+    {"alsa", &audio::detail::make_alsa_backend},
+#endif
+#ifdef AUDIO_LOOPBACK_HAVE_JACK
+    {"jack", &audio::detail::make_jack_backend},
+#endif
+    {"file", &audio::detail::make_file_backend},
+    {"generator", &audio::detail::make_generator_backend},
+    {"pipe", &audio::detail::make_pipe_backend},
+    {"faults", &audio::detail::make_fault_backend},
+};
 
+std::mutex backend_mutex;
+std::unique_ptr<audio::detail::CaptureBackend> current_backend;
 
-     ~PulseAudioWrapper(){
-        pa_simple_free(pulse_simple_api);
+const BackendEntry *find_backend(const std::string &name)
+{
+    for (const auto &entry : BACKENDS) {
+        if (name == entry.name)
+            return &entry;
     }
-private:
-    pa_simple *pulse_simple_api;
-};
-
+    return nullptr;
+}
 
+const BackendEntry &default_backend()
+{
+    const char *requested = std::getenv("AUDIO_LOOPBACK_BACKEND");
+    const BackendEntry *entry = requested != nullptr ? find_backend(requested) : nullptr;
+    return entry != nullptr ? *entry : BACKENDS[0];
+}
 
-void record_loop(audio::CaptureCallback callback)
+// Must be called with backend_mutex held
+bool select_locked(const std::string &name)
 {
-    static PulseAudioWrapper pulse;
-    bool playing = true;
-    while(playing)
-    {
-        auto result = pulse.read_sink();
-        callback(result);
-    }
+    const BackendEntry *entry = find_backend(name);
+    if (entry == nullptr)
+        return false;
+    audio::detail::stop_detached_sessions();
+    current_backend.reset();
+    current_backend = entry->make();
+    return true;
 }
 
+audio::detail::CaptureBackend &backend()
+{
+    std::lock_guard<std::mutex> lock(backend_mutex);
+    if (!current_backend)
+        select_locked(default_backend().name);
+    return *current_backend;
+}
+}
 
 namespace audio
 {
-    AudioSinkInfo get_default_sink()
+namespace detail
+{
+    std::unique_ptr<CaptureBackend> make_backend(const std::string &name)
     {
-        AudioSinkInfo apa;
-        apa.name = "Apa";
-        apa.device_id ="kamu";
-        return apa;
+        const BackendEntry *entry = name.empty() ? &default_backend() : find_backend(name);
+        return entry != nullptr ? entry->make() : nullptr;
     }
 
-    static CaptureCallback the_callback;
+    std::unique_ptr<CaptureStream> open_stream(BufferCallback callback, const AudioSinkInfo &sink,
+                                               const CaptureOptions &options)
+    {
+        return backend().open_stream(callback, sink, options);
+    }
+}
+}
 
-    void capture_data(CaptureCallback callback, const AudioSinkInfo &sink)
+namespace audio
+{
+    std::vector<std::string> available_backends()
     {
+        std::vector<std::string> names;
+        for (const auto &entry : BACKENDS)
+            names.push_back(entry.name);
+        return names;
+    }
 
-        auto record_thread = std::thread([=] {record_loop(callback);});
-        record_thread.detach();
+    bool select_backend(const std::string &name)
+    {
+        std::lock_guard<std::mutex> lock(backend_mutex);
+        return select_locked(name);
     }
 
+    std::vector<AudioSinkInfo> list_sinks()
+    {
+        return backend().list_sinks();
+    }
 
-}
\ No newline at end of file
+    AudioSinkInfo get_default_sink(bool capture)
+    {
+        return backend().get_default_sink(capture);
+    }
+}
@@ -0,0 +1,140 @@
+#include <audio_loopback/loopback_recorder.h>
+#include <alloca.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#ifdef AUDIO_LOOPBACK_HAVE_RTKIT
+#include <dbus/dbus.h>
+#endif
+
+#ifndef SCHED_RESET_ON_FORK
+#define SCHED_RESET_ON_FORK 0x40000000
+#endif
+
+namespace
+{
+// Left untouched at the far end of the stack for whatever runs below the prefaulting frame
+const size_t STACK_MARGIN = 64 * 1024;
+
+bool set_fifo(int priority, std::string &error)
+{
+  sched_param param{};
+  param.sched_priority = priority;
+  const int result = pthread_setschedparam(pthread_self(), SCHED_FIFO | SCHED_RESET_ON_FORK, &param);
+  if (result != 0)
+    error = std::string("SCHED_FIFO: ") + std::strerror(result);
+  return result == 0;
+}
+
+#ifdef AUDIO_LOOPBACK_HAVE_RTKIT
+// rtkit refuses threads of processes without an RLIMIT_RTTIME at or below its own maximum
+const rlim_t RTTIME_LIMIT_US = 200000;
+
+bool rtkit_make_realtime(int priority, std::string &error_message)
+{
+  rlimit limit;
+  if (getrlimit(RLIMIT_RTTIME, &limit) == 0 && (limit.rlim_max == RLIM_INFINITY || limit.rlim_max > RTTIME_LIMIT_US)) {
+    limit.rlim_cur = limit.rlim_max = RTTIME_LIMIT_US;
+    setrlimit(RLIMIT_RTTIME, &limit);
+  }
+
+  DBusError error;
+  dbus_error_init(&error);
+  DBusConnection *bus = dbus_bus_get_private(DBUS_BUS_SYSTEM, &error);
+  if (bus == nullptr) {
+    if (dbus_error_is_set(&error))
+      error_message = std::string("rtkit: ") + error.message;
+    dbus_error_free(&error);
+    return false;
+  }
+  dbus_connection_set_exit_on_disconnect(bus, false);
+
+  bool granted = false;
+  DBusMessage *message = dbus_message_new_method_call("org.freedesktop.RealtimeKit1", "/org/freedesktop/RealtimeKit1",
+                                                      "org.freedesktop.RealtimeKit1", "MakeThreadRealtime");
+  const dbus_uint64_t thread = static_cast<dbus_uint64_t>(syscall(SYS_gettid));
+  const dbus_uint32_t rtkit_priority = static_cast<dbus_uint32_t>(priority);
+  if (message != nullptr &&
+      dbus_message_append_args(message, DBUS_TYPE_UINT64, &thread, DBUS_TYPE_UINT32, &rtkit_priority,
+                               DBUS_TYPE_INVALID)) {
+    DBusMessage *reply = dbus_connection_send_with_reply_and_block(bus, message, -1, &error);
+    granted = reply != nullptr && !dbus_set_error_from_message(&error, reply);
+    if (reply != nullptr)
+      dbus_message_unref(reply);
+  }
+  if (dbus_error_is_set(&error))
+    error_message = std::string("rtkit: ") + error.message;
+  dbus_error_free(&error);
+  if (message != nullptr)
+    dbus_message_unref(message);
+  dbus_connection_close(bus);
+  dbus_connection_unref(bus);
+  return granted;
+}
+#endif
+
+bool pin(int cpu)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// Not inlined, so the touched pages lie below every frame the caller will ever have
+__attribute__((noinline)) bool prefault_stack(size_t bytes)
+{
+  pthread_attr_t attributes;
+  size_t stack_size = 0;
+  if (pthread_getattr_np(pthread_self(), &attributes) == 0) {
+    pthread_attr_getstacksize(&attributes, &stack_size);
+    pthread_attr_destroy(&attributes);
+  }
+  if (stack_size <= STACK_MARGIN * 2)
+    return false;
+
+  bytes = std::min(bytes, stack_size - STACK_MARGIN * 2);
+  volatile unsigned char *stack = static_cast<volatile unsigned char *>(alloca(bytes));
+  const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  for (size_t offset = 0; offset < bytes; offset += page)
+    stack[offset] = 0;
+  return true;
+}
+}
+
+namespace audio
+{
+RealtimeGrant promote_current_thread(const RealtimeOptions &options)
+{
+  RealtimeGrant grant;
+  if (!options.enabled)
+    return grant;
+
+  if (options.cpu >= 0)
+    grant.pinned = pin(options.cpu);
+
+  if (options.priority > 0) {
+    grant.scheduling = set_fifo(options.priority, grant.scheduling_error);
+#ifdef AUDIO_LOOPBACK_HAVE_RTKIT
+    // rtkit's reason replaces the kernel's, it is the last thing tried
+    if (!grant.scheduling)
+      grant.scheduling = grant.rtkit = rtkit_make_realtime(options.priority, grant.scheduling_error);
+    if (grant.scheduling)
+      grant.scheduling_error.clear();
+#endif
+  }
+
+  // The stack is touched first, so locking covers its pages too
+  if (options.prefault_stack_bytes > 0)
+    grant.stack_prefaulted = prefault_stack(options.prefault_stack_bytes);
+  if (options.lock_memory)
+    grant.memory_locked = mlockall(MCL_CURRENT) == 0;
+  return grant;
+}
+}
@@ -0,0 +1,57 @@
+#include <audio_loopback/loopback_recorder.h>
+#include <audio_loopback/channel_mix.h>
+#include <memory>
+
+namespace audio
+{
+void capture_data(BufferCallback callback, const AudioSinkInfo &sink)
+{
+  capture_data(callback, sink, CaptureOptions()).detach();
+}
+
+namespace
+{
+// Folds blocks of any channel count down to the StereoPacket layout of AudioBuffer
+class StereoAdapter
+{
+public:
+  const StereoPacket *packets(const BufferView &view)
+  {
+    if (view.format.channels == 2)
+      return view.packets();
+
+    if (m_matrix.inputs() != view.format.channels)
+      m_matrix = DownmixMatrix::stereo(view.format.channels);
+    if (m_left.size() < view.frames) {
+      m_left.resize(view.frames);
+      m_right.resize(view.frames);
+      m_packets.resize(view.frames);
+    }
+    float *const mixed[2] = {m_left.data(), m_right.data()};
+    deinterleave_downmix(view, nullptr, m_matrix, mixed);
+    for (uint32_t i = 0; i < view.frames; i++)
+      m_packets[i] = StereoPacket{m_left[i], m_right[i]};
+    return m_packets.data();
+  }
+
+private:
+  DownmixMatrix m_matrix{2, 2};
+  std::vector<float> m_left;
+  std::vector<float> m_right;
+  std::vector<StereoPacket> m_packets;
+};
+}
+
+void capture_data(CaptureCallback callback, const AudioSinkInfo &sink)
+{
+  // Reused between blocks, assign() only reallocates when a block is larger than any before it
+  auto buffer = std::make_shared<AudioBuffer>();
+  auto adapter = std::make_shared<StereoAdapter>();
+  capture_data([callback, buffer, adapter](const BufferView &view)
+               {
+                   const StereoPacket *packets = adapter->packets(view);
+                   buffer->assign(packets, packets + view.frames);
+                   return callback(*buffer);
+               }, sink);
+}
+}
@@ -7,4 +7,49 @@ std::ostream &operator<<(std::ostream &os, const audio::AudioSinkInfo &info)
 {
   os << "name: " << info.name;
   return os;
-}
\ No newline at end of file
+}
+
+std::ostream &operator<<(std::ostream &os, audio::SampleFormat format)
+{
+  switch (format) {
+    case audio::SampleFormat::float32:
+      return os << "f32";
+    case audio::SampleFormat::int16:
+      return os << "s16";
+    case audio::SampleFormat::int24:
+      return os << "s24";
+    case audio::SampleFormat::int24_32:
+      return os << "s24_32";
+    case audio::SampleFormat::int32:
+      return os << "s32";
+  }
+  return os;
+}
+
+std::ostream &operator<<(std::ostream &os, const audio::StreamInfo &info)
+{
+  os << "rate: " << info.format.sample_rate << " channels: " << info.format.channels
+     << " format: " << info.sample_format
+     << " latency: " << info.latency.count() << "us fragment: " << info.fragment_frames << " frames";
+  return os;
+}
+
+std::ostream &operator<<(std::ostream &os, const audio::RealtimeGrant &grant)
+{
+  os << "scheduling: " << (grant.scheduling ? (grant.rtkit ? "fifo (rtkit)" : "fifo") : "no");
+  if (!grant.scheduling_error.empty())
+    os << " (" << grant.scheduling_error << ")";
+  os << " pinned: " << (grant.pinned ? "yes" : "no")
+     << " memory locked: " << (grant.memory_locked ? "yes" : "no")
+     << " stack prefaulted: " << (grant.stack_prefaulted ? "yes" : "no");
+  return os;
+}
+
+std::ostream &operator<<(std::ostream &os, const audio::CaptureMetrics &metrics)
+{
+  os << "block: " << metrics.block_frames << " frames wakeups: " << metrics.wakeups_per_second
+     << "/s consumer: " << metrics.consumer_hz << " Hz errors: " << metrics.errors;
+  if (metrics.process_max.count() != 0)
+    os << " process p99: " << metrics.process_p99.count() << "us max: " << metrics.process_max.count() << "us";
+  return os;
+}
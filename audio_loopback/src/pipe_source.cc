@@ -0,0 +1,177 @@
+#include "block_source.h"
+#include "sample_convert.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    // Bytes asked for per read(), big enough that a fast producer costs few syscalls
+    const size_t READ_BYTES = 1 << 20;
+    // The kernel default of 64 KiB stalls a bursty writer, F_SETPIPE_SZ is capped by /proc/sys/fs/pipe-max-size
+    const int PIPE_BYTES = 1 << 20;
+}
+
+// Interleaved raw pcm from stdin or a named pipe, in the encoding, rate and channel count
+// given by the capture options. The writer paces the stream, reads wait until it has written.
+class PipeSource : public audio::detail::BlockSource
+{
+public:
+    PipeSource(const std::string &path, audio::StreamFormat format, audio::SampleFormat encoding)
+        : m_format(format),
+          m_encoding(encoding),
+          m_frame_bytes(audio::detail::bytes_per_sample(encoding) * format.channels),
+          m_bytes(READ_BYTES)
+    {
+        if (path.empty() || path == "-") {
+            m_fd = STDIN_FILENO;
+        }
+        else {
+            m_fd = open(path.c_str(), O_RDONLY);
+            m_owns_fd = true;
+        }
+        if (m_fd < 0)
+            throw std::runtime_error("could not open " + path);
+#ifdef F_SETPIPE_SZ
+        fcntl(m_fd, F_SETPIPE_SZ, PIPE_BYTES);
+#endif
+    }
+
+    ~PipeSource() override
+    {
+        if (m_owns_fd)
+            close(m_fd);
+    }
+
+    audio::StreamFormat format() const override
+    {
+        return m_format;
+    }
+
+    audio::SampleFormat sample_format() const override
+    {
+        return m_encoding;
+    }
+
+    bool finished() const override
+    {
+        return m_finished;
+    }
+
+    int poll_fd() const override
+    {
+        return m_fd;
+    }
+
+    void set_nonblocking() override
+    {
+        fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    // Only what was already read, the writer's timing is unknown
+    uint64_t queued_frames() const override
+    {
+        return (m_end - m_begin) / m_frame_bytes;
+    }
+
+    bool next(audio::BufferView &view, uint32_t max_frames) override
+    {
+        // Refill only once every whole frame read so far has been handed out
+        if (m_end - m_begin < m_frame_bytes && !fill())
+            return false;
+
+        const size_t frames = std::min<size_t>(max_frames, (m_end - m_begin) / m_frame_bytes);
+        const size_t samples = frames * m_format.channels;
+        const uint8_t *block = m_bytes.data() + m_begin;
+        m_begin += frames * m_frame_bytes;
+
+        const float *data;
+        if (m_encoding == audio::SampleFormat::float32 && reinterpret_cast<uintptr_t>(block) % alignof(float) == 0) {
+            data = reinterpret_cast<const float *>(block);
+        }
+        else {
+            m_converted.resize(std::max(m_converted.size(), samples));
+            audio::detail::convert_to_float(m_encoding, block, m_converted.data(), samples);
+            data = m_converted.data();
+        }
+        view = audio::BufferView{data, static_cast<uint32_t>(frames), m_format, 0, audio::BlockTiming()};
+        return true;
+    }
+private:
+    // Reads until at least one whole frame is buffered, false if none is, for now or for good
+    bool fill()
+    {
+        // Keep the partial frame a previous read left behind
+        const size_t partial = m_end - m_begin;
+        std::memmove(m_bytes.data(), m_bytes.data() + m_begin, partial);
+        m_begin = 0;
+        m_end = partial;
+
+        while (m_end < m_frame_bytes) {
+            const ssize_t result = read(m_fd, m_bytes.data() + m_end, m_bytes.size() - m_end);
+            if (result < 0 && errno == EINTR)
+                continue;
+            if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return false;
+            if (result <= 0) {
+                m_finished = true;
+                return false;
+            }
+            m_end += static_cast<size_t>(result);
+        }
+        return true;
+    }
+
+    audio::StreamFormat m_format;
+    audio::SampleFormat m_encoding;
+    size_t m_frame_bytes;
+    int m_fd = -1;
+    bool m_owns_fd = false;
+    bool m_finished = false;
+    std::vector<uint8_t> m_bytes;
+    size_t m_begin = 0;
+    size_t m_end = 0;
+    std::vector<float> m_converted;
+};
+
+// The device id is a path to a named pipe, empty or "-" reads stdin
+class PipeBackend : public audio::detail::SourceBackend
+{
+public:
+    std::vector<audio::AudioSinkInfo> list_sinks() override
+    {
+        return {audio::AudioSinkInfo{"stdin", "-", false}};
+    }
+
+    audio::AudioSinkInfo get_default_sink(bool capture) override
+    {
+        return audio::AudioSinkInfo{"stdin", "-", capture};
+    }
+
+    std::unique_ptr<audio::detail::BlockSource> open_source(const audio::AudioSinkInfo &sink,
+                                                            const audio::CaptureOptions &options) override
+    {
+        audio::StreamFormat format = options.format;
+        if (format.sample_rate == 0)
+            format.sample_rate = 48000;
+        if (format.channels == 0)
+            format.channels = 2;
+
+        return std::unique_ptr<audio::detail::BlockSource>(new PipeSource(sink.device_id, format, options.sample_format));
+    }
+};
+
+namespace audio
+{
+namespace detail
+{
+    std::unique_ptr<CaptureBackend> make_pipe_backend()
+    {
+        return std::unique_ptr<CaptureBackend>(new PipeBackend());
+    }
+}
+}
@@ -0,0 +1,396 @@
+#include "block_clock.h"
+#include "capture_backend.h"
+#include <pipewire/pipewire.h>
+#include <spa/param/audio/format-utils.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    // Only the denominator of the node.latency fraction, the stream itself runs at the graph rate
+    const uint32_t LATENCY_RATE = 48000;
+    const uint32_t CHANNELS = 2;
+    // A target that never negotiates a format fails the open instead of hanging it
+    const std::chrono::seconds CONNECT_TIMEOUT{2};
+    // Channels are asked for in WAVE order, the adapter maps the node's ports onto them
+    const spa_audio_channel POSITIONS[] = {SPA_AUDIO_CHANNEL_FL, SPA_AUDIO_CHANNEL_FR, SPA_AUDIO_CHANNEL_FC,
+                                           SPA_AUDIO_CHANNEL_LFE, SPA_AUDIO_CHANNEL_RL, SPA_AUDIO_CHANNEL_RR,
+                                           SPA_AUDIO_CHANNEL_SL, SPA_AUDIO_CHANNEL_SR};
+
+    class ThreadLoopLock
+    {
+    public:
+        explicit ThreadLoopLock(pw_thread_loop *loop)
+            : m_loop(loop)
+        {
+            pw_thread_loop_lock(m_loop);
+        }
+        ~ThreadLoopLock()
+        {
+            pw_thread_loop_unlock(m_loop);
+        }
+    private:
+        pw_thread_loop *m_loop;
+    };
+}
+
+// Owns the loop thread and the daemon connection, every stream of the backend runs on it
+class PipeWireContext
+{
+public:
+    PipeWireContext()
+    {
+        pw_init(nullptr, nullptr);
+        m_loop = pw_thread_loop_new("visualizer-capture", nullptr);
+        m_context = pw_context_new(pw_thread_loop_get_loop(m_loop), nullptr, 0);
+        if (m_context == nullptr || pw_thread_loop_start(m_loop) < 0)
+            throw std::runtime_error("could not start the pipewire loop");
+
+        ThreadLoopLock lock(m_loop);
+        m_core = pw_context_connect(m_context, nullptr, 0);
+        if (m_core == nullptr)
+            throw std::runtime_error("could not connect to pipewire");
+    }
+
+    std::vector<audio::AudioSinkInfo> sinks()
+    {
+        ThreadLoopLock lock(m_loop);
+        m_sinks.clear();
+
+        static const pw_registry_events registry_events = make_registry_events();
+        static const pw_core_events core_events = make_core_events();
+        pw_registry *registry = pw_core_get_registry(m_core, PW_VERSION_REGISTRY, 0);
+        spa_hook registry_listener{};
+        spa_hook core_listener{};
+        pw_registry_add_listener(registry, &registry_listener, &registry_events, this);
+        pw_core_add_listener(m_core, &core_listener, &core_events, this);
+
+        // Every global has been announced once the daemon answers the sync
+        m_pending_sync = pw_core_sync(m_core, PW_ID_CORE, 0);
+        while (m_pending_sync != DONE)
+            pw_thread_loop_wait(m_loop);
+
+        spa_hook_remove(&core_listener);
+        spa_hook_remove(&registry_listener);
+        pw_proxy_destroy(reinterpret_cast<pw_proxy *>(registry));
+        return m_sinks;
+    }
+
+    pw_thread_loop *loop()
+    {
+        return m_loop;
+    }
+
+    pw_core *core()
+    {
+        return m_core;
+    }
+
+    ~PipeWireContext()
+    {
+        pw_thread_loop_stop(m_loop);
+        if (m_core != nullptr)
+            pw_core_disconnect(m_core);
+        if (m_context != nullptr)
+            pw_context_destroy(m_context);
+        pw_thread_loop_destroy(m_loop);
+    }
+private:
+    static const int DONE = -1;
+
+    static pw_registry_events make_registry_events()
+    {
+        pw_registry_events events{};
+        events.version = PW_VERSION_REGISTRY_EVENTS;
+        events.global = &PipeWireContext::registry_global;
+        return events;
+    }
+
+    static pw_core_events make_core_events()
+    {
+        pw_core_events events{};
+        events.version = PW_VERSION_CORE_EVENTS;
+        events.done = &PipeWireContext::core_done;
+        return events;
+    }
+
+    static void registry_global(void *userdata, uint32_t, uint32_t, const char *type, uint32_t,
+                                const spa_dict *props)
+    {
+        auto self = static_cast<PipeWireContext *>(userdata);
+        if (props == nullptr || std::string(type) != PW_TYPE_INTERFACE_Node)
+            return;
+        const char *media_class = spa_dict_lookup(props, PW_KEY_MEDIA_CLASS);
+        const char *name = spa_dict_lookup(props, PW_KEY_NODE_NAME);
+        const char *description = spa_dict_lookup(props, PW_KEY_NODE_DESCRIPTION);
+        if (media_class == nullptr || name == nullptr || std::string(media_class) != "Audio/Sink")
+            return;
+        self->m_sinks.push_back(audio::AudioSinkInfo{description != nullptr ? description : name, name, false});
+    }
+
+    static void core_done(void *userdata, uint32_t id, int seq)
+    {
+        auto self = static_cast<PipeWireContext *>(userdata);
+        if (id == PW_ID_CORE && seq == self->m_pending_sync) {
+            self->m_pending_sync = DONE;
+            pw_thread_loop_signal(self->m_loop, false);
+        }
+    }
+
+    pw_thread_loop *m_loop;
+    pw_context *m_context;
+    pw_core *m_core = nullptr;
+    int m_pending_sync = DONE;
+    std::vector<audio::AudioSinkInfo> m_sinks;
+};
+
+// Captures the monitor of a sink node, blocks are delivered from the process callback in place
+class PipeWireStream : public audio::detail::CaptureStream
+{
+public:
+    PipeWireStream(std::shared_ptr<PipeWireContext> context, audio::BufferCallback callback)
+        : m_context(context), m_callback(callback)
+    {
+    }
+
+    audio::StreamInfo start(const std::string &target, bool capture_device, const audio::CaptureOptions &options)
+    {
+        const std::chrono::microseconds latency = options.latency;
+        static const pw_stream_events stream_events = make_stream_events();
+        ThreadLoopLock lock(m_context->loop());
+
+        const uint32_t latency_frames =
+            std::max<uint32_t>(1, static_cast<uint32_t>(latency.count() * LATENCY_RATE / 1000000));
+        pw_properties *props = pw_properties_new(PW_KEY_MEDIA_TYPE, "Audio",
+                                                 PW_KEY_MEDIA_CATEGORY, "Capture",
+                                                 PW_KEY_MEDIA_ROLE, "Music",
+                                                 nullptr);
+        // Links us to the monitor ports of the sink rather than to a source
+        if (!capture_device)
+            pw_properties_set(props, PW_KEY_STREAM_CAPTURE_SINK, "true");
+        // Asks the graph for this quantum, the driver may still pick another one
+        pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%u/%u", latency_frames, LATENCY_RATE);
+        if (!target.empty())
+            pw_properties_set(props, PW_KEY_TARGET_OBJECT, target.c_str());
+
+        m_stream = pw_stream_new(m_context->core(), "Visualizer", props);
+        if (m_stream == nullptr)
+            throw std::runtime_error("could not create the pipewire stream");
+        pw_stream_add_listener(m_stream, &m_listener, &stream_events, this);
+
+        // F32 is the graph's own sample format. Leaving the rate out takes the graph rate, so nothing
+        // resamples unless a rate was asked for.
+        spa_audio_info_raw format{};
+        format.format = SPA_AUDIO_FORMAT_F32;
+        format.rate = options.format.sample_rate;
+        format.channels = options.format.channels != 0 ? options.format.channels : CHANNELS;
+        format.channels = std::min<uint32_t>(format.channels, sizeof(POSITIONS) / sizeof(POSITIONS[0]));
+        for (uint32_t channel = 0; channel < format.channels; channel++)
+            format.position[channel] = POSITIONS[channel];
+        uint8_t pod_buffer[1024];
+        spa_pod_builder builder = SPA_POD_BUILDER_INIT(pod_buffer, sizeof(pod_buffer));
+        const spa_pod *params[1] = {spa_format_audio_raw_build(&builder, SPA_PARAM_EnumFormat, &format)};
+
+        const pw_stream_flags flags =
+            static_cast<pw_stream_flags>(PW_STREAM_FLAG_AUTOCONNECT | PW_STREAM_FLAG_MAP_BUFFERS);
+        if (pw_stream_connect(m_stream, PW_DIRECTION_INPUT, PW_ID_ANY, flags, params, 1) < 0)
+            throw std::runtime_error("could not connect the pipewire stream");
+
+        // Wait for the format, then give the graph a moment to run so the real quantum is known
+        const auto deadline = std::chrono::steady_clock::now() + CONNECT_TIMEOUT;
+        while (!m_error && m_format.sample_rate == 0) {
+            if (std::chrono::steady_clock::now() >= deadline)
+                throw std::runtime_error("pipewire stream negotiated no format in time");
+            pw_thread_loop_timed_wait(m_context->loop(), 1);
+        }
+        if (m_error)
+            throw std::runtime_error("pipewire stream failed to connect: " + m_error_message);
+        if (m_quantum_frames == 0)
+            pw_thread_loop_timed_wait(m_context->loop(), 1);
+
+        m_info.format = m_format;
+        m_info.fragment_frames = m_quantum_frames != 0 ? m_quantum_frames : latency_frames;
+        m_info.latency = std::chrono::microseconds(uint64_t(m_info.fragment_frames) * 1000000 / m_format.sample_rate);
+        return m_info;
+    }
+
+    audio::StreamInfo info() const override
+    {
+        return m_info;
+    }
+
+    uint64_t errors() const override
+    {
+        return m_errors.load(std::memory_order_relaxed);
+    }
+
+    // An inactive stream isn't scheduled in the graph, the process callback stops until it is reactivated
+    bool set_paused(bool paused) override
+    {
+        ThreadLoopLock lock(m_context->loop());
+        if (!m_capturing)
+            return true;
+        pw_stream_set_active(m_stream, !paused);
+        if (!paused)
+            m_clock.mark(audio::BUFFER_GAP);
+        return true;
+    }
+
+    // Asks the graph for another quantum. The driver runs at the smallest quantum any node asks for,
+    // so blocks only grow as far as the other streams let them.
+    bool set_block_frames(uint32_t frames) override
+    {
+        ThreadLoopLock lock(m_context->loop());
+        char latency[32];
+        std::snprintf(latency, sizeof(latency), "%u/%u", frames, m_format.sample_rate);
+        const spa_dict_item items[] = {SPA_DICT_ITEM_INIT(PW_KEY_NODE_LATENCY, latency)};
+        const spa_dict properties = SPA_DICT_INIT(items, 1);
+        if (pw_stream_update_properties(m_stream, &properties) < 0)
+            return false;
+        m_info.fragment_frames = frames;
+        m_info.latency = std::chrono::microseconds(uint64_t(frames) * 1000000 / m_format.sample_rate);
+        return true;
+    }
+
+    ~PipeWireStream() override
+    {
+        if (m_stream == nullptr)
+            return;
+        ThreadLoopLock lock(m_context->loop());
+        spa_hook_remove(&m_listener);
+        pw_stream_destroy(m_stream);
+    }
+private:
+    static pw_stream_events make_stream_events()
+    {
+        pw_stream_events events{};
+        events.version = PW_VERSION_STREAM_EVENTS;
+        events.state_changed = &PipeWireStream::state_changed;
+        events.param_changed = &PipeWireStream::param_changed;
+        events.process = &PipeWireStream::process;
+        return events;
+    }
+
+    static void state_changed(void *userdata, pw_stream_state, pw_stream_state state, const char *error)
+    {
+        auto self = static_cast<PipeWireStream *>(userdata);
+        if (state == PW_STREAM_STATE_ERROR) {
+            self->m_error = true;
+            self->m_error_message = error != nullptr ? error : "";
+            self->m_errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        pw_thread_loop_signal(self->m_context->loop(), false);
+    }
+
+    static void param_changed(void *userdata, uint32_t id, const spa_pod *param)
+    {
+        auto self = static_cast<PipeWireStream *>(userdata);
+        if (param == nullptr || id != SPA_PARAM_Format)
+            return;
+        spa_audio_info_raw format{};
+        if (spa_format_audio_raw_parse(param, &format) < 0)
+            return;
+        self->m_format = audio::StreamFormat{format.rate, format.channels};
+        pw_thread_loop_signal(self->m_context->loop(), false);
+    }
+
+    static void process(void *userdata)
+    {
+        auto self = static_cast<PipeWireStream *>(userdata);
+        pw_buffer *buffer = pw_stream_dequeue_buffer(self->m_stream);
+        if (buffer == nullptr)
+            return;
+
+        spa_data &data = buffer->buffer->datas[0];
+        // Corrupted chunks are dropped, their frames still count towards the position of later blocks
+        if (data.data != nullptr && (data.chunk->flags & SPA_CHUNK_FLAG_CORRUPTED)) {
+            self->m_clock.skip(std::min(data.chunk->size, data.maxsize) / (sizeof(float) * self->m_format.channels));
+        }
+        else if (data.data != nullptr && self->m_capturing) {
+            const uint32_t offset = std::min(data.chunk->offset, data.maxsize);
+            const uint32_t size = std::min(data.chunk->size, data.maxsize - offset);
+            const uint32_t frames = size / (sizeof(float) * self->m_format.channels);
+            if (self->m_quantum_frames == 0) {
+                self->m_quantum_frames = frames;
+                pw_thread_loop_signal(self->m_context->loop(), false);
+            }
+
+            audio::BufferView view{reinterpret_cast<const float *>(static_cast<uint8_t *>(data.data) + offset),
+                                   frames,
+                                   self->m_format,
+                                   0,
+                                   audio::BlockTiming()};
+            self->m_clock.stamp_queued(view, self->graph_delay_frames());
+            self->m_capturing = self->m_callback(view);
+            if (!self->m_capturing)
+                pw_stream_set_active(self->m_stream, false);
+        }
+        pw_stream_queue_buffer(self->m_stream, buffer);
+    }
+
+    // Delay of the filters between the device and the stream, in frames of the stream.
+    // pw_time counts it in ticks of the graph clock, whose rate can differ from the stream's.
+    uint64_t graph_delay_frames() const
+    {
+        pw_time time{};
+        if (pw_stream_get_time_n(m_stream, &time, sizeof(time)) < 0 || time.rate.denom == 0 || time.delay < 0)
+            return 0;
+        return uint64_t(time.delay) * time.rate.num * m_format.sample_rate / time.rate.denom;
+    }
+
+    std::shared_ptr<PipeWireContext> m_context;
+    audio::BufferCallback m_callback;
+    audio::detail::BlockClock m_clock;
+    pw_stream *m_stream = nullptr;
+    spa_hook m_listener{};
+    audio::StreamFormat m_format{0, 0};
+    audio::StreamInfo m_info;
+    uint32_t m_quantum_frames = 0;
+    bool m_capturing = true;
+    // Set on the loop thread, read with the loop locked
+    bool m_error = false;
+    std::string m_error_message;
+    std::atomic<uint64_t> m_errors{0};
+};
+
+class PipeWireBackend : public audio::detail::CaptureBackend
+{
+public:
+    std::vector<audio::AudioSinkInfo> list_sinks() override
+    {
+        return m_context->sinks();
+    }
+
+    // An empty target lets the session manager link us to the default sink's monitor
+    audio::AudioSinkInfo get_default_sink(bool capture) override
+    {
+        return audio::AudioSinkInfo{"default", "", capture};
+    }
+
+    std::unique_ptr<audio::detail::CaptureStream> open_stream(audio::BufferCallback callback,
+                                                              const audio::AudioSinkInfo &sink,
+                                                              const audio::CaptureOptions &options) override
+    {
+        std::unique_ptr<PipeWireStream> stream(new PipeWireStream(m_context, callback));
+        stream->start(sink.device_id, sink.capture_device, options);
+        return stream;
+    }
+private:
+    // Streams keep their own reference, they may outlive the backend
+    std::shared_ptr<PipeWireContext> m_context = std::make_shared<PipeWireContext>();
+};
+
+namespace audio
+{
+namespace detail
+{
+    std::unique_ptr<CaptureBackend> make_pipewire_backend()
+    {
+        return std::unique_ptr<CaptureBackend>(new PipeWireBackend());
+    }
+}
+}
@@ -0,0 +1,452 @@
+#include "block_clock.h"
+#include "capture_backend.h"
+#include "sample_convert.h"
+#include <pulse/pulseaudio.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+namespace {
+    // Used when the source can't be queried or its format isn't one we convert ourselves
+    static const pa_sample_spec FALLBACK_SPEC = {
+            .format = PA_SAMPLE_FLOAT32LE,
+            .rate = 48000,
+            .channels = 2
+    };
+    bool to_sample_format(pa_sample_format_t format, audio::SampleFormat &result)
+    {
+        switch (format) {
+            case PA_SAMPLE_FLOAT32LE:
+                result = audio::SampleFormat::float32;
+                return true;
+            case PA_SAMPLE_S16LE:
+                result = audio::SampleFormat::int16;
+                return true;
+            case PA_SAMPLE_S24LE:
+                result = audio::SampleFormat::int24;
+                return true;
+            case PA_SAMPLE_S24_32LE:
+                result = audio::SampleFormat::int24_32;
+                return true;
+            case PA_SAMPLE_S32LE:
+                result = audio::SampleFormat::int32;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Records in the source's own encoding, rate and channel count, so the server neither converts,
+    // resamples nor mixes
+    pa_sample_spec negotiate(const pa_sample_spec *native, const audio::CaptureOptions &options)
+    {
+        pa_sample_spec spec = FALLBACK_SPEC;
+        audio::SampleFormat encoding;
+        if (native != nullptr && to_sample_format(native->format, encoding)) {
+            spec.format = native->format;
+            spec.rate = native->rate;
+        }
+        if (native != nullptr)
+            spec.channels = native->channels;
+        if (options.format.sample_rate != 0)
+            spec.rate = options.format.sample_rate;
+        if (options.format.channels != 0)
+            spec.channels = static_cast<uint8_t>(std::min<uint32_t>(options.format.channels, PA_CHANNELS_MAX));
+        return spec;
+    }
+
+    class MainloopLock
+    {
+    public:
+        explicit MainloopLock(pa_threaded_mainloop *mainloop)
+            : m_mainloop(mainloop)
+        {
+            pa_threaded_mainloop_lock(m_mainloop);
+        }
+        ~MainloopLock()
+        {
+            pa_threaded_mainloop_unlock(m_mainloop);
+        }
+    private:
+        pa_threaded_mainloop *m_mainloop;
+    };
+}
+
+// Owns the mainloop thread and the server connection, every stream and query runs on it
+class PulseAudioContext
+{
+public:
+    PulseAudioContext()
+    {
+        m_mainloop = pa_threaded_mainloop_new();
+        m_context = pa_context_new(pa_threaded_mainloop_get_api(m_mainloop), "Visualizer");
+        pa_context_set_state_callback(m_context, &PulseAudioContext::state_callback, m_mainloop);
+
+        MainloopLock lock(m_mainloop);
+        if (pa_context_connect(m_context, nullptr, PA_CONTEXT_NOFLAGS, nullptr) < 0 ||
+            pa_threaded_mainloop_start(m_mainloop) < 0)
+            throw std::runtime_error("could not connect to pulse audio");
+
+        pa_context_state_t state;
+        while ((state = pa_context_get_state(m_context)) != PA_CONTEXT_READY) {
+            if (!PA_CONTEXT_IS_GOOD(state))
+                throw std::runtime_error(pa_strerror(pa_context_errno(m_context)));
+            pa_threaded_mainloop_wait(m_mainloop);
+        }
+    }
+
+    std::string default_sink_name()
+    {
+        MainloopLock lock(m_mainloop);
+        wait(pa_context_get_server_info(m_context, &PulseAudioContext::server_info_callback, this));
+        return m_server_default_sink;
+    }
+
+    std::string default_source_name()
+    {
+        MainloopLock lock(m_mainloop);
+        wait(pa_context_get_server_info(m_context, &PulseAudioContext::server_info_callback, this));
+        return m_server_default_source;
+    }
+
+    // False if there is no such source
+    bool source_spec(const std::string &source, pa_sample_spec &spec)
+    {
+        MainloopLock lock(m_mainloop);
+        m_source_found = false;
+        wait(pa_context_get_source_info_by_name(m_context, source.c_str(), &PulseAudioContext::source_info_callback, this));
+        spec = m_source_spec;
+        return m_source_found;
+    }
+
+    std::vector<audio::AudioSinkInfo> sinks()
+    {
+        MainloopLock lock(m_mainloop);
+        m_sinks.clear();
+        wait(pa_context_get_sink_info_list(m_context, &PulseAudioContext::sink_info_callback, this));
+        return m_sinks;
+    }
+
+    pa_threaded_mainloop *mainloop()
+    {
+        return m_mainloop;
+    }
+
+    pa_context *context()
+    {
+        return m_context;
+    }
+
+    ~PulseAudioContext()
+    {
+        {
+            MainloopLock lock(m_mainloop);
+            pa_context_disconnect(m_context);
+            pa_context_unref(m_context);
+        }
+        pa_threaded_mainloop_stop(m_mainloop);
+        pa_threaded_mainloop_free(m_mainloop);
+    }
+private:
+    // Must be called with the mainloop locked
+    void wait(pa_operation *operation)
+    {
+        if (operation == nullptr)
+            throw std::runtime_error(pa_strerror(pa_context_errno(m_context)));
+        while (pa_operation_get_state(operation) == PA_OPERATION_RUNNING)
+            pa_threaded_mainloop_wait(m_mainloop);
+        pa_operation_unref(operation);
+    }
+
+    static void state_callback(pa_context *, void *userdata)
+    {
+        pa_threaded_mainloop_signal(static_cast<pa_threaded_mainloop *>(userdata), 0);
+    }
+
+    static void server_info_callback(pa_context *, const pa_server_info *info, void *userdata)
+    {
+        auto self = static_cast<PulseAudioContext *>(userdata);
+        self->m_server_default_sink = info->default_sink_name;
+        self->m_server_default_source = info->default_source_name;
+        pa_threaded_mainloop_signal(self->m_mainloop, 0);
+    }
+
+    static void source_info_callback(pa_context *, const pa_source_info *info, int eol, void *userdata)
+    {
+        auto self = static_cast<PulseAudioContext *>(userdata);
+        if (eol != 0) {
+            pa_threaded_mainloop_signal(self->m_mainloop, 0);
+            return;
+        }
+        self->m_source_spec = info->sample_spec;
+        self->m_source_found = true;
+    }
+
+    static void sink_info_callback(pa_context *, const pa_sink_info *info, int eol, void *userdata)
+    {
+        auto self = static_cast<PulseAudioContext *>(userdata);
+        if (eol != 0) {
+            pa_threaded_mainloop_signal(self->m_mainloop, 0);
+            return;
+        }
+        // Loopback records the monitor of the sink, so that is what identifies it
+        self->m_sinks.push_back(audio::AudioSinkInfo{info->description, info->monitor_source_name, false});
+    }
+
+    pa_threaded_mainloop *m_mainloop;
+    pa_context *m_context;
+    std::string m_server_default_sink;
+    std::string m_server_default_source;
+    std::vector<audio::AudioSinkInfo> m_sinks;
+    pa_sample_spec m_source_spec = FALLBACK_SPEC;
+    bool m_source_found = false;
+};
+
+// Record stream that delivers straight from the pulse audio read callback, without copying
+class PulseAudioStream : public audio::detail::CaptureStream
+{
+public:
+    PulseAudioStream(std::shared_ptr<PulseAudioContext> context, audio::BufferCallback callback)
+        : m_context(context), m_callback(callback)
+    {
+    }
+
+    audio::StreamInfo start(const std::string &source, const pa_sample_spec &spec, std::chrono::microseconds latency)
+    {
+        m_spec = spec;
+        to_sample_format(spec.format, m_encoding);
+
+        // Only reorders the channels into the WAVE order the consumers expect
+        pa_channel_map map;
+        pa_channel_map_init_extend(&map, m_spec.channels, PA_CHANNEL_MAP_WAVEEX);
+
+        MainloopLock lock(m_context->mainloop());
+        m_stream = pa_stream_new(m_context->context(), "Record", &m_spec, &map);
+        pa_stream_set_state_callback(m_stream, &PulseAudioStream::state_callback, this);
+        pa_stream_set_read_callback(m_stream, &PulseAudioStream::read_callback, this);
+
+        // Ask for fragments matching the latency target, the server sizes the source latency after it
+        pa_buffer_attr attributes;
+        attributes.maxlength = static_cast<uint32_t>(-1);
+        attributes.tlength = static_cast<uint32_t>(-1);
+        attributes.prebuf = static_cast<uint32_t>(-1);
+        attributes.minreq = static_cast<uint32_t>(-1);
+        attributes.fragsize = static_cast<uint32_t>(pa_usec_to_bytes(latency.count(), &m_spec));
+
+        const pa_stream_flags_t flags = static_cast<pa_stream_flags_t>(PA_STREAM_ADJUST_LATENCY |
+                                                                      PA_STREAM_AUTO_TIMING_UPDATE |
+                                                                      PA_STREAM_INTERPOLATE_TIMING);
+        if (pa_stream_connect_record(m_stream, source.c_str(), &attributes, flags) < 0)
+            throw std::runtime_error(pa_strerror(pa_context_errno(m_context->context())));
+
+        pa_stream_state_t state;
+        while ((state = pa_stream_get_state(m_stream)) != PA_STREAM_READY) {
+            if (!PA_STREAM_IS_GOOD(state))
+                throw std::runtime_error(pa_strerror(pa_context_errno(m_context->context())));
+            pa_threaded_mainloop_wait(m_context->mainloop());
+        }
+
+        const pa_buffer_attr *negotiated = pa_stream_get_buffer_attr(m_stream);
+        m_info.format = audio::StreamFormat{m_spec.rate, m_spec.channels};
+        m_info.latency = std::chrono::microseconds(pa_bytes_to_usec(negotiated->fragsize, &m_spec));
+        m_info.fragment_frames = static_cast<uint32_t>(negotiated->fragsize / pa_frame_size(&m_spec));
+        m_info.sample_format = m_encoding;
+        return m_info;
+    }
+
+    audio::StreamInfo info() const override
+    {
+        return m_info;
+    }
+
+    uint64_t errors() const override
+    {
+        return m_errors.load(std::memory_order_relaxed);
+    }
+
+    // Corks the stream, the server drops what the source records meanwhile. False if the server didn't
+    // take it, the session then drops the blocks itself.
+    bool set_paused(bool paused) override
+    {
+        MainloopLock lock(m_context->mainloop());
+        if (!m_capturing)
+            return true;
+        m_corked = 0;
+        pa_operation *operation = pa_stream_cork(m_stream, paused ? 1 : 0, &PulseAudioStream::cork_callback, this);
+        if (operation == nullptr)
+            return false;
+        while (pa_operation_get_state(operation) == PA_OPERATION_RUNNING)
+            pa_threaded_mainloop_wait(m_context->mainloop());
+        pa_operation_unref(operation);
+        if (m_corked == 0)
+            return false;
+        if (!paused)
+            m_clock.mark(audio::BUFFER_GAP);
+        return true;
+    }
+
+    // The server applies the new fragment size asynchronously, blocks of the old size may still arrive
+    bool set_block_frames(uint32_t frames) override
+    {
+        MainloopLock lock(m_context->mainloop());
+        pa_buffer_attr attributes = *pa_stream_get_buffer_attr(m_stream);
+        attributes.fragsize = static_cast<uint32_t>(frames * pa_frame_size(&m_spec));
+        pa_operation *operation = pa_stream_set_buffer_attr(m_stream, &attributes, nullptr, nullptr);
+        if (operation == nullptr)
+            return false;
+        pa_operation_unref(operation);
+        m_info.fragment_frames = frames;
+        m_info.latency = std::chrono::microseconds(pa_bytes_to_usec(attributes.fragsize, &m_spec));
+        return true;
+    }
+
+    ~PulseAudioStream() override
+    {
+        if (m_stream == nullptr)
+            return;
+        MainloopLock lock(m_context->mainloop());
+        // The disconnect itself changes the state, and the stream may outlive this object on the server
+        // side, nothing may call back into it afterwards
+        pa_stream_set_state_callback(m_stream, nullptr, nullptr);
+        pa_stream_set_read_callback(m_stream, nullptr, nullptr);
+        pa_stream_disconnect(m_stream);
+        pa_stream_unref(m_stream);
+    }
+private:
+    static void state_callback(pa_stream *, void *userdata)
+    {
+        auto self = static_cast<PulseAudioStream *>(userdata);
+        pa_threaded_mainloop_signal(self->m_context->mainloop(), 0);
+    }
+
+    static void cork_callback(pa_stream *, int success, void *userdata)
+    {
+        auto self = static_cast<PulseAudioStream *>(userdata);
+        self->m_corked = success;
+        pa_threaded_mainloop_signal(self->m_context->mainloop(), 0);
+    }
+
+    static void read_callback(pa_stream *stream, size_t, void *userdata)
+    {
+        auto self = static_cast<PulseAudioStream *>(userdata);
+        const void *data;
+        size_t bytes;
+        while (pa_stream_readable_size(stream) > 0) {
+            // Whatever couldn't be read is missing in front of the next block
+            if (pa_stream_peek(stream, &data, &bytes) < 0) {
+                self->m_errors.fetch_add(1, std::memory_order_relaxed);
+                self->m_clock.mark(audio::BUFFER_GAP);
+                return;
+            }
+            if (bytes == 0)
+                return;
+
+            // A null pointer with a size is a hole in the stream, there is nothing to deliver
+            const uint32_t frames = static_cast<uint32_t>(bytes / pa_frame_size(&self->m_spec));
+            if (data == nullptr)
+                self->m_clock.skip(frames);
+            if (data != nullptr && self->m_capturing) {
+                audio::BufferView view{self->deliverable(data, frames), frames,
+                                       {self->m_spec.rate, self->m_spec.channels}, 0, audio::BlockTiming()};
+                self->m_clock.stamp(view, self->latency());
+                self->m_capturing = self->m_callback(view);
+                if (!self->m_capturing) {
+                    pa_operation *operation = pa_stream_cork(stream, 1, nullptr, nullptr);
+                    if (operation != nullptr)
+                        pa_operation_unref(operation);
+                }
+            }
+            pa_stream_drop(stream);
+        }
+    }
+
+    // Until the block being read has been dropped, the stream latency is how long ago its first frame was
+    // recorded. Monitor sources count the sink's latency against it, samples not played yet make it negative.
+    std::chrono::microseconds latency() const
+    {
+        pa_usec_t usec;
+        int negative = 0;
+        if (pa_stream_get_latency(m_stream, &usec, &negative) < 0)
+            return std::chrono::microseconds(0);
+        const auto latency = std::chrono::microseconds(usec);
+        return negative ? -latency : latency;
+    }
+
+    // Float blocks are delivered in place, integer ones converted into a buffer reused between reads
+    const float *deliverable(const void *data, uint32_t frames)
+    {
+        if (m_encoding == audio::SampleFormat::float32 && reinterpret_cast<uintptr_t>(data) % alignof(float) == 0)
+            return static_cast<const float *>(data);
+
+        const size_t samples = size_t(frames) * m_spec.channels;
+        m_converted.resize(std::max(m_converted.size(), samples));
+        audio::detail::convert_to_float(m_encoding, data, m_converted.data(), samples);
+        return m_converted.data();
+    }
+
+    std::shared_ptr<PulseAudioContext> m_context;
+    audio::BufferCallback m_callback;
+    audio::detail::BlockClock m_clock;
+    pa_stream *m_stream = nullptr;
+    pa_sample_spec m_spec = FALLBACK_SPEC;
+    audio::SampleFormat m_encoding = audio::SampleFormat::float32;
+    audio::StreamInfo m_info;
+    std::vector<float> m_converted;
+    bool m_capturing = true;
+    // Whether the last cork was applied, set on the mainloop thread
+    int m_corked = 0;
+    // Failed reads, counted on the mainloop thread
+    std::atomic<uint64_t> m_errors{0};
+};
+
+
+class PulseAudioBackend : public audio::detail::CaptureBackend
+{
+public:
+    std::vector<audio::AudioSinkInfo> list_sinks() override
+    {
+        return m_context->sinks();
+    }
+
+    audio::AudioSinkInfo get_default_sink(bool capture) override
+    {
+        if (capture) {
+            auto name = m_context->default_source_name();
+            return audio::AudioSinkInfo{name, name, true};
+        }
+
+        auto name = m_context->default_sink_name();
+        return audio::AudioSinkInfo{name, name + ".monitor", false};
+    }
+
+    std::unique_ptr<audio::detail::CaptureStream> open_stream(audio::BufferCallback callback,
+                                                              const audio::AudioSinkInfo &sink,
+                                                              const audio::CaptureOptions &options) override
+    {
+        // No device id means the monitor of whatever the default sink is right now
+        std::string source = sink.device_id;
+        if (source.empty())
+            source = m_context->default_sink_name() + ".monitor";
+
+        pa_sample_spec native;
+        const bool found = m_context->source_spec(source, native);
+        std::unique_ptr<PulseAudioStream> stream(new PulseAudioStream(m_context, callback));
+        stream->start(source, negotiate(found ? &native : nullptr, options), options.latency);
+        return stream;
+    }
+private:
+    // Streams keep their own reference, they may outlive the backend
+    std::shared_ptr<PulseAudioContext> m_context = std::make_shared<PulseAudioContext>();
+};
+
+namespace audio
+{
+namespace detail
+{
+    std::unique_ptr<CaptureBackend> make_pulseaudio_backend()
+    {
+        return std::unique_ptr<CaptureBackend>(new PulseAudioBackend());
+    }
+}
+}
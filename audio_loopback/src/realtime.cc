@@ -0,0 +1,27 @@
+#include "realtime.h"
+#include <memory>
+
+namespace audio
+{
+namespace detail
+{
+BufferCallback realtime_callback(BufferCallback callback, const RealtimeOptions &options,
+                                 std::shared_future<RealtimeGrant> &grant)
+{
+  if (!options.enabled)
+    return callback;
+
+  auto promise = std::make_shared<std::promise<RealtimeGrant>>();
+  grant = promise->get_future().share();
+  // Only ever touched by the delivering thread
+  auto promoted = std::make_shared<bool>(false);
+  return [callback, options, promise, promoted](const BufferView &view) {
+    if (!*promoted) {
+      *promoted = true;
+      promise->set_value(promote_current_thread(options));
+    }
+    return callback(view);
+  };
+}
+}
+}
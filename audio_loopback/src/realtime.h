@@ -0,0 +1,17 @@
+#ifndef VISUALIZER_REALTIME_H
+#define VISUALIZER_REALTIME_H
+#include <audio_loopback/loopback_recorder.h>
+#include <future>
+
+namespace audio
+{
+namespace detail
+{
+// Promotes whichever thread calls the returned callback first, before it handles its first block.
+// Returns the callback itself and leaves grant alone when realtime isn't enabled.
+BufferCallback realtime_callback(BufferCallback callback, const RealtimeOptions &options,
+                                 std::shared_future<RealtimeGrant> &grant);
+}
+}
+
+#endif //VISUALIZER_REALTIME_H
@@ -0,0 +1,182 @@
+#include "sample_convert.h"
+#include "simd.h"
+#include <cstring>
+
+namespace
+{
+const float INT16_SCALE = 1.0F / 32768.0F;
+const float INT32_SCALE = 1.0F / 2147483648.0F;
+
+template<typename T>
+T read_le(const uint8_t *data)
+{
+  T value;
+  std::memcpy(&value, data, sizeof(T));
+  return value;
+}
+
+// Scalar versions, also used for the tails the vector loops leave
+void int16_to_float(const uint8_t *in, float *out, size_t begin, size_t samples)
+{
+  for (size_t i = begin; i < samples; i++)
+    out[i] = read_le<int16_t>(in + i * 2) * INT16_SCALE;
+}
+
+void int24_to_float(const uint8_t *in, float *out, size_t begin, size_t samples)
+{
+  for (size_t i = begin; i < samples; i++) {
+    const uint8_t *sample = in + i * 3;
+    // Shift into the top of an int32 so the sign comes along
+    const int32_t value = static_cast<int32_t>((uint32_t(sample[0]) << 8) |
+                                               (uint32_t(sample[1]) << 16) |
+                                               (uint32_t(sample[2]) << 24));
+    out[i] = value * INT32_SCALE;
+  }
+}
+
+// Shift counts below 32 keep the top byte of 24 bit words out of the result
+void int32_to_float(const uint8_t *in, float *out, size_t begin, size_t samples, int shift)
+{
+  for (size_t i = begin; i < samples; i++)
+    out[i] = static_cast<int32_t>(read_le<uint32_t>(in + i * 4) << shift) * INT32_SCALE;
+}
+
+#ifdef AUDIO_SIMD_AVX2
+using audio::detail::has_avx2;
+
+AUDIO_SIMD_AVX2 size_t int16_to_float_avx2(const uint8_t *in, float *out, size_t samples)
+{
+  const __m256 scale = _mm256_set1_ps(INT16_SCALE);
+  size_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i * 2));
+    const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i * 2 + 16));
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(low)), scale));
+    _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(high)), scale));
+  }
+  return i;
+}
+
+// Eight packed samples are 24 bytes: the permute moves bytes 12..23 into the upper lane,
+// then each lane shuffles its four samples into the top three bytes of their words
+AUDIO_SIMD_AVX2 size_t int24_to_float_avx2(const uint8_t *in, float *out, size_t samples)
+{
+  const __m256 scale = _mm256_set1_ps(INT32_SCALE);
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+  const __m256i spread = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                          -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+  size_t i = 0;
+  // The 32 byte load reads 8 bytes past the samples it converts
+  for (; i + 11 <= samples; i += 8) {
+    __m256i words = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i * 3));
+    words = _mm256_shuffle_epi8(_mm256_permutevar8x32_epi32(words, lanes), spread);
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(words), scale));
+  }
+  return i;
+}
+
+AUDIO_SIMD_AVX2 size_t int32_to_float_avx2(const uint8_t *in, float *out, size_t samples, int shift)
+{
+  const __m256 scale = _mm256_set1_ps(INT32_SCALE);
+  const __m128i count = _mm_cvtsi32_si128(shift);
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    const __m256i words = _mm256_sll_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i * 4)), count);
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(words), scale));
+  }
+  return i;
+}
+#endif
+
+#ifdef AUDIO_SIMD_SSE2
+size_t int16_to_float_sse2(const uint8_t *in, float *out, size_t samples)
+{
+  const __m128 scale = _mm_set1_ps(INT16_SCALE);
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    const __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i * 2));
+    // Unpacking a word with itself and shifting back down sign extends it
+    const __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16);
+    const __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(words, words), 16);
+    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+    _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+  }
+  return i;
+}
+
+size_t int32_to_float_sse2(const uint8_t *in, float *out, size_t samples, int shift)
+{
+  const __m128 scale = _mm_set1_ps(INT32_SCALE);
+  const __m128i count = _mm_cvtsi32_si128(shift);
+  size_t i = 0;
+  for (; i + 4 <= samples; i += 4) {
+    const __m128i words = _mm_sll_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i * 4)), count);
+    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(words), scale));
+  }
+  return i;
+}
+#endif
+}
+
+namespace audio
+{
+namespace detail
+{
+size_t bytes_per_sample(SampleFormat format)
+{
+  switch (format) {
+    case SampleFormat::int16:
+      return 2;
+    case SampleFormat::int24:
+      return 3;
+    case SampleFormat::float32:
+    case SampleFormat::int24_32:
+    case SampleFormat::int32:
+      break;
+  }
+  return 4;
+}
+
+void convert_to_float(SampleFormat format, const void *in, float *out, size_t samples)
+{
+  const uint8_t *bytes = static_cast<const uint8_t *>(in);
+  size_t done = 0;
+  switch (format) {
+    case SampleFormat::float32:
+      std::memcpy(out, in, samples * sizeof(float));
+      break;
+    case SampleFormat::int16:
+#ifdef AUDIO_SIMD_AVX2
+      if (has_avx2())
+        done = int16_to_float_avx2(bytes, out, samples);
+#endif
+#ifdef AUDIO_SIMD_SSE2
+      done += int16_to_float_sse2(bytes + done * 2, out + done, samples - done);
+#endif
+      int16_to_float(bytes, out, done, samples);
+      break;
+    case SampleFormat::int24:
+      // Packed triplets need a byte shuffle, which SSE2 doesn't have
+#ifdef AUDIO_SIMD_AVX2
+      if (has_avx2())
+        done = int24_to_float_avx2(bytes, out, samples);
+#endif
+      int24_to_float(bytes, out, done, samples);
+      break;
+    case SampleFormat::int24_32:
+    case SampleFormat::int32: {
+      const int shift = format == SampleFormat::int24_32 ? 8 : 0;
+#ifdef AUDIO_SIMD_AVX2
+      if (has_avx2())
+        done = int32_to_float_avx2(bytes, out, samples, shift);
+#endif
+#ifdef AUDIO_SIMD_SSE2
+      done += int32_to_float_sse2(bytes + done * 4, out + done, samples - done, shift);
+#endif
+      int32_to_float(bytes, out, done, samples, shift);
+      break;
+    }
+  }
+}
+}
+}
@@ -0,0 +1,17 @@
+#ifndef VISUALIZER_SAMPLE_CONVERT_H
+#define VISUALIZER_SAMPLE_CONVERT_H
+#include <audio_loopback/loopback_recorder.h>
+#include <cstddef>
+
+namespace audio
+{
+namespace detail
+{
+size_t bytes_per_sample(SampleFormat format);
+
+// Converts little endian samples to floats in [-1, 1), the input needs no particular alignment
+void convert_to_float(SampleFormat format, const void *in, float *out, size_t samples);
+}
+}
+
+#endif //VISUALIZER_SAMPLE_CONVERT_H
@@ -0,0 +1,327 @@
+#include "block_source.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define GENERATOR_SSE2
+#endif
+
+namespace
+{
+    const float TWO_PI = 6.283185307179586F;
+    const float AMPLITUDE = 0.5F;
+    // Phases are rebased in double precision every chunk, so the float offsets within one stay exact
+    const uint32_t CHUNK = 64;
+
+    // sin(2*pi*x) for x >= 0, accurate to about 1e-5 over the phases used here
+    inline float sin_cycles(float x)
+    {
+        x -= static_cast<float>(static_cast<int32_t>(x + 0.5F));
+        const float folded = std::copysign(std::min(std::fabs(x), 0.5F - std::fabs(x)), x);
+        const float y = folded * TWO_PI;
+        const float y2 = y * y;
+        return y * (1.0F + y2 * (-1.0F / 6 + y2 * (1.0F / 120 + y2 * (-1.0F / 5040 +
+                    y2 * (1.0F / 362880 + y2 * (-1.0F / 39916800))))));
+    }
+
+    // out[i] += amplitude * sin(2*pi*phase[i]), four lanes at a time
+    void add_sines(const float *phase, float amplitude, float *out, uint32_t count)
+    {
+        uint32_t i = 0;
+#ifdef GENERATOR_SSE2
+        const __m128 sign_mask = _mm_set1_ps(-0.0F);
+        const __m128 half = _mm_set1_ps(0.5F);
+        const __m128 two_pi = _mm_set1_ps(TWO_PI);
+        const __m128 scale = _mm_set1_ps(amplitude);
+        for (; i + 4 <= count; i += 4) {
+            __m128 x = _mm_loadu_ps(phase + i);
+            x = _mm_sub_ps(x, _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_add_ps(x, half))));
+            const __m128 sign = _mm_and_ps(x, sign_mask);
+            const __m128 magnitude = _mm_andnot_ps(sign_mask, x);
+            const __m128 folded = _mm_or_ps(_mm_min_ps(magnitude, _mm_sub_ps(half, magnitude)), sign);
+            const __m128 y = _mm_mul_ps(folded, two_pi);
+            const __m128 y2 = _mm_mul_ps(y, y);
+            __m128 poly = _mm_set1_ps(-1.0F / 39916800);
+            poly = _mm_add_ps(_mm_mul_ps(poly, y2), _mm_set1_ps(1.0F / 362880));
+            poly = _mm_add_ps(_mm_mul_ps(poly, y2), _mm_set1_ps(-1.0F / 5040));
+            poly = _mm_add_ps(_mm_mul_ps(poly, y2), _mm_set1_ps(1.0F / 120));
+            poly = _mm_add_ps(_mm_mul_ps(poly, y2), _mm_set1_ps(-1.0F / 6));
+            poly = _mm_add_ps(_mm_mul_ps(poly, y2), _mm_set1_ps(1.0F));
+            const __m128 result = _mm_mul_ps(_mm_mul_ps(y, poly), scale);
+            _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), result));
+        }
+#endif
+        for (; i < count; i++)
+            out[i] += amplitude * sin_cycles(phase[i]);
+    }
+
+    // Uniform noise in [-1, 1) from four independent xorshift32 generators
+    void white_noise(uint32_t state[4], float *out, uint32_t count)
+    {
+        const float scale = 1.0F / 2147483648.0F;
+        uint32_t i = 0;
+#ifdef GENERATOR_SSE2
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(state));
+        for (; i + 4 <= count; i += 4) {
+            s = _mm_xor_si128(s, _mm_slli_epi32(s, 13));
+            s = _mm_xor_si128(s, _mm_srli_epi32(s, 17));
+            s = _mm_xor_si128(s, _mm_slli_epi32(s, 5));
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(s), _mm_set1_ps(scale)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(state), s);
+#endif
+        for (; i < count; i++) {
+            uint32_t &lane = state[i % 4];
+            lane ^= lane << 13;
+            lane ^= lane >> 17;
+            lane ^= lane << 5;
+            out[i] = static_cast<int32_t>(lane) * scale;
+        }
+    }
+
+    std::vector<double> parse_numbers(const std::string &text)
+    {
+        std::vector<double> numbers;
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, ','))
+            numbers.push_back(std::atof(item.c_str()));
+        return numbers;
+    }
+}
+
+// Test signals at any rate and channel count. The device id picks the signal:
+//   sine:440[,660,...]          one or more summed tones
+//   sweep:20,20000,10           log sweep from 20 Hz to 20 kHz every 10 s
+//   white, pink                 independent noise per channel
+//   impulse:0.5                 a full scale impulse every 0.5 s
+//   silence
+//   dropout:440,1,0.1           a tone that goes silent for the last 0.1 s of every second
+class SignalGenerator : public audio::detail::BlockSource
+{
+public:
+    SignalGenerator(const std::string &spec, audio::StreamFormat format)
+        : m_format(format)
+    {
+        const auto separator = spec.find(':');
+        m_kind = spec.substr(0, separator);
+        const auto params = separator == std::string::npos ? std::vector<double>() : parse_numbers(spec.substr(separator + 1));
+        const double rate = m_format.sample_rate;
+
+        if (m_kind == "sine" || m_kind == "dropout") {
+            if (params.empty())
+                throw std::runtime_error("generator: " + m_kind + " needs a frequency");
+            const size_t tones = m_kind == "sine" ? params.size() : 1;
+            for (size_t i = 0; i < tones; i++)
+                m_tones.push_back(Tone{0.0, params[i] / rate});
+            if (m_kind == "dropout") {
+                m_period_frames = static_cast<uint64_t>((params.size() > 1 ? params[1] : 1.0) * rate);
+                m_gap_frames = static_cast<uint64_t>((params.size() > 2 ? params[2] : 0.1) * rate);
+            }
+        }
+        else if (m_kind == "sweep") {
+            const double start = params.size() > 0 ? params[0] : 20.0;
+            const double end = params.size() > 1 ? params[1] : 20000.0;
+            m_period_frames = std::max<uint64_t>(1, static_cast<uint64_t>((params.size() > 2 ? params[2] : 10.0) * rate));
+            m_sweep_start = start / rate;
+            // Every sample multiplies the frequency by ratio, tabulate the powers once per chunk offset
+            const double ratio = std::pow(end / start, 1.0 / m_period_frames);
+            double power = 1.0;
+            double sum = 0.0;
+            for (uint32_t i = 0; i <= CHUNK; i++) {
+                m_sweep_phase_offsets[i] = static_cast<float>(sum);
+                sum += power;
+                power *= ratio;
+            }
+            m_sweep_chunk_ratio = std::pow(ratio, CHUNK);
+            m_tones.push_back(Tone{0.0, m_sweep_start});
+        }
+        else if (m_kind == "impulse") {
+            m_period_frames = std::max<uint64_t>(1, static_cast<uint64_t>((params.empty() ? 1.0 : params[0]) * rate));
+        }
+        else if (m_kind == "white" || m_kind == "pink") {
+            m_noise.resize(m_format.channels);
+            uint32_t seed = 0x9E3779B9;
+            for (auto &noise : m_noise) {
+                for (auto &lane : noise.state) {
+                    seed = seed * 1664525 + 1013904223;
+                    lane = seed | 1;
+                }
+            }
+        }
+        else if (m_kind != "silence") {
+            throw std::runtime_error("generator: unknown signal " + spec);
+        }
+    }
+
+    audio::StreamFormat format() const override
+    {
+        return m_format;
+    }
+
+    bool next(audio::BufferView &view, uint32_t max_frames) override
+    {
+        m_plane.resize(std::max<size_t>(m_plane.size(), max_frames));
+        m_out.resize(std::max<size_t>(m_out.size(), size_t(max_frames) * m_format.channels));
+
+        if (m_kind == "white" || m_kind == "pink") {
+            for (uint32_t channel = 0; channel < m_format.channels; channel++) {
+                generate_noise(m_noise[channel], max_frames);
+                interleave(channel, max_frames);
+            }
+        }
+        else {
+            generate(max_frames);
+            for (uint32_t channel = 0; channel < m_format.channels; channel++)
+                interleave(channel, max_frames);
+        }
+
+        m_frame += max_frames;
+        view = audio::BufferView{m_out.data(), max_frames, m_format, 0, audio::BlockTiming()};
+        return true;
+    }
+private:
+    struct Tone
+    {
+        double phase;
+        double increment;
+    };
+
+    struct Noise
+    {
+        uint32_t state[4];
+        // Paul Kellet's pink filter
+        float b[7] = {};
+    };
+
+    void generate(uint32_t frames)
+    {
+        float *plane = m_plane.data();
+        std::fill(plane, plane + frames, 0.0F);
+        const float amplitude = m_tones.empty() ? 0.0F : AMPLITUDE / m_tones.size();
+
+        for (auto &tone : m_tones) {
+            for (uint32_t start = 0; start < frames; start += CHUNK) {
+                const uint32_t count = std::min(CHUNK, frames - start);
+                const float base = static_cast<float>(tone.phase);
+                if (m_kind == "sweep") {
+                    for (uint32_t i = 0; i < count; i++)
+                        m_phases[i] = base + static_cast<float>(tone.increment) * m_sweep_phase_offsets[i];
+                    tone.phase += tone.increment * m_sweep_phase_offsets[count];
+                    tone.increment *= count == CHUNK ? m_sweep_chunk_ratio : std::pow(m_sweep_chunk_ratio, double(count) / CHUNK);
+                    if ((m_frame + start + count) % m_period_frames < count)
+                        tone.increment = m_sweep_start;
+                }
+                else {
+                    for (uint32_t i = 0; i < count; i++)
+                        m_phases[i] = base + static_cast<float>(tone.increment) * i;
+                    tone.phase += tone.increment * count;
+                }
+                tone.phase -= std::floor(tone.phase);
+                add_sines(m_phases, amplitude, plane + start, count);
+            }
+        }
+
+        if (m_kind == "impulse") {
+            for (uint32_t i = 0; i < frames; i++)
+                plane[i] = (m_frame + i) % m_period_frames == 0 ? 1.0F : 0.0F;
+        }
+        else if (m_kind == "dropout") {
+            for (uint32_t i = 0; i < frames; i++)
+                if ((m_frame + i) % m_period_frames >= m_period_frames - m_gap_frames)
+                    plane[i] = 0.0F;
+        }
+    }
+
+    void generate_noise(Noise &noise, uint32_t frames)
+    {
+        float *plane = m_plane.data();
+        white_noise(noise.state, plane, frames);
+        if (m_kind != "pink")
+            return;
+
+        float *b = noise.b;
+        for (uint32_t i = 0; i < frames; i++) {
+            const float white = plane[i];
+            b[0] = 0.99886F * b[0] + white * 0.0555179F;
+            b[1] = 0.99332F * b[1] + white * 0.0750759F;
+            b[2] = 0.96900F * b[2] + white * 0.1538520F;
+            b[3] = 0.86650F * b[3] + white * 0.3104856F;
+            b[4] = 0.55000F * b[4] + white * 0.5329522F;
+            b[5] = -0.7616F * b[5] - white * 0.0168980F;
+            plane[i] = (b[0] + b[1] + b[2] + b[3] + b[4] + b[5] + b[6] + white * 0.5362F) * 0.11F;
+            b[6] = white * 0.115926F;
+        }
+    }
+
+    void interleave(uint32_t channel, uint32_t frames)
+    {
+        const uint32_t channels = m_format.channels;
+        float *out = m_out.data() + channel;
+        for (uint32_t i = 0; i < frames; i++)
+            out[i * channels] = m_plane[i];
+    }
+
+    audio::StreamFormat m_format;
+    std::string m_kind;
+    uint64_t m_frame = 0;
+    std::vector<Tone> m_tones;
+    std::vector<Noise> m_noise;
+    uint64_t m_period_frames = 1;
+    uint64_t m_gap_frames = 0;
+    double m_sweep_start = 0.0;
+    double m_sweep_chunk_ratio = 1.0;
+    float m_sweep_phase_offsets[CHUNK + 1] = {};
+    float m_phases[CHUNK];
+    std::vector<float> m_plane;
+    std::vector<float> m_out;
+};
+
+// Sinks of this backend are signal descriptions, see SignalGenerator
+class GeneratorBackend : public audio::detail::SourceBackend
+{
+public:
+    std::vector<audio::AudioSinkInfo> list_sinks() override
+    {
+        return {audio::AudioSinkInfo{"440 Hz sine", "sine:440", false},
+                audio::AudioSinkInfo{"Log sweep", "sweep:20,20000,10", false},
+                audio::AudioSinkInfo{"White noise", "white", false},
+                audio::AudioSinkInfo{"Pink noise", "pink", false},
+                audio::AudioSinkInfo{"Impulses", "impulse:0.5", false},
+                audio::AudioSinkInfo{"Tone with dropouts", "dropout:440,1,0.1", false},
+                audio::AudioSinkInfo{"Silence", "silence", false}};
+    }
+
+    audio::AudioSinkInfo get_default_sink(bool capture) override
+    {
+        return audio::AudioSinkInfo{"440 Hz sine", "sine:440", capture};
+    }
+
+    std::unique_ptr<audio::detail::BlockSource> open_source(const audio::AudioSinkInfo &sink,
+                                                            const audio::CaptureOptions &options) override
+    {
+        audio::StreamFormat format = options.format;
+        if (format.sample_rate == 0)
+            format.sample_rate = 48000;
+        if (format.channels == 0)
+            format.channels = 2;
+
+        return std::unique_ptr<audio::detail::BlockSource>(
+            new SignalGenerator(sink.device_id.empty() ? "sine:440" : sink.device_id, format));
+    }
+};
+
+namespace audio
+{
+namespace detail
+{
+    std::unique_ptr<CaptureBackend> make_generator_backend()
+    {
+        return std::unique_ptr<CaptureBackend>(new GeneratorBackend());
+    }
+}
+}
@@ -0,0 +1,37 @@
+#ifndef VISUALIZER_SIMD_H
+#define VISUALIZER_SIMD_H
+
+// SSE2 is part of x86-64, AVX2 kernels are compiled for it whatever the target
+// and only called once has_avx2() says the cpu runs them
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define AUDIO_SIMD_SSE2
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define AUDIO_SIMD_AVX2 __attribute__((target("avx2")))
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define AUDIO_SIMD_AVX2
+#endif
+
+namespace audio
+{
+namespace detail
+{
+#ifdef AUDIO_SIMD_AVX2
+inline bool has_avx2()
+{
+#if defined(__GNUC__)
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+#else
+  // MSVC only defines __AVX2__ when the whole build targets it
+  return true;
+#endif
+}
+#endif
+}
+}
+
+#endif //VISUALIZER_SIMD_H
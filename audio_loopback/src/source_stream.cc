@@ -0,0 +1,143 @@
+#include "block_source.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+// How often a paused stream checks whether it was resumed or stopped
+const std::chrono::milliseconds PAUSE_POLL{5};
+}
+
+namespace audio
+{
+namespace detail
+{
+std::unique_ptr<BlockSource> CaptureBackend::open_source(const AudioSinkInfo &, const CaptureOptions &)
+{
+  return nullptr;
+}
+
+StreamInfo CaptureBackend::capture_data(BufferCallback callback, const AudioSinkInfo &sink, const CaptureOptions &options)
+{
+  auto stream = open_stream(callback, sink, options);
+  auto info = stream->info();
+  m_detached.push_back(std::move(stream));
+  return info;
+}
+
+uint32_t block_frames(const CaptureOptions &options, StreamFormat format)
+{
+  uint32_t frames = options.period_frames;
+  if (frames == 0)
+    frames = static_cast<uint32_t>(options.latency.count() * format.sample_rate / 1000000);
+  return std::max<uint32_t>(frames, 1);
+}
+
+SourceStream::SourceStream(std::unique_ptr<BlockSource> source, BufferCallback callback)
+    : m_source(std::move(source)), m_callback(callback)
+{
+}
+
+SourceStream::~SourceStream()
+{
+  m_running = false;
+  if (m_thread.joinable())
+    m_thread.join();
+}
+
+StreamInfo SourceStream::start(const CaptureOptions &options)
+{
+  const StreamFormat format = m_source->format();
+  const uint32_t frames = block_frames(options, format);
+  // Sources with a descriptor are paced by whoever writes to it, sleeping on top would only fall behind
+  const Pacing pacing = m_source->poll_fd() >= 0 ? Pacing::unthrottled : options.pacing;
+
+  m_info.format = format;
+  m_info.fragment_frames = frames;
+  m_info.sample_format = m_source->sample_format();
+  m_info.latency = std::chrono::microseconds(uint64_t(frames) * 1000000 / format.sample_rate);
+
+  m_block_frames = frames;
+  m_running = true;
+  m_thread = std::thread([this, pacing] { run(pacing); });
+  return m_info;
+}
+
+StreamInfo SourceStream::info() const
+{
+  return m_info;
+}
+
+bool SourceStream::set_paused(bool paused)
+{
+  m_paused = paused;
+  return true;
+}
+
+// Takes effect with the next block, pacing follows the frames actually delivered
+bool SourceStream::set_block_frames(uint32_t frames)
+{
+  m_block_frames = std::max<uint32_t>(frames, 1);
+  m_info.fragment_frames = m_block_frames;
+  m_info.latency = std::chrono::microseconds(uint64_t(m_block_frames) * 1000000 / m_info.format.sample_rate);
+  return true;
+}
+
+uint64_t SourceStream::errors() const
+{
+  return m_source->errors();
+}
+
+void SourceStream::run(Pacing pacing)
+{
+  const StreamFormat format = m_source->format();
+  // Pacing restarts after a pause instead of catching up on it
+  auto paced_from = std::chrono::steady_clock::now();
+  uint64_t paced = 0;
+
+  BufferView view;
+  BlockClock clock;
+  bool capturing = true;
+  bool was_paused = false;
+  while (m_running && capturing && !m_source->finished()) {
+    if (m_paused) {
+      was_paused = true;
+      std::this_thread::sleep_for(PAUSE_POLL);
+      continue;
+    }
+    if (was_paused) {
+      was_paused = false;
+      clock.mark(BUFFER_GAP);
+      paced_from = std::chrono::steady_clock::now();
+      paced = 0;
+    }
+
+    if (!m_source->next(view, m_block_frames.load(std::memory_order_relaxed)))
+      continue;
+    // Lost frames took their time on the device too, positions and pacing both count them
+    if (const uint64_t lost = m_source->lost_frames()) {
+      clock.skip(lost);
+      paced += lost;
+    }
+    clock.stamp_queued(view, m_source->queued_frames());
+    capturing = m_callback(view);
+    paced += view.frames;
+
+    // Deadlines are derived from the total delivered, so rounding never accumulates into drift
+    if (pacing == Pacing::realtime)
+      std::this_thread::sleep_until(paced_from + std::chrono::microseconds(paced * 1000000 / format.sample_rate));
+  }
+}
+
+std::unique_ptr<CaptureStream> SourceBackend::open_stream(BufferCallback callback, const AudioSinkInfo &sink,
+                                                          const CaptureOptions &options)
+{
+  auto source = open_source(sink, options);
+  if (!source)
+    throw std::runtime_error("could not open " + sink.device_id);
+  std::unique_ptr<SourceStream> stream(new SourceStream(std::move(source), callback));
+  stream->start(options);
+  return stream;
+}
+}
+}
@@ -0,0 +1,186 @@
+#include "block_source.h"
+#include "sample_convert.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    const uint16_t WAVE_FORMAT_PCM = 0x0001;
+    const uint16_t WAVE_FORMAT_IEEE_FLOAT = 0x0003;
+    const uint16_t WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+    template<typename T>
+    T read_le(const uint8_t *data)
+    {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        return value;
+    }
+}
+
+// Replays the data chunk of a mapped WAV file. Float files are delivered straight out of the
+// mapping, integer files are converted into a buffer that is reused between blocks.
+class WavFileSource : public audio::detail::BlockSource
+{
+public:
+    explicit WavFileSource(const std::string &path)
+    {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("could not open " + path);
+        struct stat file_stat;
+        fstat(fd, &file_stat);
+        m_size = static_cast<size_t>(file_stat.st_size);
+        void *mapping = m_size > 0 ? mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        close(fd);
+        if (mapping == MAP_FAILED)
+            throw std::runtime_error("could not map " + path);
+        m_mapping = static_cast<const uint8_t *>(mapping);
+        madvise(mapping, m_size, MADV_SEQUENTIAL);
+
+        parse(path);
+    }
+
+    ~WavFileSource() override
+    {
+        munmap(const_cast<uint8_t *>(m_mapping), m_size);
+    }
+
+    audio::StreamFormat format() const override
+    {
+        return m_format;
+    }
+
+    audio::SampleFormat sample_format() const override
+    {
+        return m_encoding;
+    }
+
+    bool next(audio::BufferView &view, uint32_t max_frames) override
+    {
+        const size_t frames = std::min<size_t>(max_frames, m_total_frames - m_position);
+        if (frames == 0)
+            return false;
+
+        const uint8_t *block = m_data + m_position * m_frame_bytes;
+        view = audio::BufferView{convert(block, frames), static_cast<uint32_t>(frames), m_format, 0, audio::BlockTiming()};
+        m_position += frames;
+        return true;
+    }
+
+    bool finished() const override
+    {
+        return m_position == m_total_frames;
+    }
+private:
+    void parse(const std::string &path)
+    {
+        if (m_size < 12 || std::memcmp(m_mapping, "RIFF", 4) != 0 || std::memcmp(m_mapping + 8, "WAVE", 4) != 0)
+            throw std::runtime_error(path + " is not a wav file");
+
+        bool have_format = false;
+        uint16_t tag = 0;
+        uint16_t bits = 0;
+        for (size_t offset = 12; offset + 8 <= m_size;) {
+            const uint8_t *chunk = m_mapping + offset;
+            const size_t chunk_size = std::min<size_t>(read_le<uint32_t>(chunk + 4), m_size - offset - 8);
+
+            if (std::memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16) {
+                tag = read_le<uint16_t>(chunk + 8);
+                m_format.channels = read_le<uint16_t>(chunk + 10);
+                m_format.sample_rate = read_le<uint32_t>(chunk + 12);
+                bits = read_le<uint16_t>(chunk + 22);
+                // The real format tag of an extensible file is the start of the sub format guid
+                if (tag == WAVE_FORMAT_EXTENSIBLE && chunk_size >= 40)
+                    tag = read_le<uint16_t>(chunk + 32);
+                have_format = true;
+            }
+            else if (std::memcmp(chunk, "data", 4) == 0) {
+                m_data = chunk + 8;
+                m_data_bytes = chunk_size;
+            }
+            // Chunks are padded to an even size
+            offset += 8 + chunk_size + (chunk_size & 1);
+        }
+
+        if (!have_format || m_data == nullptr || m_format.channels == 0 || m_format.sample_rate == 0)
+            throw std::runtime_error(path + " has no usable fmt or data chunk");
+
+        if (tag == WAVE_FORMAT_IEEE_FLOAT && bits == 32)
+            m_encoding = audio::SampleFormat::float32;
+        else if (tag == WAVE_FORMAT_PCM && bits == 16)
+            m_encoding = audio::SampleFormat::int16;
+        else if (tag == WAVE_FORMAT_PCM && bits == 24)
+            m_encoding = audio::SampleFormat::int24;
+        else
+            throw std::runtime_error(path + ": only float32, int16 and int24 pcm is supported");
+
+        m_frame_bytes = m_format.channels * (bits / 8);
+        m_total_frames = m_data_bytes / m_frame_bytes;
+        // The mapping is page aligned, so the data chunk offset decides if floats can be read in place
+        m_zero_copy = m_encoding == audio::SampleFormat::float32 && (m_data - m_mapping) % alignof(float) == 0;
+    }
+
+    const float *convert(const uint8_t *block, size_t frames)
+    {
+        if (m_zero_copy)
+            return reinterpret_cast<const float *>(block);
+
+        const size_t samples = frames * m_format.channels;
+        m_converted.resize(std::max(m_converted.size(), samples));
+        audio::detail::convert_to_float(m_encoding, block, m_converted.data(), samples);
+        return m_converted.data();
+    }
+
+    const uint8_t *m_mapping = nullptr;
+    size_t m_size = 0;
+    const uint8_t *m_data = nullptr;
+    size_t m_data_bytes = 0;
+    size_t m_frame_bytes = 0;
+    size_t m_total_frames = 0;
+    size_t m_position = 0;
+    audio::SampleFormat m_encoding = audio::SampleFormat::float32;
+    bool m_zero_copy = false;
+    audio::StreamFormat m_format{0, 0};
+    std::vector<float> m_converted;
+};
+
+// Sinks of this backend are wav files, the device id is the path
+class FileBackend : public audio::detail::SourceBackend
+{
+public:
+    std::vector<audio::AudioSinkInfo> list_sinks() override
+    {
+        return {};
+    }
+
+    audio::AudioSinkInfo get_default_sink(bool capture) override
+    {
+        return audio::AudioSinkInfo{"file", "", capture};
+    }
+
+    std::unique_ptr<audio::detail::BlockSource> open_source(const audio::AudioSinkInfo &sink,
+                                                            const audio::CaptureOptions &) override
+    {
+        if (sink.device_id.empty())
+            throw std::runtime_error("the file backend needs a wav file path as device id");
+        return std::unique_ptr<audio::detail::BlockSource>(new WavFileSource(sink.device_id));
+    }
+};
+
+namespace audio
+{
+namespace detail
+{
+    std::unique_ptr<CaptureBackend> make_file_backend()
+    {
+        return std::unique_ptr<CaptureBackend>(new FileBackend());
+    }
+}
+}
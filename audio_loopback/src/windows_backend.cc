@@ -1,4 +1,6 @@
 #include <audio_loopback/loopback_recorder.h>
+#include "block_clock.h"
+#include "capture_stream.h"
 
 #include <mmdeviceapi.h>
 #include <assert.h>
@@ -7,10 +9,13 @@
 #include <iostream>
 #include <functiondiscoverykeys_devpkey.h>
 #include <algorithm>
+#include <atomic>
 #include <Audioclient.h>
 #include <chrono>
 #include <thread>
 #include <numeric>
+#include <future>
+#include <stdexcept>
 
 
 namespace
@@ -75,7 +80,9 @@ public:
     {
     }
 
-    void start_capture(CaptureCallback callback, AudioBuffer &buffer)
+    // Captures until the callback returns false or running is cleared
+    void start_capture(BufferCallback callback, std::chrono::microseconds latency, std::promise<StreamInfo> &started,
+                       const std::atomic<bool> &running)
     {
       IAudioClient *audioClient;
       m_device->Activate(MY_IID_IAudioClient, CLSCTX_INPROC_SERVER, NULL, reinterpret_cast<void **>(&audioClient));
@@ -87,15 +94,17 @@ public:
 
       WAVEFORMATEXTENSIBLE *format_ex = reinterpret_cast<WAVEFORMATEXTENSIBLE *>(format);
       std::cout << std::hex << format_ex->SubFormat.Data1 << std::dec << std::endl;
+      const StreamFormat stream_format{format->nSamplesPerSec, format->nChannels};
 
-      const REFERENCE_TIME ten_ms_in_hns = 10 * (10000);
+      // REFERENCE_TIME is in 100ns units
+      const REFERENCE_TIME buffer_duration = latency.count() * 10;
       // Must be 0 in shared mode
       const REFERENCE_TIME periodicity = 0;
       // Set the loopback flag if we are not using a capture device
       const DWORD stream_flags = m_capture ? 0 : AUDCLNT_STREAMFLAGS_LOOPBACK;
       auto hr = audioClient->Initialize(AUDCLNT_SHAREMODE_SHARED,
                                         stream_flags,
-                                        ten_ms_in_hns,
+                                        buffer_duration,
                                         periodicity,
                                         format,
                                         nullptr);
@@ -104,41 +113,60 @@ public:
       std::cout << frames << std::endl;
 
       assert(SUCCEEDED(hr));
+      started.set_value(StreamInfo{stream_format,
+                                   std::chrono::microseconds(uint64_t(frames) * 1000000 / stream_format.sample_rate),
+                                   frames});
 
 
       IAudioCaptureClient *captureClient;
       audioClient->GetService(__uuidof(IAudioCaptureClient), reinterpret_cast<void **>(&captureClient));
       audioClient->Start();
+      detail::BlockClock clock;
+      LARGE_INTEGER qpc_frequency;
+      QueryPerformanceFrequency(&qpc_frequency);
       bool keep_capturing = true;
-      while (keep_capturing) {
+      while (keep_capturing && running) {
         // Really short sleep to reduce CPU load of this thread,
         // might be able to increase it but want to keep latency minimal too.
         std::this_thread::sleep_for(std::chrono::microseconds(1));
-        std::vector<StereoPacket> audio_copy;
         uint32_t packet_size;
         do {
           DWORD flags;
           uint32_t num_frames_in_buffer;
 
           captureClient->GetNextPacketSize(&packet_size);
-          audio_copy.resize(packet_size);
-
-          StereoPacket *audio_capture_buffer;
-          captureClient->GetBuffer(reinterpret_cast<uint8_t **>(&audio_capture_buffer),
-                                   &num_frames_in_buffer,
-                                   &flags,
-                                   nullptr,
-                                   nullptr);
-          for (int i = 0; i < packet_size; i++) {
-            audio_copy[i] = audio_capture_buffer[i];
+
+          float *audio_capture_buffer;
+          // Performance counter time the first frame of the packet was recorded, in 100 ns units
+          UINT64 qpc_position = 0;
+          hr = captureClient->GetBuffer(reinterpret_cast<uint8_t **>(&audio_capture_buffer),
+                                        &num_frames_in_buffer,
+                                        &flags,
+                                        nullptr,
+                                        &qpc_position);
+          // Nothing to release, whatever the packet held is missing in front of the next one
+          if (FAILED(hr)) {
+            clock.mark(BUFFER_GAP);
+            break;
           }
-          captureClient->ReleaseBuffer(packet_size);
-          if (audio_copy.size() > 0 && packet_size > 0) {
-            keep_capturing = callback(audio_copy);
+          // Hand out the shared mode buffer directly, it stays valid until ReleaseBuffer
+          if (packet_size > 0) {
+            const uint32_t buffer_flags = (flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY) ? BUFFER_XRUN : 0;
+            BufferView view{audio_capture_buffer, packet_size, stream_format, buffer_flags};
+            LARGE_INTEGER qpc_now;
+            QueryPerformanceCounter(&qpc_now);
+            const int64_t now = int64_t(qpc_now.QuadPart * 10000000.0 / qpc_frequency.QuadPart);
+            const bool timed = (flags & AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR) == 0 && qpc_position != 0;
+            clock.stamp(view, std::chrono::microseconds(timed ? (now - int64_t(qpc_position)) / 10 : 0));
+            keep_capturing = callback(view);
           }
+          captureClient->ReleaseBuffer(packet_size);
         }
         while (packet_size != 0);
       }
+      audioClient->Stop();
+      captureClient->Release();
+      audioClient->Release();
     }
 
     operator AudioSinkInfo()
@@ -264,32 +292,52 @@ AudioSinkInfo get_default_sink(bool capture)
     return enumerator.get_default();
 };
 
-class DataCapture
+class DataCapture : public detail::CaptureStream
 {
 public:
-    DataCapture(std::shared_ptr<Device> dev, CaptureCallback callback)
+    DataCapture(std::shared_ptr<Device> dev, BufferCallback callback, const CaptureOptions &options)
         :
         m_capturedevice(dev),
-        m_callback(callback)
+        m_callback(callback),
+        m_options(options)
     {
     };
-    void start_capture()
+    ~DataCapture() override
+    {
+      m_running = false;
+      if (m_capturethread.joinable())
+        m_capturethread.join();
+    }
+
+    // Returns once the device is initialized and capturing
+    StreamInfo start_capture()
     {
+      auto started = m_started.get_future();
       m_capturethread = std::thread([this]
-                                    { m_capturedevice->start_capture(m_callback, m_captureBuffer); });
-      m_capturethread.detach();
+                                    { m_capturedevice->start_capture(m_callback, m_options.latency, m_started, m_running); });
+      m_info = started.get();
+      return m_info;
+    }
+
+    StreamInfo info() const override
+    {
+      return m_info;
     }
 
 private:
     std::shared_ptr<Device> m_capturedevice;
     std::thread m_capturethread;
-    AudioBuffer m_captureBuffer;
-    CaptureCallback m_callback;
+    BufferCallback m_callback;
+    CaptureOptions m_options;
+    std::promise<StreamInfo> m_started;
+    StreamInfo m_info;
+    std::atomic<bool> m_running{true};
 };
 
-std::vector<std::shared_ptr<DataCapture>> active_devices;
-
-void capture_data(CaptureCallback callback, const AudioSinkInfo &sink)
+namespace detail
+{
+std::unique_ptr<CaptureStream> open_stream(BufferCallback callback, const AudioSinkInfo &sink,
+                                           const CaptureOptions &options)
 {
   DeviceEnumerator enumerator;
     std::cout << sink.name << " searching" << std::endl;
@@ -303,11 +351,27 @@ void capture_data(CaptureCallback callback, const AudioSinkInfo &sink)
 
   if (device != devices.end()) {
     std::cout << sink.name << " found" << std::endl;
-    std::shared_ptr<Device> device_ptr = *device;
-    auto capture = std::make_shared<DataCapture>(device_ptr, callback);
-    active_devices.push_back(capture);
+    std::unique_ptr<DataCapture> capture(new DataCapture(*device, callback, options));
     capture->start_capture();
+    return std::move(capture);
   }
+  throw std::runtime_error("could not find " + sink.name);
+}
+
+// Only one backend, selecting it never stops anything
+void stop_detached_sessions()
+{
+}
+}
+
+std::vector<std::string> available_backends()
+{
+  return {"wasapi"};
+}
+
+bool select_backend(const std::string &name)
+{
+  return name == "wasapi";
 }
 
 std::vector<AudioSinkInfo> list_sinks()
@@ -0,0 +1,36 @@
+#include <audio_loopback/loopback_recorder.h>
+#include <windows.h>
+#include <malloc.h>
+
+namespace
+{
+// _alloca already probes every page from the top down, the guard page needs the stack to grow that way
+__declspec(noinline) bool prefault_stack(size_t bytes)
+{
+  volatile unsigned char *stack = static_cast<volatile unsigned char *>(_alloca(bytes));
+  stack[0] = 0;
+  return true;
+}
+}
+
+namespace audio
+{
+// Windows has no SCHED_FIFO, the closest is the time critical priority of the current priority class.
+// Locking every page isn't possible without growing the working set first, so it is never granted here.
+RealtimeGrant promote_current_thread(const RealtimeOptions &options)
+{
+  RealtimeGrant grant;
+  if (!options.enabled)
+    return grant;
+
+  if (options.cpu >= 0 && options.cpu < 64)
+    grant.pinned = SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << options.cpu) != 0;
+  if (options.priority > 0)
+    grant.scheduling = SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+  // The default stack is 1 MiB, stay well inside it
+  if (options.prefault_stack_bytes > 0)
+    grant.stack_prefaulted = prefault_stack(options.prefault_stack_bytes < 512 * 1024 ? options.prefault_stack_bytes
+                                                                                      : 512 * 1024);
+  return grant;
+}
+}
@@ -0,0 +1,112 @@
+#include "check.h"
+#include <audio_loopback/loopback_recorder.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+
+// The capture path reuses its buffers, so once the first block is out nothing on the capture thread
+// allocates any more. Every allocation is counted per thread by replacing the global operator new.
+namespace
+{
+thread_local std::uint64_t allocations = 0;
+}
+
+void *operator new(std::size_t size)
+{
+  allocations++;
+  if (void *block = std::malloc(size != 0 ? size : 1))
+    return block;
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void *block) noexcept
+{
+  std::free(block);
+}
+
+void operator delete[](void *block) noexcept
+{
+  std::free(block);
+}
+
+void operator delete(void *block, std::size_t) noexcept
+{
+  std::free(block);
+}
+
+void operator delete[](void *block, std::size_t) noexcept
+{
+  std::free(block);
+}
+
+namespace
+{
+const std::uint32_t BLOCKS = 500;
+
+struct Run
+{
+  std::mutex mutex;
+  std::condition_variable done;
+  std::uint32_t blocks = 0;
+  std::uint64_t after_first = 0;
+  std::uint64_t allocated = 0;
+  bool finished = false;
+};
+
+// Captures BLOCKS blocks of the signal and returns how often the capture thread allocated after the first
+std::uint64_t allocations_after_first_block(const std::string &signal, audio::StreamFormat format)
+{
+  Run run;
+  audio::CaptureOptions options;
+  options.pacing = audio::Pacing::unthrottled;
+  options.format = format;
+  auto session = audio::capture_data(
+      [&run](const audio::BufferView &view) {
+        // Only reads the counter, the lock is taken once at the end
+        if (run.blocks == 0)
+          run.after_first = allocations;
+        volatile float first = view.data[0];
+        (void) first;
+        if (++run.blocks < BLOCKS)
+          return true;
+        std::lock_guard<std::mutex> lock(run.mutex);
+        run.allocated = allocations - run.after_first;
+        run.finished = true;
+        run.done.notify_one();
+        return false;
+      },
+      audio::AudioSinkInfo{signal, signal, false}, options);
+
+  std::unique_lock<std::mutex> lock(run.mutex);
+  const bool finished = run.done.wait_for(lock, std::chrono::seconds(10), [&run] { return run.finished; });
+  lock.unlock();
+  session.stop();
+  CHECK(finished);
+  return run.allocated;
+}
+}
+
+int main()
+{
+  CHECK(audio::select_backend("generator"));
+  const char *const signals[] = {"sine:440,660", "sweep:20,20000,1", "white", "pink", "impulse:0.01", "dropout:440,0.05,0.01",
+                                 "silence"};
+  for (const char *signal : signals) {
+    const std::uint64_t stereo = allocations_after_first_block(signal, audio::StreamFormat{48000, 2});
+    const std::uint64_t surround = allocations_after_first_block(signal, audio::StreamFormat{44100, 6});
+    if (!CHECK(stereo == 0 && surround == 0))
+      std::cerr << signal << ": " << stereo << " allocations in stereo, " << surround << " in 5.1" << std::endl;
+  }
+  return test::result("allocation_test");
+}
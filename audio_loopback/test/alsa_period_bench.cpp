@@ -0,0 +1,41 @@
+#include "capture_cadence.h"
+#include <audio_loopback/loopback_recorder.h>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <string>
+
+// Latency and cpu of the ALSA mmap backend at periods of 64, 128 and 256 frames, and how evenly the
+// periods arrive. Records hw:Loopback,1 of snd-aloop unless another device is given, it runs off the
+// system timer whether or not anything plays on hw:Loopback,0.
+namespace
+{
+const std::uint32_t PERIODS[] = {64, 128, 256};
+const std::chrono::seconds DURATION{5};
+}
+
+int main(int argc, char **argv)
+{
+  if (!audio::select_backend("alsa")) {
+    std::cerr << "the alsa backend isn't built" << std::endl;
+    return 1;
+  }
+  const std::string device = argc > 1 ? argv[1] : "hw:Loopback,1";
+
+  test::print_cadence_header("period");
+  for (std::uint32_t period : PERIODS) {
+    audio::CaptureOptions options;
+    options.period_frames = period;
+    options.format = audio::StreamFormat{48000, 2};
+    try {
+      test::print_cadence(std::to_string(period),
+                          test::measure_cadence(audio::AudioSinkInfo{device, device, true}, options, DURATION));
+    }
+    catch (const std::exception &error) {
+      std::cerr << "could not capture from " << device << ": " << error.what() << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
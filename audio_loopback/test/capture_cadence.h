@@ -0,0 +1,139 @@
+#ifndef VISUALIZER_TEST_CAPTURE_CADENCE_H
+#define VISUALIZER_TEST_CAPTURE_CADENCE_H
+#include <audio_loopback/loopback_recorder.h>
+#include <time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What the benchmarks against a real sound server measure: how far apart the blocks of a capture
+// actually arrive, next to what the backend said it negotiated
+namespace test
+{
+struct Cadence
+{
+  audio::StreamInfo info;
+  audio::CaptureMetrics metrics{};
+  uint64_t blocks = 0;
+  uint64_t frames = 0;
+  uint64_t flagged = 0;
+  // Between the arrival of consecutive blocks, sorted
+  std::vector<std::chrono::microseconds> intervals;
+  // Of one core, the whole process over the capture
+  double cpu_percent = 0.0;
+
+  std::chrono::microseconds percentile(std::size_t percent) const
+  {
+    if (intervals.empty())
+      return std::chrono::microseconds(0);
+    return intervals[std::min(intervals.size() - 1, intervals.size() * percent / 100)];
+  }
+};
+
+inline std::chrono::microseconds process_cpu_time()
+{
+  timespec time;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+  return std::chrono::microseconds(time.tv_sec * 1000000LL + time.tv_nsec / 1000);
+}
+
+// Captures from the sink of the selected backend for the given time. The first second is left out,
+// servers settle their buffers in it.
+inline Cadence measure_cadence(const audio::AudioSinkInfo &sink, const audio::CaptureOptions &options,
+                               std::chrono::seconds duration)
+{
+  typedef std::chrono::steady_clock Clock;
+  const auto warmup = std::chrono::seconds(1);
+  Cadence cadence;
+  std::vector<Clock::time_point> arrivals;
+  arrivals.reserve(200000);
+  uint64_t frames = 0, flagged = 0;
+  std::atomic<bool> counting{false};
+
+  auto session = audio::capture_data(
+      [&](const audio::BufferView &view) {
+        if (counting && arrivals.size() < arrivals.capacity()) {
+          arrivals.push_back(Clock::now());
+          frames += view.frames;
+          flagged += (view.flags & audio::BUFFER_DISCONTINUITY) != 0;
+        }
+        return true;
+      },
+      sink, options);
+  cadence.info = session.info();
+
+  std::this_thread::sleep_for(warmup);
+  session.metrics();
+  const auto cpu_before = process_cpu_time();
+  const auto wall_before = Clock::now();
+  counting = true;
+  std::this_thread::sleep_for(duration);
+  cadence.metrics = session.metrics();
+  const auto cpu = process_cpu_time() - cpu_before;
+  const auto wall = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - wall_before);
+  session.stop();
+
+  for (std::size_t i = 1; i < arrivals.size(); i++)
+    cadence.intervals.push_back(std::chrono::duration_cast<std::chrono::microseconds>(arrivals[i] - arrivals[i - 1]));
+  std::sort(cadence.intervals.begin(), cadence.intervals.end());
+  cadence.blocks = arrivals.size();
+  cadence.frames = frames;
+  cadence.flagged = flagged;
+  cadence.cpu_percent = 100.0 * cpu.count() / wall.count();
+  return cadence;
+}
+
+// Loads a null sink with pactl, which pipewire-pulse serves as well. The index of the module to
+// unload afterwards, empty if pactl failed.
+inline std::string load_null_sink(const std::string &name)
+{
+  const std::string command = "pactl load-module module-null-sink sink_name=" + name + " rate=48000 channels=2";
+  FILE *pactl = popen(command.c_str(), "r");
+  if (pactl == nullptr)
+    return std::string();
+  char index[32] = {};
+  const bool read = std::fgets(index, sizeof(index), pactl) != nullptr;
+  if (pclose(pactl) != 0 || !read)
+    return std::string();
+  std::string result = index;
+  result.erase(result.find_last_not_of("\n") + 1);
+  return result;
+}
+
+inline void unload_module(const std::string &index)
+{
+  std::system(("pactl unload-module " + index).c_str());
+}
+
+inline double milliseconds(std::chrono::microseconds time)
+{
+  return time.count() / 1000.0;
+}
+
+inline void print_cadence_header(const char *first)
+{
+  std::cout << std::setw(10) << first << std::setw(12) << "latency ms" << std::setw(10) << "frames" << std::setw(10)
+            << "blocks" << std::setw(10) << "p50 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "max ms"
+            << std::setw(8) << "flagged" << std::setw(8) << "cpu" << std::endl;
+}
+
+// The negotiated latency and fragment size, then the intervals the blocks actually came at
+inline void print_cadence(const std::string &first, const Cadence &cadence)
+{
+  std::cout << std::setw(10) << first << std::fixed << std::setprecision(2) << std::setw(12)
+            << milliseconds(cadence.info.latency) << std::setw(10) << cadence.info.fragment_frames << std::setw(10)
+            << cadence.blocks << std::setw(10) << milliseconds(cadence.percentile(50)) << std::setw(10)
+            << milliseconds(cadence.percentile(99)) << std::setw(10) << milliseconds(cadence.percentile(100))
+            << std::setw(8) << cadence.flagged << std::setw(7) << cadence.cpu_percent << "%" << std::endl;
+}
+}
+
+#endif //VISUALIZER_TEST_CAPTURE_CADENCE_H
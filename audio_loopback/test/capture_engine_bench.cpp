@@ -0,0 +1,120 @@
+#include <audio_loopback/capture_engine.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Cpu time and wakeups of the capture side against the number of streams, for the engine's single
+// epoll thread and for a thread per stream as capture sessions run them. Every stream is a 48kHz
+// stereo generator delivering 10ms blocks, drained by one consumer thread every 5ms.
+namespace
+{
+const std::chrono::seconds DURATION{2};
+const std::chrono::milliseconds DRAIN_INTERVAL{5};
+const size_t STREAM_COUNTS[] = {1, 4, 16, 64};
+
+audio::CaptureOptions options()
+{
+  audio::CaptureOptions result;
+  result.latency = std::chrono::milliseconds(10);
+  result.format = audio::StreamFormat{48000, 2};
+  return result;
+}
+
+std::chrono::microseconds process_cpu_time()
+{
+  timespec time;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+  return std::chrono::microseconds(time.tv_sec * 1000000LL + time.tv_nsec / 1000);
+}
+
+void report(const char *name, size_t streams, double cpu_percent, double wakeups_per_second, double blocks_per_second)
+{
+  std::cout << std::setw(8) << name << std::setw(8) << streams << std::fixed << std::setprecision(2) << std::setw(10)
+            << cpu_percent << "%" << std::setprecision(0) << std::setw(12) << wakeups_per_second << std::setw(12)
+            << blocks_per_second << std::endl;
+}
+
+void engine(size_t count)
+{
+  audio::CaptureEngine engine;
+  std::vector<size_t> streams;
+  for (size_t i = 0; i < count; i++)
+    streams.push_back(engine.add_stream(audio::AudioSinkInfo{"sine", "sine:440", false}, options(), "generator"));
+
+  std::atomic<bool> running{true};
+  std::thread consumer([&] {
+    std::vector<float> samples(1 << 14);
+    while (running) {
+      for (size_t stream : streams) {
+        audio::CaptureRing &ring = engine.ring(stream);
+        while (ring.read(samples.data(), samples.size()) > 0) {
+        }
+        audio::CaptureRing::Block block;
+        while (ring.next_block(block)) {
+        }
+      }
+      std::this_thread::sleep_for(DRAIN_INTERVAL);
+    }
+  });
+
+  engine.start();
+  const audio::EngineStats before = engine.stats();
+  const auto started = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(DURATION);
+  const audio::EngineStats after = engine.stats();
+  const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  engine.stop();
+  running = false;
+  consumer.join();
+
+  const double cpu = std::chrono::duration<double>(after.cpu_time - before.cpu_time).count();
+  report("engine", count, 100 * cpu / elapsed, (after.wakeups - before.wakeups) / elapsed,
+         (after.blocks - before.blocks) / elapsed);
+}
+
+// Sessions don't report their thread's cpu time, the whole process is measured with only the
+// consumer's share, which is small, on top
+void sessions(size_t count)
+{
+  std::atomic<uint64_t> blocks{0};
+  std::vector<audio::CaptureSession> running;
+  audio::select_backend("generator");
+  for (size_t i = 0; i < count; i++) {
+    running.push_back(audio::capture_data(
+        [&blocks](const audio::BufferView &) {
+          blocks.fetch_add(1, std::memory_order_relaxed);
+          return true;
+        },
+        audio::AudioSinkInfo{"sine", "sine:440", false}, options()));
+  }
+
+  const uint64_t blocks_before = blocks;
+  const auto cpu_before = process_cpu_time();
+  const auto started = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(DURATION);
+  const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  const double cpu = std::chrono::duration<double>(process_cpu_time() - cpu_before).count();
+  const double delivered = (blocks - blocks_before) / elapsed;
+  running.clear();
+
+  // Every stream thread wakes up once per block
+  report("threads", count, 100 * cpu / elapsed, delivered, delivered);
+}
+}
+
+int main()
+{
+  std::cout << std::setw(8) << "capture" << std::setw(8) << "streams" << std::setw(11) << "cpu" << std::setw(12)
+            << "wakeups/s" << std::setw(12) << "blocks/s" << std::endl;
+  for (size_t count : STREAM_COUNTS)
+    engine(count);
+  for (size_t count : STREAM_COUNTS)
+    sessions(count);
+  return 0;
+}
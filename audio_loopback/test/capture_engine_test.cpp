@@ -0,0 +1,124 @@
+#include "check.h"
+#include <audio_loopback/capture_engine.h>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Generator streams on the engine's epoll thread, with a consumer that falls behind for longer than
+// the ring holds. What the engine does then is up to the ring's lag policy.
+namespace
+{
+const audio::StreamFormat FORMAT{48000, 2};
+// Longer than the 500ms the engine's rings hold
+const std::chrono::milliseconds STALL{800};
+
+struct Drained
+{
+  std::uint64_t blocks = 0;
+  std::uint64_t frames = 0;
+  // Blocks flagged BUFFER_GAP because the ring cut them short, and blocks with gap set after one
+  std::uint64_t cut = 0;
+  std::uint64_t after_cut = 0;
+  // Every block starts where the one before it ended, unless one of them was cut or flagged
+  bool continuous = true;
+};
+
+Drained drain(audio::CaptureRing &ring, std::chrono::milliseconds duration)
+{
+  Drained result;
+  std::vector<float> samples(1 << 16);
+  uint64_t next_position = 0;
+  bool previous_cut = false;
+  const auto until = std::chrono::steady_clock::now() + duration;
+  while (std::chrono::steady_clock::now() < until) {
+    audio::CaptureRing::Block block;
+    if (!ring.next_block(block)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      continue;
+    }
+    const uint64_t frames = block.samples / FORMAT.channels;
+    const bool cut = (block.stamp.flags & audio::BUFFER_GAP) != 0;
+    if (result.blocks != 0 && !cut && !block.gap && !previous_cut)
+      result.continuous &= block.stamp.timing.position == next_position;
+    if (cut)
+      result.cut++;
+    if (previous_cut && block.gap)
+      result.after_cut++;
+    previous_cut = cut;
+    next_position = block.stamp.timing.position + frames;
+
+    const size_t end = block.position + block.samples;
+    while (end > ring.position() && ring.read(samples.data(), std::min(end - ring.position(), samples.size())) > 0) {
+    }
+    result.blocks++;
+    result.frames += frames;
+  }
+  return result;
+}
+
+audio::CaptureOptions generator_options()
+{
+  audio::CaptureOptions options;
+  options.latency = std::chrono::milliseconds(10);
+  options.format = FORMAT;
+  return options;
+}
+
+void block_policy_waits()
+{
+  audio::CaptureEngine engine;
+  const size_t stream = engine.add_stream(audio::AudioSinkInfo{"sine", "sine:440", false}, generator_options(), "generator");
+  engine.ring(stream).set_lag_policy(audio::LagPolicy::block);
+  engine.start();
+  std::this_thread::sleep_for(STALL);
+  const Drained drained = drain(engine.ring(stream), std::chrono::milliseconds(500));
+  engine.stop();
+  const audio::EngineStats stats = engine.stats();
+
+  CHECK(drained.blocks > 0);
+  CHECK(drained.cut == 0);
+  CHECK(drained.continuous);
+  CHECK(stats.dropped_frames == 0);
+  CHECK(engine.ring(stream).dropped() == 0);
+}
+
+void drop_newest_flags_the_cut_block()
+{
+  audio::CaptureEngine engine;
+  const size_t stream = engine.add_stream(audio::AudioSinkInfo{"sine", "sine:440", false}, generator_options(), "generator");
+  engine.start();
+  std::this_thread::sleep_for(STALL);
+  const Drained drained = drain(engine.ring(stream), std::chrono::milliseconds(300));
+  engine.stop();
+  const audio::EngineStats stats = engine.stats();
+
+  CHECK(stats.dropped_frames > 0);
+  CHECK(stats.dropped_frames * FORMAT.channels == engine.ring(stream).dropped());
+  // The block that lost frames is flagged, and the ring sets gap on the one after it
+  CHECK(drained.cut > 0);
+  CHECK(drained.after_cut > 0);
+  CHECK(drained.continuous);
+  CHECK(stats.discontinuities >= drained.cut);
+}
+
+void stop_releases_a_waiting_producer()
+{
+  audio::CaptureEngine engine;
+  const size_t stream = engine.add_stream(audio::AudioSinkInfo{"sine", "sine:440", false}, generator_options(), "generator");
+  engine.ring(stream).set_lag_policy(audio::LagPolicy::block);
+  engine.start();
+  std::this_thread::sleep_for(STALL);
+  const auto stopping = std::chrono::steady_clock::now();
+  engine.stop();
+  CHECK(std::chrono::steady_clock::now() - stopping < std::chrono::milliseconds(100));
+}
+}
+
+int main()
+{
+  block_policy_waits();
+  drop_newest_flags_the_cut_block();
+  stop_releases_a_waiting_producer();
+  return test::result("capture_engine_test");
+}
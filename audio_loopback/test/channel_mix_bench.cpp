@@ -0,0 +1,81 @@
+#include <audio_loopback/channel_mix.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Splitting 10ms blocks of 192kHz audio into planes and folding them down to stereo, with
+// deinterleave_downmix and with the frame by frame loop it replaced. The share is how much of one
+// core keeping up with the stream in real time takes.
+namespace
+{
+typedef std::chrono::steady_clock Clock;
+
+const std::uint32_t RATE = 192000;
+const std::uint32_t BLOCK = RATE / 100;
+const std::size_t BLOCKS = 2000;
+const std::uint32_t CHANNEL_COUNTS[] = {2, 6, 8};
+// Written with every block so the work isn't optimized away
+volatile float last_output;
+
+void reference(const audio::BufferView &view, float *const *planes, const audio::DownmixMatrix &matrix,
+               float *const *mixed)
+{
+  const std::uint32_t channels = view.format.channels;
+  for (std::size_t frame = 0; frame < view.frames; frame++) {
+    const float *in = view.data + frame * channels;
+    for (std::uint32_t channel = 0; channel < channels; channel++)
+      planes[channel][frame] = in[channel];
+    for (std::uint32_t output = 0; output < matrix.outputs(); output++) {
+      float sum = 0.0F;
+      for (std::uint32_t channel = 0; channel < channels; channel++)
+        sum += matrix(output, channel) * in[channel];
+      mixed[output][frame] = sum;
+    }
+  }
+}
+
+template<typename Mix>
+void run(const char *name, std::uint32_t channels, Mix mix)
+{
+  std::mt19937 random_source(3);
+  std::uniform_real_distribution<float> uniform(-1.0F, 1.0F);
+  std::vector<float> samples(std::size_t(BLOCK) * channels);
+  for (float &sample : samples)
+    sample = uniform(random_source);
+  std::vector<std::vector<float>> plane_storage(channels, std::vector<float>(BLOCK));
+  std::vector<std::vector<float>> mixed_storage(2, std::vector<float>(BLOCK));
+  std::vector<float *> planes, mixed;
+  for (std::vector<float> &plane : plane_storage)
+    planes.push_back(plane.data());
+  for (std::vector<float> &plane : mixed_storage)
+    mixed.push_back(plane.data());
+  const audio::DownmixMatrix matrix = audio::DownmixMatrix::stereo(channels);
+  const audio::BufferView view{samples.data(), BLOCK, {RATE, channels}, 0, audio::BlockTiming()};
+
+  const auto start = Clock::now();
+  for (std::size_t i = 0; i < BLOCKS; i++) {
+    mix(view, planes.data(), matrix, mixed.data());
+    last_output = mixed[0][i % BLOCK];
+  }
+  const std::chrono::duration<double> elapsed = Clock::now() - start;
+  const double frames_per_second = BLOCK * BLOCKS / elapsed.count();
+  std::cout << std::setw(10) << name << std::setw(10) << channels << std::fixed << std::setprecision(1)
+            << std::setw(12) << frames_per_second / 1e6 << std::setprecision(3) << std::setw(11)
+            << 100.0 * RATE / frames_per_second << "%" << std::endl;
+}
+}
+
+int main()
+{
+  std::cout << std::setw(10) << "mix" << std::setw(10) << "channels" << std::setw(12) << "M frames/s" << std::setw(12)
+            << "share" << std::endl;
+  for (std::uint32_t channels : CHANNEL_COUNTS) {
+    run("reference", channels, reference);
+    run("library", channels, audio::deinterleave_downmix);
+  }
+  return 0;
+}
@@ -0,0 +1,165 @@
+#include "check.h"
+#include <audio_loopback/channel_mix.h>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+// deinterleave_downmix against a frame by frame reference, for every channel count up to eight and
+// block sizes leaving every tail the shuffles, the 8x8 transpose and the gathers leave. Whichever of
+// them this cpu runs, the planes are copies and have to match exactly. The mix adds the same products
+// in the same order, rounding may only differ where the compiler fuses them.
+namespace
+{
+const float MIX_TOLERANCE = 1e-6F;
+const std::size_t FRAMES[] = {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 100, 1000};
+
+std::mt19937 random_source(17);
+
+std::vector<float> noise(std::size_t count)
+{
+  std::uniform_real_distribution<float> uniform(-1.0F, 1.0F);
+  std::vector<float> values(count);
+  for (float &value : values)
+    value = uniform(random_source);
+  return values;
+}
+
+audio::DownmixMatrix random_matrix(std::uint32_t inputs, std::uint32_t outputs)
+{
+  audio::DownmixMatrix matrix(inputs, outputs);
+  const std::vector<float> weights = noise(std::size_t(inputs) * outputs);
+  for (std::uint32_t output = 0; output < outputs; output++) {
+    for (std::uint32_t input = 0; input < inputs; input++)
+      matrix(output, input) = weights[output * inputs + input];
+  }
+  return matrix;
+}
+
+struct Planes
+{
+  std::vector<std::vector<float>> storage;
+  std::vector<float *> pointers;
+
+  Planes(std::size_t count, std::size_t frames)
+      : storage(count, std::vector<float>(frames + 1, 42.0F))
+  {
+    for (std::vector<float> &plane : storage)
+      pointers.push_back(plane.data());
+  }
+};
+
+void compare(const audio::DownmixMatrix &matrix, std::size_t frames, bool with_planes, bool with_mix)
+{
+  const std::uint32_t channels = matrix.inputs();
+  const std::vector<float> samples = noise(frames * channels);
+  const audio::BufferView view{samples.data(), static_cast<std::uint32_t>(frames), {48000, channels}, 0,
+                               audio::BlockTiming()};
+  Planes planes(channels, frames), mixed(matrix.outputs(), frames);
+  audio::deinterleave_downmix(view, with_planes ? planes.pointers.data() : nullptr, matrix,
+                              with_mix ? mixed.pointers.data() : nullptr);
+
+  bool exact = true, untouched = true;
+  float worst = 0.0F;
+  for (std::size_t frame = 0; frame < frames; frame++) {
+    const float *in = samples.data() + frame * channels;
+    for (std::uint32_t channel = 0; channel < channels; channel++)
+      exact &= planes.storage[channel][frame] == (with_planes ? in[channel] : 42.0F);
+    for (std::uint32_t output = 0; output < matrix.outputs(); output++) {
+      float expected = 0.0F, magnitude = 0.0F;
+      for (std::uint32_t channel = 0; channel < channels; channel++) {
+        expected += matrix(output, channel) * in[channel];
+        magnitude += std::fabs(matrix(output, channel) * in[channel]);
+      }
+      if (!with_mix)
+        untouched &= mixed.storage[output][frame] == 42.0F;
+      else if (magnitude > 0.0F)
+        worst = std::max(worst, std::fabs(mixed.storage[output][frame] - expected) / magnitude);
+      else
+        exact &= mixed.storage[output][frame] == 0.0F;
+    }
+  }
+  // Nothing past the block is written
+  for (const std::vector<float> &plane : planes.storage)
+    untouched &= plane[frames] == 42.0F;
+  for (const std::vector<float> &plane : mixed.storage)
+    untouched &= plane[frames] == 42.0F;
+
+  if (!CHECK(exact && untouched && worst <= MIX_TOLERANCE))
+    std::cerr << channels << " channels to " << matrix.outputs() << " in " << frames << " frames: off by " << worst
+              << (exact ? "" : ", planes differ") << (untouched ? "" : ", wrote past the block") << std::endl;
+}
+
+void matches_the_reference()
+{
+  for (std::uint32_t channels = 1; channels <= 8; channels++) {
+    const audio::DownmixMatrix matrices[] = {audio::DownmixMatrix::stereo(channels),
+                                             audio::DownmixMatrix::mono(channels), random_matrix(channels, 3),
+                                             random_matrix(channels, audio::MAX_MIX_OUTPUTS),
+                                             audio::DownmixMatrix(channels, 0)};
+    for (const audio::DownmixMatrix &matrix : matrices) {
+      for (std::size_t frames : FRAMES) {
+        compare(matrix, frames, true, true);
+        compare(matrix, frames, false, true);
+        compare(matrix, frames, true, false);
+      }
+    }
+  }
+}
+
+// Every input ends up somewhere but the LFE, and in phase full scale input doesn't clip
+void fold_downs_keep_unity_gain()
+{
+  for (std::uint32_t channels = 1; channels <= 8; channels++) {
+    const audio::DownmixMatrix stereo = audio::DownmixMatrix::stereo(channels);
+    const audio::DownmixMatrix mono = audio::DownmixMatrix::mono(channels);
+    float mono_gain = 0.0F;
+    for (std::uint32_t input = 0; input < channels; input++)
+      mono_gain += mono(0, input);
+    CHECK(std::fabs(mono_gain - 1.0F) < 1e-6F);
+    for (std::uint32_t output = 0; output < 2; output++) {
+      float gain = 0.0F;
+      for (std::uint32_t input = 0; input < channels; input++)
+        gain += stereo(output, input);
+      CHECK(std::fabs(gain - 1.0F) < 1e-6F);
+    }
+    const bool has_lfe = channels == 6 || channels == 8;
+    for (std::uint32_t input = 0; input < channels; input++)
+      CHECK((stereo(0, input) + stereo(1, input) == 0.0F) == (has_lfe && input == 3));
+  }
+}
+
+void mismatches_are_rejected()
+{
+  const std::vector<float> samples(6 * 16);
+  const audio::BufferView view{samples.data(), 16, {48000, 6}, 0, audio::BlockTiming()};
+  bool threw = false;
+  try {
+    audio::deinterleave_downmix(view, nullptr, audio::DownmixMatrix::stereo(8), nullptr);
+  }
+  catch (const std::invalid_argument &) {
+    threw = true;
+  }
+  CHECK(threw);
+
+  threw = false;
+  try {
+    audio::DownmixMatrix(2, audio::MAX_MIX_OUTPUTS + 1);
+  }
+  catch (const std::invalid_argument &) {
+    threw = true;
+  }
+  CHECK(threw);
+}
+}
+
+int main()
+{
+  matches_the_reference();
+  fold_downs_keep_unity_gain();
+  mismatches_are_rejected();
+  return test::result("channel_mix_test");
+}
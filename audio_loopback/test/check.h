@@ -0,0 +1,35 @@
+#ifndef VISUALIZER_TEST_CHECK_H
+#define VISUALIZER_TEST_CHECK_H
+#include <iostream>
+
+// Tests are plain executables, CTest counts one as failed when it returns nonzero
+namespace test
+{
+inline int &failures()
+{
+  static int count = 0;
+  return count;
+}
+
+inline bool check(bool passed, const char *condition, const char *file, int line)
+{
+  if (!passed) {
+    std::cerr << file << ":" << line << ": check failed: " << condition << std::endl;
+    failures()++;
+  }
+  return passed;
+}
+
+inline int result(const char *name)
+{
+  if (failures() == 0)
+    std::cout << name << ": passed" << std::endl;
+  else
+    std::cerr << name << ": " << failures() << " checks failed" << std::endl;
+  return failures() == 0 ? 0 : 1;
+}
+}
+
+#define CHECK(condition) test::check((condition), #condition, __FILE__, __LINE__)
+
+#endif //VISUALIZER_TEST_CHECK_H
@@ -0,0 +1,161 @@
+#include "check.h"
+#include <audio_loopback/loopback_recorder.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// A session switching between generator devices, silence and a sine, so every block shows which
+// device it came from. The first block of the new device carries the gap flag, nothing of the old one
+// follows it, and the time without blocks stays around one block.
+namespace
+{
+const std::chrono::milliseconds BLOCK{10};
+// A block plus the time it takes to open a generator, with room for a loaded machine
+const std::chrono::milliseconds MAX_GAP{50};
+const int SWITCHES = 6;
+
+const audio::AudioSinkInfo SILENCE{"silence", "silence", false};
+const audio::AudioSinkInfo SINE{"sine", "sine:440", false};
+
+struct Delivered
+{
+  bool loud;
+  bool gap;
+};
+
+struct Capture
+{
+  std::mutex mutex;
+  std::vector<Delivered> blocks;
+
+  size_t size()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return blocks.size();
+  }
+};
+
+audio::CaptureSession start(Capture &capture)
+{
+  audio::CaptureOptions options;
+  options.latency = BLOCK;
+  options.format = audio::StreamFormat{48000, 2};
+  return audio::capture_data(
+      [&capture](const audio::BufferView &view) {
+        float peak = 0;
+        for (size_t i = 0; i < size_t(view.frames) * view.format.channels; i++)
+          peak = std::max(peak, std::fabs(view.data[i]));
+        std::lock_guard<std::mutex> lock(capture.mutex);
+        capture.blocks.push_back(Delivered{peak > 0, (view.flags & audio::BUFFER_GAP) != 0});
+        return true;
+      },
+      SILENCE, options);
+}
+
+// Waits for a few more blocks to be delivered
+void settle(Capture &capture)
+{
+  const size_t until = capture.size() + 5;
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (capture.size() < until && std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(BLOCK);
+}
+
+void switches_are_flagged_and_short()
+{
+  Capture capture;
+  audio::CaptureSession session = start(capture);
+  settle(capture);
+
+  std::chrono::microseconds longest{0};
+  for (int i = 0; i < SWITCHES; i++) {
+    session.switch_device(i % 2 == 0 ? SINE : SILENCE);
+    longest = std::max(longest, session.last_switch_gap());
+    settle(capture);
+  }
+  session.stop();
+
+  std::lock_guard<std::mutex> lock(capture.mutex);
+  int flagged = 0;
+  int changes = 0;
+  bool flagged_at_changes = true;
+  for (size_t i = 1; i < capture.blocks.size(); i++) {
+    const bool changed = capture.blocks[i].loud != capture.blocks[i - 1].loud;
+    // A sine block can start with a zero crossing but never be silent throughout, so the device
+    // changes exactly where the blocks change between silent and loud
+    flagged_at_changes &= changed == capture.blocks[i].gap;
+    flagged += capture.blocks[i].gap;
+    changes += changed;
+  }
+  CHECK(!capture.blocks.front().gap);
+  CHECK(flagged == SWITCHES);
+  CHECK(changes == SWITCHES);
+  CHECK(flagged_at_changes);
+  CHECK(longest > std::chrono::microseconds(0));
+  if (!CHECK(longest < MAX_GAP))
+    std::cerr << "longest switch gap " << longest.count() << "us" << std::endl;
+}
+
+void failed_switch_keeps_the_old_device()
+{
+  Capture capture;
+  audio::CaptureSession session = start(capture);
+  settle(capture);
+
+  bool threw = false;
+  try {
+    session.switch_device(audio::AudioSinkInfo{"nothing", "nothing:1", false});
+  }
+  catch (const std::exception &) {
+    threw = true;
+  }
+  const size_t before = capture.size();
+  settle(capture);
+  session.stop();
+
+  std::lock_guard<std::mutex> lock(capture.mutex);
+  bool untouched = true;
+  for (const Delivered &block : capture.blocks)
+    untouched &= !block.loud && !block.gap;
+  CHECK(threw);
+  CHECK(session.last_switch_gap() == std::chrono::microseconds(0));
+  CHECK(capture.blocks.size() > before);
+  CHECK(untouched);
+}
+
+void switch_while_paused_flags_the_resume()
+{
+  Capture capture;
+  audio::CaptureSession session = start(capture);
+  settle(capture);
+  session.pause();
+  session.switch_device(SINE);
+  std::this_thread::sleep_for(BLOCK * 5);
+  const size_t while_paused = capture.size();
+  session.resume();
+  settle(capture);
+  session.stop();
+
+  std::lock_guard<std::mutex> lock(capture.mutex);
+  CHECK(capture.blocks.size() > while_paused);
+  CHECK(capture.blocks[while_paused].loud && capture.blocks[while_paused].gap);
+  bool after = true;
+  for (size_t i = while_paused + 1; i < capture.blocks.size(); i++)
+    after &= capture.blocks[i].loud && !capture.blocks[i].gap;
+  CHECK(after);
+}
+}
+
+int main()
+{
+  CHECK(audio::select_backend("generator"));
+  switches_are_flagged_and_short();
+  failed_switch_keeps_the_old_device();
+  switch_while_paused_flags_the_resume();
+  return test::result("device_switch_test");
+}
@@ -0,0 +1,97 @@
+#include <audio_loopback/capture_engine.h>
+#include <audio_loopback/fault_injection.h>
+#include <audio_loopback/loopback_recorder.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The ring, alignment and latency figures of a 48kHz stereo generator under each named fault profile
+// as the fault backend ships them, drained into a ring at 60 Hz. Lateness is how long after its
+// frames were due a block was delivered, the ring fill how much of its half second was in use when
+// the consumer came round.
+namespace
+{
+const audio::StreamFormat FORMAT{48000, 2};
+const uint64_t IMPULSE_FRAMES = 480;
+const std::chrono::seconds DURATION{5};
+const std::chrono::milliseconds DRAIN_INTERVAL{16};
+const char *const PROFILES[] = {"none", "jitter", "bursty", "short", "lossy", "stalls", "all"};
+
+double milliseconds(std::chrono::microseconds time)
+{
+  return time.count() / 1000.0;
+}
+
+void profile(const std::string &name)
+{
+  audio::CaptureRing ring(FORMAT.sample_rate * FORMAT.channels / 2, 256, FORMAT.channels);
+  audio::CaptureOptions options;
+  options.latency = std::chrono::milliseconds(10);
+  options.format = FORMAT;
+
+  const audio::InjectedFaults before = audio::injected_faults();
+  auto session = audio::capture_data(
+      [&ring](const audio::BufferView &view) {
+        ring.write(view.data, size_t(view.frames) * view.format.channels, view.stamp());
+        return true;
+      },
+      audio::AudioSinkInfo{name, name + "|generator|impulse:0.01", false}, options);
+
+  std::vector<float> samples(ring.capacity());
+  std::vector<std::chrono::microseconds> lateness;
+  std::chrono::steady_clock::time_point origin;
+  size_t peak_fill = 0;
+  uint64_t flagged = 0;
+  uint64_t misaligned = 0;
+  const auto until = std::chrono::steady_clock::now() + DURATION;
+  while (std::chrono::steady_clock::now() < until) {
+    std::this_thread::sleep_for(DRAIN_INTERVAL);
+    peak_fill = std::max(peak_fill, ring.available());
+    audio::CaptureRing::Block block;
+    while (ring.next_block(block) && ring.read(samples.data(), block.samples) == block.samples) {
+      const uint64_t frames = block.samples / FORMAT.channels;
+      const uint64_t position = block.stamp.timing.position;
+      for (uint64_t i = 0; i < frames; i++)
+        misaligned += (samples[i * FORMAT.channels] == 1.0F) != ((position + i) % IMPULSE_FRAMES == 0);
+
+      const auto due = std::chrono::microseconds((position + frames) * 1000000 / FORMAT.sample_rate);
+      if (lateness.empty())
+        origin = block.stamp.timing.timestamp - due;
+      lateness.push_back(
+          std::chrono::duration_cast<std::chrono::microseconds>(block.stamp.timing.timestamp - origin - due));
+      flagged += (block.stamp.flags & audio::BUFFER_GAP) != 0;
+    }
+  }
+  session.stop();
+  const audio::InjectedFaults after = audio::injected_faults();
+
+  std::sort(lateness.begin(), lateness.end());
+  const auto percentile = [&lateness](size_t percent) {
+    return lateness.empty() ? 0.0 : milliseconds(lateness[std::min(lateness.size() - 1, lateness.size() * percent / 100)]);
+  };
+  std::cout << std::setw(8) << name << std::setw(8) << lateness.size() << std::setw(8) << flagged << std::setw(10)
+            << misaligned << std::setw(8) << ring.dropped() << std::fixed << std::setprecision(1) << std::setw(9)
+            << 100.0 * peak_fill / ring.capacity() << "%" << std::setprecision(2) << std::setw(10) << percentile(50)
+            << std::setw(10) << percentile(99) << std::setw(10) << percentile(100) << std::setw(10)
+            << milliseconds(after.held_up - before.held_up) << std::endl;
+}
+}
+
+int main()
+{
+  if (!audio::select_backend("faults")) {
+    std::cerr << "the fault backend isn't built" << std::endl;
+    return 1;
+  }
+  std::cout << std::setw(8) << "profile" << std::setw(8) << "blocks" << std::setw(8) << "gaps" << std::setw(10)
+            << "misalign" << std::setw(8) << "ring" << std::setw(10) << "fill" << std::setw(10) << "p50 ms"
+            << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << std::setw(10) << "held ms" << std::endl;
+  for (const char *name : PROFILES)
+    profile(name);
+  return 0;
+}
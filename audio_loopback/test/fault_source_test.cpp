@@ -0,0 +1,167 @@
+#include "check.h"
+#include <audio_loopback/capture_engine.h>
+#include <audio_loopback/fault_injection.h>
+#include <audio_loopback/loopback_recorder.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Impulses every 10ms from the generator, through the fault backend under each profile and into a
+// ring drained at 60 Hz like the renderer does. Whatever is injected, the ring mustn't overflow,
+// every impulse must sit where the block's position says it does, and delivery must catch up with
+// the clock: most blocks on time, none later than all the holdups injected so far add up to. Fault
+// rates are raised over the named profiles so every fault shows up within the second each runs.
+namespace
+{
+const audio::StreamFormat FORMAT{48000, 2};
+const uint64_t IMPULSE_FRAMES = 480;
+const std::chrono::milliseconds BLOCK{10};
+const std::chrono::milliseconds DURATION{1000};
+const std::chrono::milliseconds DRAIN_INTERVAL{16};
+// Scheduling noise on top of what a profile injects
+const std::chrono::milliseconds SLACK{20};
+
+const char *const PROFILES[] = {"none", "jitter", "bursty,burst=0.1", "short,short=0.5", "lossy,drop=0.1",
+                                 "stalls,stall=0.05", "all,burst=0.03,drop=0.05,stall=0.02"};
+
+struct Outcome
+{
+  uint64_t blocks = 0;
+  uint64_t flagged = 0;
+  uint64_t ring_dropped = 0;
+  bool aligned = true;
+  std::vector<std::chrono::microseconds> lateness;
+  audio::InjectedFaults faults{};
+};
+
+audio::InjectedFaults since(const audio::InjectedFaults &before)
+{
+  const audio::InjectedFaults now = audio::injected_faults();
+  return audio::InjectedFaults{now.late - before.late,
+                               now.bursts - before.bursts,
+                               now.short_reads - before.short_reads,
+                               now.dropped - before.dropped,
+                               now.dropped_frames - before.dropped_frames,
+                               now.stalls - before.stalls,
+                               now.held_up - before.held_up};
+}
+
+// Checks one block taken from the ring against the impulse train and the time it should have come
+void inspect(const audio::CaptureRing::Block &block, const float *samples, Outcome &outcome,
+             std::chrono::steady_clock::time_point &origin)
+{
+  const uint64_t frames = block.samples / FORMAT.channels;
+  const uint64_t position = block.stamp.timing.position;
+  for (uint64_t i = 0; i < frames; i++)
+    outcome.aligned &= (samples[i * FORMAT.channels] == 1.0F) == ((position + i) % IMPULSE_FRAMES == 0);
+
+  // The first block sets when frame 0 went through, later ones are late by however much they
+  // were delivered after the frames they hold were due
+  const auto due = std::chrono::microseconds((position + frames) * 1000000 / FORMAT.sample_rate);
+  if (outcome.blocks == 0)
+    origin = block.stamp.timing.timestamp - due;
+  const auto late = std::chrono::duration_cast<std::chrono::microseconds>(block.stamp.timing.timestamp - origin - due);
+  outcome.lateness.push_back(late);
+  outcome.flagged += (block.stamp.flags & audio::BUFFER_GAP) != 0;
+  outcome.blocks++;
+}
+
+Outcome run(const std::string &spec)
+{
+  audio::CaptureRing ring(FORMAT.sample_rate * FORMAT.channels / 2, 256, FORMAT.channels);
+  audio::CaptureOptions options;
+  options.latency = BLOCK;
+  options.format = FORMAT;
+
+  Outcome outcome;
+  const audio::InjectedFaults before = audio::injected_faults();
+  auto session = audio::capture_data(
+      [&ring](const audio::BufferView &view) {
+        ring.write(view.data, size_t(view.frames) * view.format.channels, view.stamp());
+        return true;
+      },
+      audio::AudioSinkInfo{spec, spec + "|generator|impulse:0.01", false}, options);
+
+  std::vector<float> samples(ring.capacity());
+  std::chrono::steady_clock::time_point origin;
+  const auto until = std::chrono::steady_clock::now() + DURATION;
+  while (std::chrono::steady_clock::now() < until) {
+    std::this_thread::sleep_for(DRAIN_INTERVAL);
+    audio::CaptureRing::Block block;
+    while (ring.next_block(block)) {
+      if (ring.read(samples.data(), block.samples) != block.samples)
+        break;
+      inspect(block, samples.data(), outcome, origin);
+    }
+  }
+  session.stop();
+  outcome.ring_dropped = ring.dropped();
+  outcome.faults = since(before);
+  return outcome;
+}
+
+void profiles_meet_their_slos()
+{
+  for (const char *spec : PROFILES) {
+    Outcome outcome = run(spec);
+    const std::string name = spec;
+    const audio::InjectedFaults &faults = outcome.faults;
+    std::sort(outcome.lateness.begin(), outcome.lateness.end());
+    const std::chrono::microseconds median =
+        outcome.lateness.empty() ? std::chrono::microseconds(0) : outcome.lateness[outcome.lateness.size() / 2];
+    const std::chrono::microseconds latest =
+        outcome.lateness.empty() ? std::chrono::microseconds(0) : outcome.lateness.back();
+
+    bool passed = CHECK(outcome.blocks > 50);
+    passed &= CHECK(outcome.ring_dropped == 0);
+    passed &= CHECK(outcome.aligned);
+    passed &= CHECK(median < SLACK);
+    passed &= CHECK(latest < faults.held_up + SLACK);
+    // A block after a dropped one is flagged, the last drop may not have been followed yet
+    passed &= CHECK(outcome.flagged <= faults.dropped && outcome.flagged + 1 >= faults.dropped);
+
+    // Each profile injects its own faults and no others
+    const bool all = name.compare(0, 3, "all") == 0;
+    passed &= CHECK((faults.late > 0) == (all || name == "jitter"));
+    passed &= CHECK((faults.bursts > 0) == (all || name.compare(0, 6, "bursty") == 0));
+    passed &= CHECK((faults.short_reads > 0) == (all || name.compare(0, 5, "short") == 0));
+    passed &= CHECK((faults.dropped > 0) == (all || name.compare(0, 5, "lossy") == 0));
+    passed &= CHECK((faults.stalls > 0) == (all || name.compare(0, 6, "stalls") == 0));
+    if (!passed)
+      std::cerr << name << ": " << outcome.blocks << " blocks, " << outcome.flagged << " flagged, "
+                << outcome.ring_dropped << " dropped by the ring, median " << median.count() << "us late, latest "
+                << latest.count() << "us of " << faults.held_up.count() << "us held up" << std::endl;
+  }
+}
+
+void bad_overrides_are_rejected()
+{
+  const char *const specs[] = {"lossy,drop=0.1x", "lossy,drop=", "lossy,drop=-1", "all,seed=seven",
+                               "all,stall_ms=1e999", "jitter,jitter", "none,tempo=2", "noisy"};
+  for (const char *spec : specs) {
+    bool threw = false;
+    try {
+      audio::capture_data([](const audio::BufferView &) { return true; },
+                          audio::AudioSinkInfo{spec, std::string(spec) + "|generator|silence", false},
+                          audio::CaptureOptions());
+    }
+    catch (const std::invalid_argument &) {
+      threw = true;
+    }
+    if (!CHECK(threw))
+      std::cerr << spec << " was accepted" << std::endl;
+  }
+}
+}
+
+int main()
+{
+  CHECK(audio::select_backend("faults"));
+  bad_overrides_are_rejected();
+  profiles_meet_their_slos();
+  return test::result("fault_source_test");
+}
@@ -0,0 +1,166 @@
+#include "check.h"
+#include <audio_loopback/capture_engine.h>
+#include <audio_loopback/loopback_recorder.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A wav file replayed by the file backend behind the fault backend, which drops blocks on the way.
+// Every sample holds the index of its frame, so a block shows where it really came from and the
+// frames lost in front of it can be told apart from the ones that weren't.
+namespace
+{
+const audio::StreamFormat FORMAT{48000, 2};
+const uint32_t TOTAL_FRAMES = 48000;
+const uint32_t BLOCK_FRAMES = 480;
+
+template<typename T>
+void write_le(std::ofstream &file, T value)
+{
+  char bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  file.write(bytes, sizeof(T));
+}
+
+// Float32 wav whose frame n holds n on the left and -n on the right, exact up to 2^24
+std::string write_ramp()
+{
+  const char *directory = std::getenv("TMPDIR");
+  const std::string path = std::string(directory != nullptr ? directory : "/tmp") + "/file_drop_test_" +
+                           std::to_string(getpid()) + ".wav";
+  const uint32_t data_bytes = TOTAL_FRAMES * FORMAT.channels * sizeof(float);
+  std::ofstream file(path, std::ios::binary);
+  file.write("RIFF", 4);
+  write_le<uint32_t>(file, 36 + data_bytes);
+  file.write("WAVEfmt ", 8);
+  write_le<uint32_t>(file, 16);
+  write_le<uint16_t>(file, 3);
+  write_le<uint16_t>(file, uint16_t(FORMAT.channels));
+  write_le<uint32_t>(file, FORMAT.sample_rate);
+  write_le<uint32_t>(file, FORMAT.sample_rate * FORMAT.channels * sizeof(float));
+  write_le<uint16_t>(file, uint16_t(FORMAT.channels * sizeof(float)));
+  write_le<uint16_t>(file, 32);
+  file.write("data", 4);
+  write_le<uint32_t>(file, data_bytes);
+  for (uint32_t frame = 0; frame < TOTAL_FRAMES; frame++) {
+    write_le<float>(file, float(frame));
+    write_le<float>(file, -float(frame));
+  }
+  return path;
+}
+
+struct Delivered
+{
+  uint64_t position;
+  uint32_t frames;
+  uint32_t flags;
+  float first;
+};
+
+struct Capture
+{
+  std::mutex mutex;
+  std::vector<Delivered> blocks;
+  audio::CaptureRing ring{TOTAL_FRAMES * FORMAT.channels, TOTAL_FRAMES, FORMAT.channels};
+};
+
+// Replays the file until it stops delivering, which it does at its end or once it dropped its last block
+void replay(const std::string &device, Capture &capture)
+{
+  audio::CaptureOptions options;
+  options.pacing = audio::Pacing::unthrottled;
+  options.period_frames = BLOCK_FRAMES;
+  auto session = audio::capture_data(
+      [&capture](const audio::BufferView &view) {
+        std::lock_guard<std::mutex> lock(capture.mutex);
+        capture.blocks.push_back(Delivered{view.timing.position, view.frames, view.flags, view.data[0]});
+        capture.ring.write(view.data, size_t(view.frames) * view.format.channels, view.stamp());
+        return true;
+      },
+      audio::AudioSinkInfo{"ramp", device, false}, options);
+
+  size_t seen = 0;
+  for (int idle = 0; idle < 20; idle++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    std::lock_guard<std::mutex> lock(capture.mutex);
+    if (capture.blocks.size() != seen)
+      idle = 0;
+    seen = capture.blocks.size();
+  }
+  session.stop();
+}
+
+void drops_are_flagged_and_counted(const std::string &path)
+{
+  CHECK(audio::select_backend("faults"));
+  Capture capture;
+  replay("lossy,seed=3,drop=0.1,short=0.2|file|" + path, capture);
+
+  uint64_t end = 0;
+  uint64_t delivered = 0;
+  uint64_t gaps = 0;
+  bool positions = true;
+  bool flagged = true;
+  for (const Delivered &block : capture.blocks) {
+    // Positions count the dropped frames, so a block's position is the frame it starts with
+    positions &= block.first == float(block.position);
+    // Exactly the blocks with frames missing in front of them are flagged
+    const bool lost = block.position != end;
+    flagged &= lost == ((block.flags & audio::BUFFER_GAP) != 0);
+    gaps += lost;
+    end = block.position + block.frames;
+    delivered += block.frames;
+  }
+  CHECK(!capture.blocks.empty());
+  CHECK(gaps > 0);
+  CHECK(positions);
+  CHECK(flagged);
+  CHECK(delivered < end);
+  CHECK(end <= TOTAL_FRAMES);
+
+  // The flags come out of the ring with the blocks they were delivered with
+  audio::CaptureRing::Block block;
+  size_t index = 0;
+  bool carried = true;
+  while (capture.ring.next_block(block)) {
+    carried &= index < capture.blocks.size() && block.stamp.flags == capture.blocks[index].flags &&
+               block.stamp.timing.position == capture.blocks[index].position && !block.gap;
+    index++;
+  }
+  CHECK(carried);
+  CHECK(index == capture.blocks.size());
+}
+
+void without_faults_nothing_is_flagged(const std::string &path)
+{
+  CHECK(audio::select_backend("file"));
+  Capture capture;
+  replay(path, capture);
+
+  uint64_t end = 0;
+  bool continuous = true;
+  for (const Delivered &block : capture.blocks) {
+    continuous &= block.position == end && block.flags == 0 && block.first == float(block.position);
+    end = block.position + block.frames;
+  }
+  CHECK(continuous);
+  CHECK(end == TOTAL_FRAMES);
+}
+}
+
+int main()
+{
+  const std::string path = write_ramp();
+  without_faults_nothing_is_flagged(path);
+  drops_are_flagged_and_counted(path);
+  std::remove(path.c_str());
+  return test::result("file_drop_test");
+}
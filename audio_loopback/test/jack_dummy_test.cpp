@@ -0,0 +1,150 @@
+#include "check.h"
+#include <audio_loopback/loopback_recorder.h>
+#include <jack/jack.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <thread>
+
+extern char **environ;
+
+// Captures from a jackd running the dummy driver, started for the test under a server name of its own.
+// The process times the session reports have to be there and fit in a period. Then a second client
+// holds up a few cycles to force xruns, the blocks after them have to be flagged BUFFER_XRUN and none
+// in the quiet seconds before. Not registered with CTest, it needs jackd installed.
+namespace
+{
+const char *const SERVER = "visualizer_test";
+const uint32_t PERIOD_FRAMES = 256;
+const uint32_t RATE = 48000;
+const std::chrono::seconds SETTLE{2};
+const int STALLED_CYCLES = 3;
+
+pid_t start_jackd()
+{
+  const char *const argv[] = {"jackd", "--no-realtime", "-n", SERVER, "-d", "dummy", "-r", "48000", "-p", "256",
+                              nullptr};
+  pid_t pid;
+  if (posix_spawnp(&pid, "jackd", nullptr, nullptr, const_cast<char *const *>(argv), environ) != 0)
+    return -1;
+  return pid;
+}
+
+// The server takes a moment to come up, the first clients are refused meanwhile
+jack_client_t *connect(const char *name)
+{
+  for (int attempt = 0; attempt < 50; attempt++) {
+    if (jack_client_t *client = jack_client_open(name, JackNoStartServer, nullptr))
+      return client;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  return nullptr;
+}
+
+// Sleeps through its process callback for a few cycles once armed, the server then misses its deadlines
+struct Staller
+{
+  std::atomic<int> cycles{0};
+
+  static int process(jack_nframes_t, void *userdata)
+  {
+    auto self = static_cast<Staller *>(userdata);
+    if (self->cycles.load() > 0) {
+      self->cycles--;
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    return 0;
+  }
+};
+
+// Clients joining the graph may cost an xrun of their own, the blocks of the first phase aren't checked
+enum Phase
+{
+  JOINING,
+  QUIET,
+  STALLING,
+};
+
+struct Blocks
+{
+  std::atomic<int> phase{JOINING};
+  std::atomic<uint64_t> count{0};
+  // Blocks flagged BUFFER_XRUN in each phase
+  std::atomic<uint64_t> xruns[3];
+};
+
+void capture_through_xruns()
+{
+  jack_client_t *staller_client = connect("visualizer-staller");
+  if (!CHECK(staller_client != nullptr))
+    return;
+  Staller staller;
+  jack_set_process_callback(staller_client, &Staller::process, &staller);
+  CHECK(jack_activate(staller_client) == 0);
+
+  CHECK(audio::select_backend("jack"));
+  Blocks blocks;
+  for (auto &xruns : blocks.xruns)
+    xruns = 0;
+  audio::CaptureOptions options;
+  options.latency = std::chrono::microseconds(PERIOD_FRAMES * 1000000 / RATE);
+  auto session = audio::capture_data(
+      [&blocks](const audio::BufferView &view) {
+        blocks.count++;
+        if (view.flags & audio::BUFFER_XRUN)
+          blocks.xruns[blocks.phase]++;
+        return true;
+      },
+      audio::AudioSinkInfo{"system", "system", true}, options);
+
+  const audio::StreamInfo info = session.info();
+  CHECK(info.format.sample_rate == RATE);
+  CHECK(info.fragment_frames == PERIOD_FRAMES);
+  std::this_thread::sleep_for(SETTLE);
+  blocks.phase = QUIET;
+  std::this_thread::sleep_for(SETTLE);
+
+  // Our own process callback only interleaves a period, it has to be done well within one
+  const audio::CaptureMetrics metrics = session.metrics();
+  const std::chrono::microseconds period(PERIOD_FRAMES * 1000000 / RATE);
+  CHECK(blocks.count > 0);
+  CHECK(metrics.process_max.count() > 0);
+  CHECK(metrics.process_p99 <= metrics.process_max);
+  if (!CHECK(metrics.process_max < period))
+    std::cerr << "process took up to " << metrics.process_max.count() << "us of a " << period.count() << "us period"
+              << std::endl;
+
+  blocks.phase = STALLING;
+  staller.cycles = STALLED_CYCLES;
+  std::this_thread::sleep_for(SETTLE);
+  session.stop();
+  jack_client_close(staller_client);
+
+  CHECK(staller.cycles == 0);
+  CHECK(blocks.xruns[QUIET] == 0);
+  // Several stalled cycles may be reported as one xrun, the flag is only carried to the next period
+  const uint64_t xruns = blocks.xruns[STALLING];
+  if (!CHECK(xruns >= 1 && xruns <= uint64_t(STALLED_CYCLES)))
+    std::cerr << xruns << " blocks flagged after " << STALLED_CYCLES << " stalled cycles" << std::endl;
+}
+}
+
+int main()
+{
+  // Both the library and our own clients go to this server
+  setenv("JACK_DEFAULT_SERVER", SERVER, 1);
+  const pid_t jackd = start_jackd();
+  if (jackd < 0) {
+    std::cerr << "could not start jackd" << std::endl;
+    return 1;
+  }
+  capture_through_xruns();
+  kill(jackd, SIGTERM);
+  waitpid(jackd, nullptr, 0);
+  return test::result("jack_dummy_test");
+}
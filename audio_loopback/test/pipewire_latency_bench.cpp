@@ -0,0 +1,48 @@
+#include "capture_cadence.h"
+#include <audio_loopback/loopback_recorder.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+// The quantum PipeWire grants for the node.latency each target asks for, against the cadence the
+// blocks then come at, and the same through pipewire-pulse with the pulse audio backend. Both record
+// the monitor of a null sink loaded for the run. A quantum below what another node on the graph asks
+// for isn't granted, run it with nothing else playing.
+namespace
+{
+const char *const SINK = "visualizer_bench";
+const int LATENCIES_MS[] = {2, 5, 10, 20, 50};
+const std::chrono::seconds DURATION{5};
+}
+
+int main()
+{
+  if (!audio::select_backend("pipewire")) {
+    std::cerr << "the pipewire backend isn't built" << std::endl;
+    return 1;
+  }
+  const std::string module = test::load_null_sink(SINK);
+  if (module.empty()) {
+    std::cerr << "could not load a null sink, is pipewire-pulse running?" << std::endl;
+    return 1;
+  }
+
+  test::print_cadence_header("target ms");
+  for (int latency : LATENCIES_MS) {
+    audio::CaptureOptions options;
+    options.latency = std::chrono::milliseconds(latency);
+    options.format = audio::StreamFormat{48000, 2};
+
+    // node.name is what PipeWire targets, pulse audio records the sink's monitor source
+    audio::select_backend("pipewire");
+    test::print_cadence(std::to_string(latency) + " pw",
+                        test::measure_cadence(audio::AudioSinkInfo{SINK, SINK, false}, options, DURATION));
+    audio::select_backend("pulse");
+    test::print_cadence(std::to_string(latency) + " pa",
+                        test::measure_cadence(audio::AudioSinkInfo{SINK, std::string(SINK) + ".monitor", false},
+                                              options, DURATION));
+  }
+
+  test::unload_module(module);
+  return 0;
+}
@@ -0,0 +1,41 @@
+#include "capture_cadence.h"
+#include <audio_loopback/loopback_recorder.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+// The fragment size pulse audio grants for each latency target from 2 to 50ms and the cadence the
+// blocks then come at, recorded from the monitor of a null sink loaded for the run. Needs a running
+// pulse audio server (or pipewire-pulse) and pactl.
+namespace
+{
+const char *const SINK = "visualizer_bench";
+const int LATENCIES_MS[] = {2, 5, 10, 20, 50};
+const std::chrono::seconds DURATION{5};
+}
+
+int main()
+{
+  if (!audio::select_backend("pulse")) {
+    std::cerr << "the pulse audio backend isn't built" << std::endl;
+    return 1;
+  }
+  const std::string module = test::load_null_sink(SINK);
+  if (module.empty()) {
+    std::cerr << "could not load a null sink, is pulse audio running?" << std::endl;
+    return 1;
+  }
+
+  test::print_cadence_header("target ms");
+  for (int latency : LATENCIES_MS) {
+    audio::CaptureOptions options;
+    options.latency = std::chrono::milliseconds(latency);
+    options.format = audio::StreamFormat{48000, 2};
+    const test::Cadence cadence =
+        test::measure_cadence(audio::AudioSinkInfo{SINK, std::string(SINK) + ".monitor", false}, options, DURATION);
+    test::print_cadence(std::to_string(latency), cadence);
+  }
+
+  test::unload_module(module);
+  return 0;
+}
@@ -0,0 +1,101 @@
+#include <audio_loopback/loopback_recorder.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How late the capture thread wakes up for its blocks with and without RealtimeOptions, while a busy
+// thread per core competes for the cpu. The generator delivers 5ms blocks of 48kHz stereo on its own
+// thread like a device would, lateness is how long after its frames were due a block reached the
+// callback. Scheduling is only granted with CAP_SYS_NICE, an rtprio limit or rtkit.
+namespace
+{
+typedef std::chrono::steady_clock Clock;
+
+const audio::StreamFormat FORMAT{48000, 2};
+const std::chrono::seconds DURATION{5};
+
+double milliseconds(std::chrono::microseconds time)
+{
+  return time.count() / 1000.0;
+}
+
+// Spins until told to stop, the load a renderer or a compile puts on every core
+void hog(const std::atomic<bool> &running)
+{
+  volatile std::uint64_t counter = 0;
+  while (running.load(std::memory_order_relaxed))
+    counter = counter + 1;
+}
+
+void measure(bool realtime, bool loaded)
+{
+  audio::CaptureOptions options;
+  options.latency = std::chrono::milliseconds(5);
+  options.format = FORMAT;
+  options.realtime.enabled = realtime;
+
+  // Arrival less the time the block was due after the start, the earliest one defines on time
+  std::vector<std::chrono::microseconds> lateness;
+  lateness.reserve(DURATION.count() * 1000);
+  const Clock::time_point start = Clock::now();
+  auto session = audio::capture_data(
+      [&](const audio::BufferView &view) {
+        const auto due = std::chrono::microseconds((view.timing.position + view.frames) * 1000000 / FORMAT.sample_rate);
+        if (lateness.size() < lateness.capacity())
+          lateness.push_back(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start) - due);
+        return true;
+      },
+      audio::AudioSinkInfo{"sine", "sine:440", false}, options);
+
+  std::atomic<bool> running{true};
+  std::vector<std::thread> hogs;
+  if (loaded) {
+    for (unsigned i = 0; i < std::max(1u, std::thread::hardware_concurrency()); i++)
+      hogs.emplace_back(hog, std::cref(running));
+  }
+  std::this_thread::sleep_for(DURATION);
+  running = false;
+  for (std::thread &thread : hogs)
+    thread.join();
+  session.stop();
+
+  std::string granted = "off";
+  if (realtime) {
+    const audio::RealtimeGrant grant = session.info().realtime.get();
+    granted = grant.scheduling ? (grant.rtkit ? "rtkit" : "fifo") : "refused";
+  }
+  std::sort(lateness.begin(), lateness.end());
+  for (std::size_t i = lateness.size(); i-- > 0;)
+    lateness[i] -= lateness.front();
+  const auto percentile = [&lateness](double percent) {
+    if (lateness.empty())
+      return 0.0;
+    return milliseconds(lateness[std::min(lateness.size() - 1, static_cast<std::size_t>(lateness.size() * percent / 100))]);
+  };
+  std::cout << std::setw(10) << granted << std::setw(8) << (loaded ? "yes" : "no") << std::setw(8) << lateness.size()
+            << std::fixed << std::setprecision(3) << std::setw(10) << percentile(50) << std::setw(10) << percentile(99)
+            << std::setw(10) << percentile(99.9) << std::setw(10) << percentile(100) << std::endl;
+}
+}
+
+int main()
+{
+  if (!audio::select_backend("generator")) {
+    std::cerr << "the generator backend isn't built" << std::endl;
+    return 1;
+  }
+  std::cout << std::setw(10) << "realtime" << std::setw(8) << "hog" << std::setw(8) << "blocks" << std::setw(10)
+            << "p50 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "p99.9 ms" << std::setw(10) << "max ms"
+            << std::endl;
+  for (bool loaded : {false, true}) {
+    measure(false, loaded);
+    measure(true, loaded);
+  }
+  return 0;
+}
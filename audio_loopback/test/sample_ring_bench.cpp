@@ -0,0 +1,143 @@
+#include <audio_loopback/sample_ring.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// How long the capture thread is held up handing a block to the render loop. The old hand-off shared one
+// history buffer under a mutex the render loop kept while it searched for the phase, the ring never waits.
+namespace
+{
+typedef std::chrono::steady_clock Clock;
+
+const std::size_t HISTORY = 1 << 18;
+// 256 frames at 48kHz, interpolated four times
+const std::size_t BLOCK = 1024;
+const std::chrono::microseconds PERIOD{5333};
+const std::chrono::microseconds RENDER_FRAME{16667};
+const std::chrono::seconds DURATION{3};
+
+// The phase search of the render loop, 600 samples against 1800 of history at a stride of 4
+float find_phase(const float *history, std::size_t end)
+{
+  float best = 0.0f;
+  for (std::size_t offset = 0; offset < 1200; offset++) {
+    float sum = 0.0f;
+    for (std::size_t i = 0; i < 600; i++)
+      sum += history[(end - 4 * i) % HISTORY] * history[(end - 4 * (i + offset)) % HISTORY];
+    best = std::max(best, sum);
+  }
+  return best;
+}
+
+struct Stalls
+{
+  std::vector<double> microseconds;
+
+  void report(const char *name)
+  {
+    std::sort(microseconds.begin(), microseconds.end());
+    double total = 0.0;
+    for (double stall : microseconds)
+      total += stall;
+    std::cout << std::setw(6) << name << std::fixed << std::setprecision(1) << "  mean " << std::setw(7)
+              << total / microseconds.size() << "us  p99 " << std::setw(7)
+              << microseconds[microseconds.size() * 99 / 100] << "us  max " << std::setw(7) << microseconds.back()
+              << "us  over " << microseconds.size() << " blocks" << std::endl;
+  }
+};
+
+// The capture thread, calls deliver once a period and times it
+template<typename Deliver>
+Stalls capture(const std::atomic<bool> &running, Deliver deliver)
+{
+  Stalls stalls;
+  std::vector<float> block(BLOCK, 0.5f);
+  auto next = Clock::now();
+  while (running.load(std::memory_order_relaxed)) {
+    const auto started = Clock::now();
+    deliver(block.data());
+    stalls.microseconds.push_back(std::chrono::duration<double, std::micro>(Clock::now() - started).count());
+    next += PERIOD;
+    std::this_thread::sleep_until(next);
+  }
+  return stalls;
+}
+
+Stalls with_mutex()
+{
+  std::mutex mutex;
+  std::vector<float> history(HISTORY);
+  std::size_t current = 0;
+  std::atomic<bool> running{true};
+  volatile float sink = 0.0f;
+
+  std::thread render([&] {
+    auto next = Clock::now();
+    while (running.load(std::memory_order_relaxed)) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        sink = find_phase(history.data(), current + HISTORY);
+      }
+      next += RENDER_FRAME;
+      std::this_thread::sleep_until(next);
+    }
+  });
+  std::thread stop([&] {
+    std::this_thread::sleep_for(DURATION);
+    running = false;
+  });
+  Stalls stalls = capture(running, [&](const float *block) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (std::size_t i = 0; i < BLOCK; i++)
+      history[(current + i) % HISTORY] = block[i];
+    current = (current + BLOCK) % HISTORY;
+  });
+  render.join();
+  stop.join();
+  return stalls;
+}
+
+Stalls with_ring()
+{
+  audio::SampleRing<float> ring(HISTORY);
+  std::atomic<bool> running{true};
+  volatile float sink = 0.0f;
+
+  std::thread render([&] {
+    std::vector<float> history(HISTORY);
+    std::size_t current = 0;
+    auto next = Clock::now();
+    while (running.load(std::memory_order_relaxed)) {
+      std::size_t count;
+      while ((count = ring.read(history.data() + current, HISTORY - current)) > 0)
+        current = (current + count) % HISTORY;
+      sink = find_phase(history.data(), current + HISTORY);
+      next += RENDER_FRAME;
+      std::this_thread::sleep_until(next);
+    }
+  });
+  std::thread stop([&] {
+    std::this_thread::sleep_for(DURATION);
+    running = false;
+  });
+  Stalls stalls = capture(running, [&](const float *block) { ring.write(block, BLOCK); });
+  render.join();
+  stop.join();
+  return stalls;
+}
+}
+
+int main()
+{
+  std::cout << "Capture thread stalls handing " << BLOCK << " samples to the render loop every "
+            << PERIOD.count() << "us" << std::endl;
+  with_mutex().report("mutex");
+  with_ring().report("ring");
+  return 0;
+}
@@ -0,0 +1,286 @@
+#include "check.h"
+#include <audio_loopback/sample_ring.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <thread>
+#include <vector>
+
+// A producer and a consumer thread stream a counting sequence through the rings. Every sample carries
+// its own index, so the consumer can tell exactly what it lost and whether anything came out of order.
+namespace
+{
+typedef audio::StampedRing<std::uint32_t, std::uint32_t> Ring;
+
+const std::uint32_t TOTAL = 1 << 22;
+
+void sample_ring_keeps_order()
+{
+  audio::SampleRing<std::uint32_t> ring(1000);
+  CHECK(ring.capacity() == 1024);
+
+  std::thread producer([&ring] {
+    std::minstd_rand random(1);
+    std::vector<std::uint32_t> chunk(700);
+    std::uint32_t next = 0;
+    while (next < TOTAL) {
+      // Only what fits, so nothing is dropped
+      const std::size_t count = std::min<std::size_t>({random() % chunk.size() + 1, TOTAL - next, ring.writable()});
+      for (std::size_t i = 0; i < count; i++)
+        chunk[i] = next + std::uint32_t(i);
+      next += std::uint32_t(ring.write(chunk.data(), count));
+      // Spinning without yielding would hold up the consumer for a whole time slice on a single core
+      if (count == 0)
+        std::this_thread::yield();
+    }
+  });
+
+  std::minstd_rand random(2);
+  std::vector<std::uint32_t> chunk(900);
+  std::uint32_t expected = 0;
+  bool ordered = true;
+  while (expected < TOTAL) {
+    const std::size_t count = ring.read(chunk.data(), random() % chunk.size() + 1);
+    for (std::size_t i = 0; i < count; i++)
+      ordered &= chunk[i] == expected++;
+    if (count == 0)
+      std::this_thread::yield();
+  }
+  producer.join();
+
+  CHECK(ordered);
+  CHECK(ring.dropped() == 0);
+  CHECK(ring.available() == 0);
+  CHECK(ring.read_position() == TOTAL);
+}
+
+// Writes total samples in blocks of up to max_block, the stamp of each block is its number.
+// A paced producer sleeps after every block like a device would, an unpaced one floods the ring.
+void produce(Ring &ring, std::uint32_t total, std::size_t max_block, std::chrono::microseconds pace)
+{
+  std::minstd_rand random(3);
+  std::vector<std::uint32_t> block(max_block);
+  std::uint32_t next = 0;
+  std::uint32_t stamp = 0;
+  while (next < total) {
+    const std::size_t count = std::min<std::size_t>(random() % max_block + 1, total - next);
+    for (std::size_t i = 0; i < count; i++)
+      block[i] = next + std::uint32_t(i);
+    ring.write(block.data(), count, stamp++);
+    next += std::uint32_t(count);
+    if (pace.count() != 0)
+      std::this_thread::sleep_for(pace);
+  }
+}
+
+struct Consumed
+{
+  std::uint64_t samples = 0;
+  std::uint64_t blocks = 0;
+  std::uint64_t gaps = 0;
+  std::uint32_t last_sample = 0;
+  std::uint32_t last_stamp = 0;
+  bool ordered = true;
+  // Blocks without gap follow on from the block before, both in samples and in stamps
+  bool continuous = true;
+};
+
+// Takes blocks like the render loop does, reading each up to its end. Stalls every stall_every blocks
+// so the lag policy has something to do, until the producer is done and the ring is empty.
+Consumed consume(Ring &ring, const std::atomic<bool> &produced, std::size_t stall_every, std::chrono::microseconds stall)
+{
+  Consumed result;
+  std::vector<std::uint32_t> chunk(4096);
+  bool first = true;
+  Ring::Block block;
+  for (;;) {
+    if (!ring.next_block(block)) {
+      if (produced.load(std::memory_order_acquire) && !ring.next_block(block))
+        break;
+      if (!produced.load(std::memory_order_acquire))
+        std::this_thread::yield();
+      continue;
+    }
+    result.blocks++;
+    if (block.gap)
+      result.gaps++;
+    else if (!first)
+      result.continuous &= block.stamp == result.last_stamp + 1;
+    result.last_stamp = block.stamp;
+
+    const std::size_t end = block.position + block.samples;
+    bool block_start = true;
+    while (end > ring.position()) {
+      const std::size_t count = ring.read(chunk.data(), std::min(end - ring.position(), chunk.size()));
+      for (std::size_t i = 0; i < count; i++) {
+        const std::uint32_t sample = chunk[i];
+        if (!first) {
+          result.ordered &= sample > result.last_sample;
+          if (!(block_start && block.gap))
+            result.continuous &= sample == result.last_sample + 1;
+        }
+        result.last_sample = sample;
+        first = false;
+        block_start = false;
+      }
+      result.samples += count;
+    }
+    if (stall_every != 0 && result.blocks % stall_every == 0)
+      std::this_thread::sleep_for(stall);
+  }
+  return result;
+}
+
+struct Schedule
+{
+  std::uint32_t total;
+  std::size_t max_block;
+  std::chrono::microseconds pace;
+  std::size_t stall_every;
+  std::chrono::microseconds stall;
+};
+
+Consumed run(Ring &ring, const Schedule &schedule)
+{
+  std::atomic<bool> produced{false};
+  std::thread producer([&] {
+    produce(ring, schedule.total, schedule.max_block, schedule.pace);
+    produced.store(true, std::memory_order_release);
+  });
+  const Consumed result = consume(ring, produced, schedule.stall_every, schedule.stall);
+  producer.join();
+  return result;
+}
+
+void block_loses_nothing()
+{
+  Ring ring(1 << 12, 64);
+  ring.set_lag_policy(audio::LagPolicy::block);
+  // The producer floods the ring, every stall of the consumer leaves it waiting for room
+  const Consumed result = run(ring, Schedule{TOTAL, 600, std::chrono::microseconds(0), 64, std::chrono::microseconds(500)});
+
+  CHECK(result.ordered);
+  CHECK(result.continuous);
+  CHECK(result.gaps == 0);
+  CHECK(result.samples == TOTAL);
+  CHECK(result.last_sample == TOTAL - 1);
+  CHECK(ring.dropped() == 0);
+  CHECK(ring.dropped_blocks() == 0);
+  CHECK(ring.skipped() == 0);
+}
+
+// A device paced producer, roughly 2M samples/s, and a consumer that stalls for about 30 blocks at a time.
+// That is well past the lag limit but short of a full ring, the policy catches up before the producer drops.
+const Schedule LAGGING{TOTAL / 4, 300, std::chrono::microseconds(20), 16, std::chrono::microseconds(2000)};
+
+void check_lagging(const Ring &ring, const Consumed &result)
+{
+  CHECK(result.ordered);
+  CHECK(result.continuous);
+  CHECK(result.gaps > 0);
+  CHECK(ring.skipped() > 0);
+  CHECK(ring.dropped_blocks() == 0);
+  // Every sample was either read, dropped by the producer or skipped by the consumer, once
+  CHECK(result.samples + ring.dropped() + ring.skipped() == LAGGING.total);
+  // The newest block is never skipped, a loaded machine may still have made the producer drop it
+  if (ring.dropped() == 0)
+    CHECK(result.last_sample == LAGGING.total - 1);
+}
+
+void drop_oldest_catches_up()
+{
+  Ring ring(1 << 15, 1 << 10);
+  ring.set_lag_policy(audio::LagPolicy::drop_oldest, 1 << 11);
+  const Consumed result = run(ring, LAGGING);
+  check_lagging(ring, result);
+}
+
+void decimate_keeps_some_blocks()
+{
+  Ring ring(1 << 15, 1 << 10);
+  ring.set_lag_policy(audio::LagPolicy::decimate, 1 << 11);
+  const Consumed result = run(ring, LAGGING);
+  check_lagging(ring, result);
+}
+
+// Ten blocks of 100 waiting against a lag limit of 200, taken without a producer in the way
+void lag_policies_skip_blocks()
+{
+  std::uint32_t data[1000];
+  for (std::uint32_t i = 0; i < 1000; i++)
+    data[i] = i;
+  Ring::Block block;
+
+  Ring dropping(4096, 64);
+  dropping.set_lag_policy(audio::LagPolicy::drop_oldest, 200);
+  for (std::uint32_t i = 0; i < 10; i++)
+    dropping.write(data + 100 * i, 100, i);
+  CHECK(dropping.next_block(block) && block.gap && block.stamp == 9);
+  CHECK(dropping.skipped() == 900 && dropping.position() == 900);
+
+  // Decimating skips lag / max_lag blocks at a time, fewer as the backlog shrinks
+  Ring decimating(4096, 64);
+  decimating.set_lag_policy(audio::LagPolicy::decimate, 200);
+  for (std::uint32_t i = 0; i < 10; i++)
+    decimating.write(data + 100 * i, 100, i);
+  std::uint32_t read[100];
+  CHECK(decimating.next_block(block) && block.gap && block.stamp == 5);
+  CHECK(decimating.read(read, 100) == 100 && read[0] == 500);
+  CHECK(decimating.next_block(block) && block.gap && block.stamp == 8);
+  CHECK(decimating.read(read, 100) == 100 && read[0] == 800);
+  CHECK(decimating.next_block(block) && !block.gap && block.stamp == 9);
+  CHECK(decimating.skipped() == 700);
+}
+
+void drop_newest_flags_the_next_block()
+{
+  Ring ring(16, 8);
+  const std::uint32_t first[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+  const std::uint32_t second[8] = {12, 13, 14, 15, 16, 17, 18, 19};
+  CHECK(ring.write(first, 12, 0) == 12);
+  CHECK(ring.write(second, 8, 1) == 4);
+  CHECK(ring.dropped() == 4);
+
+  std::uint32_t data[16];
+  Ring::Block block;
+  CHECK(ring.next_block(block) && !block.gap && block.samples == 12);
+  CHECK(ring.read(data, block.samples) == 12);
+  CHECK(ring.next_block(block) && !block.gap && block.samples == 4);
+  CHECK(ring.read(data, block.samples) == 4 && data[3] == 15);
+
+  CHECK(ring.write(second + 4, 4, 2) == 4);
+  CHECK(ring.next_block(block) && block.gap && block.stamp == 2);
+}
+
+void close_releases_a_waiting_producer()
+{
+  Ring ring(16, 8);
+  ring.set_lag_policy(audio::LagPolicy::block);
+  const std::uint32_t data[16] = {};
+  CHECK(ring.write(data, 16, 0) == 16);
+
+  std::atomic<bool> returned{false};
+  std::thread producer([&] {
+    ring.write(data, 16, 1);
+    returned = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  CHECK(!returned);
+  ring.close();
+  producer.join();
+  CHECK(returned);
+}
+}
+
+int main()
+{
+  sample_ring_keeps_order();
+  block_loses_nothing();
+  drop_oldest_catches_up();
+  decimate_keeps_some_blocks();
+  lag_policies_skip_blocks();
+  drop_newest_flags_the_next_block();
+  close_releases_a_waiting_producer();
+  return test::result("sample_ring_test");
+}
@@ -1,15 +1,19 @@
 #include <iostream>
 #include <audio_loopback/ostream_operators.h>
 #include <audio_loopback/loopback_recorder.h>
+#include <audio_loopback/channel_mix.h>
+#include <audio_loopback/sample_ring.h>
 #include <audio_filters/filters.h>
+#include <audio_filters/kernels.h>
 #include <chrono>
 #include <thread>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <fstream>
 #include <sstream>
-#include <mutex>
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <assert.h>
 #include <limits>
 #include <metaFFT/radix2.h>
@@ -26,8 +30,6 @@ void test_fft(std::vector<std::complex<float>> data) {
 }
 const uint32_t width = 2400;
 
-std::mutex mtx;
-
 class Initializer
 {
 public:
@@ -37,7 +39,8 @@ public:
     }
 };
 
-static bool capturing = true;
+// Cleared by the render loop once the window closes, read by the capture thread after every block
+static std::atomic<bool> capturing{true};
 
 struct vec4
 {
@@ -49,66 +52,112 @@ struct vec4
 
 const uint32_t BUFFER_LENGTH = width * 1000;
 
+// Only touched by the render loop, the capture thread hands samples over through sample_ring
 static vec4 samples[BUFFER_LENGTH];
 
 static int current_sample = 0;
 
-bool audio_callback(const audio::AudioBuffer &buffer)
-{
-
-  mtx.lock();
-  static uint32_t step = 0;
-  std::vector<float> new_samples;
-  for (const audio::StereoPacket &packet : buffer) {
-    //if (step++ % 2 == 0)
-    //  continue;
-    float new_sample = packet.left*0.5F + packet.right*0.5F;
-    new_sample *= 1.0F;
-    new_samples.push_back(new_sample);
+// Interpolated samples per captured frame
+const uint32_t INTERPOLATION = 4;
 
-  }
-  std::vector<std::complex<float>> to_transform(1024);
-  for(int i = 0, c = current_sample; i < 1024; i++)
-  {
-    to_transform.push_back({samples[c].x, 0.0F});
-    c+=1;
-    c%= BUFFER_LENGTH;
-  }
+// How often the capture's block size and wakeup rate are printed
+const std::chrono::seconds METRICS_INTERVAL{10};
 
-  //auto filtered = audio::filters::lowpass(new_samples);
-  //std::cout << filtered.size() << " " << new_samples.size();
+typedef audio::StampedRing<float, audio::BlockStamp> TimedRing;
 
-  for(int i = 1; i < new_samples.size(); i++)
-  {
-      auto& sample_now = new_samples[i-1];
-      auto& sample_next = new_samples[i];
+// Roughly 1.5 seconds of interpolated samples, enough to ride out a stalled frame
+static TimedRing sample_ring(1 << 18, 1 << 12);
 
-      auto sample_interp = (sample_now + sample_next) / 2.0F;
+// Samples moved into the history so far, current_sample is where the next one goes
+static uint64_t drained = 0;
 
-      float k = sample_next-sample_now;
-      auto sample1 = k*0.25 + sample_now;
-      auto sample2 = k*0.5 + sample_now;
-      auto sample3 = k*0.75 + sample_now;
+struct HistoryBlock
+{
+  // Value of drained when the block's first sample went into the history
+  uint64_t start;
+  audio::BlockStamp stamp;
+};
 
-      samples[current_sample].x = sample_now;
-      current_sample = (current_sample + 1) % BUFFER_LENGTH;
+// Blocks whose samples are in the history, oldest first, to find which sample was heard when
+static std::deque<HistoryBlock> history_blocks;
 
-      samples[current_sample].x = sample1;
-      current_sample = (current_sample + 1) % BUFFER_LENGTH;
+// Start of the newest block that doesn't follow on from the samples before it
+static uint64_t last_discontinuity = 0;
+static uint64_t discontinuities = 0;
 
+bool audio_callback(const audio::BufferView &view)
+{
+  // Runs on the capture thread, must never wait for the render loop.
+  // Every channel folded down to one, the buffers are reused between blocks.
+  static audio::DownmixMatrix downmix = audio::DownmixMatrix::mono(2);
+  static std::vector<float> mono;
+  static std::vector<float> interpolated;
+  if (downmix.inputs() != view.format.channels)
+    downmix = audio::DownmixMatrix::mono(view.format.channels);
+  if (mono.size() < view.frames) {
+    mono.resize(view.frames);
+    interpolated.resize(size_t(view.frames) * INTERPOLATION);
+  }
+  float *const mixed[1] = {mono.data()};
+  audio::deinterleave_downmix(view, nullptr, downmix, mixed);
 
-      samples[current_sample].x = sample2;
-      current_sample = (current_sample + 1) % BUFFER_LENGTH;
+  const size_t count = audio::filters::interpolate_linear(mono.data(), view.frames, INTERPOLATION, interpolated.data());
+  sample_ring.write(interpolated.data(), count, view.stamp());
 
-      samples[current_sample].x = sample3;
-      current_sample = (current_sample + 1) % BUFFER_LENGTH;
+  return capturing;
+}
 
+// Moves everything the capture thread has published into the render side history, a block at a time
+// so the lag policy can skip whole blocks when the render loop fell behind
+void drain_sample_ring()
+{
+  const size_t chunk_size = 4096;
+  static float chunk[chunk_size];
+  TimedRing::Block block;
+  while (sample_ring.next_block(block)) {
+    if (block.gap || (block.stamp.flags & audio::BUFFER_DISCONTINUITY)) {
+      last_discontinuity = drained;
+      discontinuities++;
+    }
+    history_blocks.push_back(HistoryBlock{drained, block.stamp});
+
+    // Samples whose stamp was dropped come along with the block after them
+    const size_t end = block.position + block.samples;
+    size_t remaining = end > sample_ring.position() ? end - sample_ring.position() : 0;
+    size_t count;
+    while (remaining > 0 && (count = sample_ring.read(chunk, std::min(remaining, chunk_size))) > 0) {
+      for (size_t i = 0; i < count; i++) {
+        samples[current_sample].x = chunk[i];
+        current_sample = (current_sample + 1) % BUFFER_LENGTH;
+      }
+      drained += count;
+      remaining -= count;
+    }
   }
+  // Blocks the history has already overwritten can't be shown any more
+  while (!history_blocks.empty() && drained - history_blocks.front().start > BUFFER_LENGTH)
+    history_blocks.pop_front();
+}
 
+// Drained count one past the sample the device captured, or played for loopback, at the given time.
+// That's the newest sample while it isn't due yet.
+uint64_t drained_at(std::chrono::steady_clock::time_point time, uint32_t sample_rate)
+{
+  uint64_t position = history_blocks.empty() ? drained : history_blocks.front().start;
+  for (auto block = history_blocks.rbegin(); block != history_blocks.rend(); ++block) {
+    const auto start = block->stamp.timing.device_time(0, sample_rate);
+    if (start > time)
+      continue;
+    const auto since = std::chrono::duration_cast<std::chrono::microseconds>(time - start).count();
+    position = block->start + uint64_t(since) * sample_rate * INTERPOLATION / 1000000;
+    break;
+  }
+  return std::min(position, drained);
+}
 
-  mtx.unlock();
-
-  return capturing;
+int history_index(uint64_t position)
+{
+  return static_cast<int>(position % BUFFER_LENGTH);
 }
 
 std::string load_file(const std::string &filename)
@@ -147,38 +196,98 @@ void check_shader_link(uint32_t shader)
 /// \return Best matching index
 int find_sample(const std::vector<float> &pattern, const std::vector<float> &new_samples)
 {
-  std::vector<float> conv(new_samples.size());
-  for(auto& result : conv)
-  {
-    result = std::numeric_limits<float>::infinity();
-  }
-  for (int i = 0; i < new_samples.size(); i++) {
-    float result = 0.0F;
-    int j = 0;
-    for (auto &sample : pattern) {
-
-      if ((i + j) > new_samples.size() - 1) {
-        result = std::numeric_limits<float>::infinity();
-        break;
-      }
-      auto error = (sample - new_samples[i + j++]);
-
-      result += error*error;
-    }
-    conv[i] = result;
-  }
-  return std::min_element(conv.begin(), conv.end()) - conv.begin();
+  return audio::filters::best_match(pattern.data(), pattern.size(), new_samples.data(), new_samples.size());
 }
 
-int main()
+int main(int argc, char **argv)
 {
   Initializer _init;
   const bool capture = false;
+  audio::CaptureOptions capture_options;
+  std::string device_id;
+  int render_cpu = -1;
+  std::string lag_policy;
+
+  // visualizer [--backend name] [--device id] [--unthrottled]
+  //            [--format f32le|s16le|s24le|s24_32le|s32le] [--rate hz] [--channels n]
+  //            [--realtime] [--capture-cpu n] [--render-cpu n] [--lag drop|block|decimate]
+  //            [--latency-budget ms]
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--backend" && i + 1 < argc) {
+      std::string backend = argv[++i];
+      if (!audio::select_backend(backend)) {
+        std::cout << "Unknown backend " << backend << std::endl;
+        return -1;
+      }
+    }
+    else if (arg == "--device" && i + 1 < argc)
+      device_id = argv[++i];
+    else if (arg == "--unthrottled")
+      capture_options.pacing = audio::Pacing::unthrottled;
+    else if (arg == "--rate" && i + 1 < argc)
+      capture_options.format.sample_rate = std::stoul(argv[++i]);
+    else if (arg == "--channels" && i + 1 < argc)
+      capture_options.format.channels = std::stoul(argv[++i]);
+    else if (arg == "--realtime")
+      capture_options.realtime.enabled = true;
+    else if (arg == "--capture-cpu" && i + 1 < argc)
+      capture_options.realtime.cpu = std::stoi(argv[++i]);
+    else if (arg == "--render-cpu" && i + 1 < argc)
+      render_cpu = std::stoi(argv[++i]);
+    else if (arg == "--lag" && i + 1 < argc)
+      lag_policy = argv[++i];
+    else if (arg == "--latency-budget" && i + 1 < argc) {
+      capture_options.adaptive.enabled = true;
+      capture_options.adaptive.latency_budget = std::chrono::milliseconds(std::stoi(argv[++i]));
+    }
+    else if (arg == "--format" && i + 1 < argc) {
+      std::string format = argv[++i];
+      if (format == "s16le")
+        capture_options.sample_format = audio::SampleFormat::int16;
+      else if (format == "s24le")
+        capture_options.sample_format = audio::SampleFormat::int24;
+      else if (format == "s24_32le")
+        capture_options.sample_format = audio::SampleFormat::int24_32;
+      else if (format == "s32le")
+        capture_options.sample_format = audio::SampleFormat::int32;
+      else
+        capture_options.sample_format = audio::SampleFormat::float32;
+    }
+  }
+
+  // Live capture shows the newest audio when rendering falls behind, offline runs don't lose any
+  if (lag_policy == "block" || (lag_policy.empty() && capture_options.pacing == audio::Pacing::unthrottled))
+    sample_ring.set_lag_policy(audio::LagPolicy::block);
+  else if (lag_policy == "decimate")
+    sample_ring.set_lag_policy(audio::LagPolicy::decimate);
+  else
+    sample_ring.set_lag_policy(audio::LagPolicy::drop_oldest);
+
+  std::cout << "Filter kernels " << audio::filters::simd_level_name(audio::filters::simd_level()) << std::endl;
   std::cout << "Using Default Sink" << std::endl;
-  std::cout << audio::get_default_sink(capture) << std::endl;
   audio::AudioSinkInfo default_sink = audio::get_default_sink(capture);
-
-  audio::capture_data(&audio_callback, default_sink);
+  if (!device_id.empty())
+    default_sink.device_id = device_id;
+  std::cout << default_sink << std::endl;
+
+  audio::CaptureSession session = audio::capture_data(&audio_callback, default_sink, capture_options);
+  const audio::StreamInfo stream_info = session.info();
+  std::cout << "Capturing " << stream_info << std::endl;
+  // The capture thread promotes itself when the first block arrives
+  if (stream_info.realtime.valid() &&
+      stream_info.realtime.wait_for(std::chrono::seconds(1)) == std::future_status::ready)
+    std::cout << "Capture thread " << stream_info.realtime.get() << std::endl;
+
+  // The render loop only gets pinned, FIFO priority would starve the compositor it waits on
+  if (capture_options.realtime.enabled && render_cpu >= 0) {
+    audio::RealtimeOptions render_realtime;
+    render_realtime.enabled = true;
+    render_realtime.priority = 0;
+    render_realtime.cpu = render_cpu;
+    render_realtime.lock_memory = false;
+    std::cout << "Render thread " << audio::promote_current_thread(render_realtime) << std::endl;
+  }
 
   std::string soundwave_shader_text = load_file("soundwave.glsl");
   std::string basic_vertex_text = load_file("basic_vertex.glsl");
@@ -263,15 +372,24 @@ int main()
 
   uint32_t previous_sample = current_sample;
   float a_compensation = 0.0f;
-  const float samples_per_a_cycle = 48000.0f / 440.0f;
+  const float samples_per_a_cycle = static_cast<float>(stream_info.format.sample_rate) / 440.0f;
 
   bool running = true;
   glfwSwapInterval(1);
   /* Loop until the user closes the window */
     glClear(GL_COLOR_BUFFER_BIT);
+  auto next_metrics = std::chrono::steady_clock::now() + METRICS_INTERVAL;
   while (capturing) {
-    mtx.lock();
-    uint32_t curr_sample = current_sample;
+    drain_sample_ring();
+    // Adaptive blocks follow the frame rate, an idle or minimised window lets them grow
+    session.consumed();
+    if (std::chrono::steady_clock::now() >= next_metrics) {
+      std::cout << "Capture " << session.metrics() << std::endl;
+      next_metrics += METRICS_INTERVAL;
+    }
+    // The window ends at what is being heard now, which is behind the newest sample by the output latency
+    const uint64_t curr_position = drained_at(std::chrono::steady_clock::now(), stream_info.format.sample_rate);
+    uint32_t curr_sample = history_index(curr_position);
     uint32_t samples_diff =
         curr_sample >= previous_sample ? (curr_sample - previous_sample) : ((BUFFER_LENGTH + curr_sample)
             - previous_sample);
@@ -290,19 +408,20 @@ int main()
 
     std::vector<float> curr;
     const uint32_t lookback = 1800;
-    for (int i = 0, sample_no = current_sample - (current_sample % stride); i < lookback ; i++) {
+    for (int i = 0, sample_no = curr_sample - (curr_sample % stride); i < lookback ; i++) {
       curr.push_back(samples[sample_no].x);
       sample_no -= stride;
       if (sample_no < 0)
         sample_no = BUFFER_LENGTH - 1;
     }
 
-    auto sample_loc = find_sample(prev, curr);
+    // Matching the phase across a discontinuity would only line up unrelated samples
+    const bool realign = discontinuities > 0 && last_discontinuity <= curr_position &&
+                         curr_position - last_discontinuity < lookback * stride;
+    auto sample_loc = realign ? 0 : find_sample(prev, curr);
     int a_sample = curr_sample - sample_loc*stride;
 
 
-    mtx.unlock();
-
     auto start = glfwGetTime();
     glBindBuffer(GL_UNIFORM_BUFFER, ubo);
     GLvoid *p = glMapBuffer(GL_UNIFORM_BUFFER, GL_WRITE_ONLY);
@@ -332,7 +451,12 @@ int main()
 
   }
 
+  // A producer waiting for room would never see capturing turn false otherwise
+  sample_ring.close();
+  session.stop();
   glfwTerminate();
+  std::cout << discontinuities << " discontinuities, " << sample_ring.dropped() << " samples dropped, "
+            << sample_ring.skipped() << " skipped to catch up" << std::endl;
 
 
   return 0;